@@ -0,0 +1,762 @@
+//   Copyright 2022 Kevin Godden
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+
+//
+// Rough throughput benchmarks, run from the build directory:
+//
+//   ./path_tools_bench [scale]
+//
+// scale is the number of times that the track points in
+// table_mountain_loop.gpx are repeated in the generated test
+// file, 1000 gives a file of around 1GB.
+//
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <string>
+#include <cstdio>
+#include <vector>
+
+#include "../gps_path_tools.h"
+#include "../gps_path_io.h"
+
+using namespace gps_path_tools;
+
+static const char* backend_name(const internal::scan_backend backend) {
+    switch (backend) {
+        case internal::scan_backend::scalar: return "scalar";
+        case internal::scan_backend::sse2: return "sse2";
+        case internal::scan_backend::avx2: return "avx2";
+    }
+
+    return "?";
+}
+
+static void report(const std::string& name, const double bytes, const size_t points, const long long us) {
+    const double seconds = static_cast<double>(us) / 1E6;
+
+    std::cout << std::left << std::setw(40) << name << std::right
+            << std::fixed << std::setprecision(3) << std::setw(10) << seconds << "s "
+            << std::setw(10) << std::setprecision(1) << (bytes / 1E6) / seconds << " MB/s "
+            << std::setw(12) << std::setprecision(0) << static_cast<double>(points) / seconds << " points/s" << std::endl;
+}
+
+// Writes a GPX file containing the track points of the source file repeated scale times
+static size_t make_scaled_gpx(const std::string& source, const std::string& target, const int scale) {
+    std::ifstream in(source, std::ios::binary);
+    const std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+    const auto first = text.find("<trkpt");
+    const auto last = text.rfind("</trkpt>") + 8;
+
+    std::ofstream out(target, std::ios::binary);
+    out << text.substr(0, first);
+
+    for (int i = 0; i != scale; ++i) {
+        out.write(text.data() + first, static_cast<std::streamsize>(last - first));
+    }
+
+    out << text.substr(last);
+
+    return static_cast<size_t>(out.tellp());
+}
+
+static void bench_gpx_load(const std::string& file, const size_t bytes) {
+    {
+        stopwatch sw;
+        const auto path = load_gpx_trk(file);
+        report("load_gpx_trk()", static_cast<double>(bytes), path.size(), sw.elapsed_us());
+    }
+
+    {
+        stopwatch sw;
+        const auto path = load_gpx_trk_mmap(file);
+        report("load_gpx_trk_mmap()", static_cast<double>(bytes), path.size(), sw.elapsed_us());
+    }
+
+    {
+        stopwatch sw;
+        const auto path = load_gpx_trk_parallel(file);
+        report("load_gpx_trk_parallel()", static_cast<double>(bytes), path.size(), sw.elapsed_us());
+    }
+
+    {
+        stopwatch sw;
+        size_t points = 0;
+        double dist = 0.0;
+
+        for_each_gpx_trk_batch(file, [&](const path& batch) {
+            dist += path_distance(batch.begin(), batch.end());
+            points += batch.size() - 1;
+        }, true);
+
+        report("gpx_trk_reader + path_distance()", static_cast<double>(bytes), points, sw.elapsed_us());
+    }
+
+    const internal::mapped_file mapped(file);
+
+    for (const auto backend : { internal::scan_backend::scalar, internal::scan_backend::sse2, internal::scan_backend::avx2 }) {
+        const auto& scanner = internal::get_tag_scanner(backend);
+
+        if (scanner.backend != backend) {
+            std::cout << backend_name(backend) << " not supported" << std::endl;
+            continue;
+        }
+
+        stopwatch sw;
+        path path;
+        internal::gpx_trk_parser parser;
+        parser.scanner = &scanner;
+        parser.parse(mapped.view(), path);
+
+        report(std::string("gpx_trk_parser (") + backend_name(backend) + ")", static_cast<double>(bytes), path.size(), sw.elapsed_us());
+    }
+}
+
+static void bench_time_parse() {
+    const auto path = load_gpx_trk_mmap("../test_data/table_mountain_loop.gpx");
+
+    std::vector<std::string> times;
+
+    for (const auto& p : path) {
+        auto t = time_to_str_utc(p.timestamp);
+        t.erase(23, 3);   // millisecond resolution like most GPX files
+        times.push_back(t + "Z");
+    }
+
+    const int repeat = 50;
+    const auto count = times.size() * repeat;
+    long long check = 0;
+
+    {
+        stopwatch sw;
+
+        for (int r = 0; r != repeat; ++r) {
+            for (const auto& t : times) {
+                check += time_to_us(str_to_time_utc(t));
+            }
+        }
+
+        const auto us = sw.elapsed_us();
+        std::cout << std::left << std::setw(40) << "str_to_time_utc()" << std::right << std::fixed << std::setprecision(1)
+                << std::setw(10) << static_cast<double>(us) * 1000.0 / static_cast<double>(count) << " ns/time" << std::endl;
+    }
+
+    {
+        stopwatch sw;
+
+        for (int r = 0; r != repeat; ++r) {
+            for (const auto& t : times) {
+                check -= time_to_us(parse_time_utc(t));
+            }
+        }
+
+        const auto us = sw.elapsed_us();
+        std::cout << std::left << std::setw(40) << "parse_time_utc()" << std::right << std::fixed << std::setprecision(1)
+                << std::setw(10) << static_cast<double>(us) * 1000.0 / static_cast<double>(count) << " ns/time" << std::endl;
+    }
+
+    if (check != 0) {
+        std::cout << "parse_time_utc() and str_to_time_utc() disagree!" << std::endl;
+    }
+}
+
+static void bench_gpx_save(const std::string& file) {
+    auto path = load_gpx_trk_mmap(file);
+
+    const std::string out_file = "bench_save.gpx";
+
+    stopwatch sw;
+    save_gpx_trk(out_file, path.begin(), path.end());
+    const auto us = sw.elapsed_us();
+
+    std::ifstream in(out_file, std::ios::binary | std::ios::ate);
+    report("save_gpx_trk()", static_cast<double>(in.tellg()), path.size(), us);
+
+    std::remove(out_file.c_str());
+}
+
+static void bench_csv_load(const int scale) {
+    std::ifstream in("../test_data/pass4_gps_track_log_24_08_2022.csv", std::ios::binary);
+    const std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+    // The source is small so repeat it a lot more
+    const std::string file = "bench_scaled.csv";
+
+    {
+        std::ofstream out(file, std::ios::binary);
+
+        for (int i = 0; i != scale * 20; ++i) {
+            out << text;
+        }
+    }
+
+    const auto bytes = static_cast<double>(text.size()) * scale * 20;
+
+    stopwatch sw;
+    const auto table = load_csv_columns(file, gps_log_csv_schema());
+    report("load_csv_columns()", bytes, table.rows, sw.elapsed_us());
+
+    std::remove(file.c_str());
+}
+
+static void bench_path_bin(const std::string& file) {
+    auto path = load_gpx_trk_mmap(file);
+
+    const std::string bin_file = "bench_path.bin";
+
+    {
+        stopwatch sw;
+        save_path_bin(bin_file, path.begin(), path.end());
+        const auto us = sw.elapsed_us();
+
+        std::ifstream in(bin_file, std::ios::binary | std::ios::ate);
+        report("save_path_bin()", static_cast<double>(in.tellg()), path.size(), us);
+    }
+
+    {
+        std::ifstream in(bin_file, std::ios::binary | std::ios::ate);
+        const auto bytes = static_cast<double>(in.tellg());
+
+        stopwatch sw;
+        const auto loaded = load_path_bin(bin_file);
+        report("load_path_bin()", bytes, loaded.size(), sw.elapsed_us());
+    }
+
+    std::remove(bin_file.c_str());
+}
+
+static void bench_compressed_path(const std::string& file) {
+    const auto path = load_gpx_trk_mmap(file);
+
+    stopwatch sw;
+    const auto compressed = compress_path(path.begin(), path.end());
+    const auto encode_us = sw.elapsed_us();
+    const auto bytes = static_cast<double>(compressed.data.size());
+    report("compress_path()", bytes, path.size(), encode_us);
+
+    stopwatch sw2;
+    const auto decoded = decompress_path(compressed);
+    report("decompress_path()", bytes, decoded.size(), sw2.elapsed_us());
+
+    std::cout << "  " << bytes / static_cast<double>(path.size()) << " bytes per point" << std::endl;
+}
+
+// Compares the path functions on a path and a path_soa
+static void bench_path_soa(const std::string& file) {
+    const auto path = load_gpx_trk_mmap(file);
+    const auto soa = to_path_soa(path.begin(), path.end());
+    const auto points = path.size();
+    volatile double sink = 0;
+
+    {
+        stopwatch sw;
+        sink = sink + std::get<0>(axis_aligned_bounding_box(path.begin(), path.end())).lat;
+        report("axis_aligned_bounding_box(path)", static_cast<double>(points * sizeof(path_point)), points, sw.elapsed_us());
+    }
+
+    {
+        stopwatch sw;
+        sink = sink + std::get<0>(axis_aligned_bounding_box(soa)).lat;
+        report("axis_aligned_bounding_box(path_soa)", static_cast<double>(points * 2 * sizeof(double)), points, sw.elapsed_us());
+    }
+
+    {
+        stopwatch sw;
+        sink = sink + path_distance(path.begin(), path.end());
+        report("path_distance(path)", static_cast<double>(points * sizeof(path_point)), points, sw.elapsed_us());
+    }
+
+    {
+        stopwatch sw;
+        sink = sink + path_distance(soa);
+        report("path_distance(path_soa)", static_cast<double>(points * 2 * sizeof(double)), points, sw.elapsed_us());
+    }
+
+    {
+        stopwatch sw;
+        sink = sink + std::get<2>(path_elevation_summary(path.begin(), path.end()));
+        report("path_elevation_summary(path)", static_cast<double>(points * sizeof(path_point)), points, sw.elapsed_us());
+    }
+
+    {
+        stopwatch sw;
+        sink = sink + std::get<2>(path_elevation_summary(soa));
+        report("path_elevation_summary(path_soa)", static_cast<double>(points * sizeof(double)), points, sw.elapsed_us());
+    }
+}
+
+// Compares the path functions on a path and a compact_path
+static void bench_compact_path(const std::string& file) {
+    const auto path = load_gpx_trk_mmap(file);
+    const auto points = path.size();
+    volatile double sink = 0;
+
+    compact_path compact;
+    to_compact_path(path.begin(), path.end(), compact);
+
+    {
+        stopwatch sw;
+        sink = sink + std::get<0>(axis_aligned_bounding_box(compact.begin(), compact.end())).lat;
+        report("axis_aligned_bounding_box(compact_path)", static_cast<double>(points * sizeof(compact_path_point)), points, sw.elapsed_us());
+    }
+
+    {
+        stopwatch sw;
+        sink = sink + path_distance(compact.begin(), compact.end());
+        report("path_distance(compact_path)", static_cast<double>(points * sizeof(compact_path_point)), points, sw.elapsed_us());
+    }
+}
+
+// Compares analyze_path() with calling the functions it replaces one at a time
+static void bench_analyze_path(const std::string& file) {
+    const auto path = load_gpx_trk_mmap(file);
+    const auto bytes = static_cast<double>(path.size() * sizeof(path_point));
+    volatile double sink = 0;
+
+    {
+        stopwatch sw;
+        const auto summary = generate_path_summary(path.begin(), path.end());
+        const auto speed = path_speed(path.begin(), path.end());
+        const auto heading = path_heading(path.begin(), path.end());
+        const auto distance = path_cumulative_distance(path.begin(), path.end());
+        const auto elevation = path_elevation_summary(path.begin(), path.end());
+        const auto box = axis_aligned_bounding_box(path.begin(), path.end());
+        sink = sink + summary.distance_m + speed.back().value + heading.back().value + distance.back().value + std::get<2>(elevation) + std::get<0>(box).lat;
+        report("six separate path functions", bytes, path.size(), sw.elapsed_us());
+    }
+
+    {
+        stopwatch sw;
+        const auto result = analyze_path(path.begin(), path.end());
+        sink = sink + result.summary.distance_m + result.speed.back().value + result.heading.back().value;
+        report("analyze_path()", bytes, path.size(), sw.elapsed_us());
+    }
+}
+
+static void bench_distance_batch(const std::string& file) {
+    const auto soa = [&] { const auto path = load_gpx_trk_mmap(file); return to_path_soa(path.begin(), path.end()); }();
+    const auto n = soa.size() - 1;
+    const auto bytes = static_cast<double>(n * 4 * sizeof(double));
+    std::vector<double> out(n);
+    volatile double sink = 0;
+
+    {
+        stopwatch sw;
+
+        for (size_t i = 0; i != n; ++i) {
+            out[i] = distance(soa.loc(i), soa.loc(i + 1));
+        }
+
+        sink = sink + out.back();
+        report("distance() per pair", bytes, n, sw.elapsed_us());
+    }
+
+    for (const auto backend : { internal::simd_backend::scalar, internal::simd_backend::avx2, internal::simd_backend::avx512 }) {
+        const auto& kernel = internal::get_distance_kernel(backend);
+
+        if (kernel.backend != backend) {
+            continue;
+        }
+
+        const char* names[] = { "distance_batch() scalar", "distance_batch() AVX2", "distance_batch() AVX-512" };
+
+        stopwatch sw;
+        kernel.distance(&soa.lat[0], &soa.lon[0], &soa.lat[1], &soa.lon[1], out.data(), n);
+        sink = sink + out.back();
+        report(names[static_cast<int>(backend)], bytes, n, sw.elapsed_us());
+    }
+}
+
+template <typename Distance>
+static void bench_distance_model(const path& path, const char* name) {
+    const auto bytes = static_cast<double>(path.size() * sizeof(path_point));
+    volatile double sink = 0;
+
+    stopwatch sw;
+    sink = sink + path_distance<Distance>(path.begin(), path.end());
+    report(name, bytes, path.size(), sw.elapsed_us());
+}
+
+static void bench_distance_models(const std::string& file) {
+    const auto path = load_gpx_trk_mmap(file);
+
+    bench_distance_model<distance_model::haversine>(path, "path_distance<haversine>()");
+    bench_distance_model<distance_model::nvector>(path, "path_distance<nvector>()");
+    bench_distance_model<distance_model::equirectangular>(path, "path_distance<equirectangular>()");
+    bench_distance_model<distance_model::flat_earth>(path, "path_distance<flat_earth>()");
+    bench_distance_model<distance_model::ellipsoidal>(path, "path_distance<ellipsoidal>()");
+}
+
+static void bench_ellipsoidal_distances(const std::string& file) {
+    const auto path = load_gpx_trk_mmap(file);
+    const auto bytes = static_cast<double>(path.size() * sizeof(path_point));
+    std::vector<double> out(path.size() - 1);
+    volatile double sink = 0;
+
+    {
+        stopwatch sw;
+
+        for (size_t i = 0; i != out.size(); ++i) {
+            out[i] = distance_model::ellipsoidal::distance(path[i].loc, path[i + 1].loc);
+        }
+
+        sink = sink + out.back();
+        report("ellipsoidal::distance() per pair", bytes, path.size(), sw.elapsed_us());
+    }
+
+    {
+        stopwatch sw;
+        ellipsoidal_distances(path.begin(), path.end(), out.data(), 1);
+        sink = sink + out.back();
+        report("ellipsoidal_distances() 1 thread", bytes, path.size(), sw.elapsed_us());
+    }
+
+    {
+        stopwatch sw;
+        ellipsoidal_distances(path.begin(), path.end(), out.data());
+        sink = sink + out.back();
+        report("ellipsoidal_distances()", bytes, path.size(), sw.elapsed_us());
+    }
+}
+
+static void bench_prepared_path(const std::string& file) {
+    const auto path = load_gpx_trk_mmap(file);
+    const auto bytes = static_cast<double>(path.size() * sizeof(path_point));
+    const size_t queries = 10;
+    volatile size_t sink = 0;
+
+    {
+        stopwatch sw;
+
+        for (size_t q = 0; q != queries; ++q) {
+            sink = sink + (find_closest_path_point_dist(path, path[q * 100].loc) - path.begin());
+        }
+
+        report("find_closest_path_point_dist() x10", bytes * queries, path.size() * queries, sw.elapsed_us());
+    }
+
+    stopwatch prepare_sw;
+    const auto prepared = prepare_path(path);
+    report("prepare_path()", bytes, path.size(), prepare_sw.elapsed_us());
+
+    {
+        stopwatch sw;
+
+        for (size_t q = 0; q != queries; ++q) {
+            sink = sink + (find_closest_path_point_dist(prepared, prepare_location(path[q * 100].loc)) - prepared.begin());
+        }
+
+        report("prepared find_closest_path_point_dist() x10", bytes * queries, path.size() * queries, sw.elapsed_us());
+    }
+
+    {
+        stopwatch sw;
+        sink = sink + path_heading(path).size();
+        report("path_heading()", bytes, path.size(), sw.elapsed_us());
+    }
+
+    {
+        stopwatch sw;
+        sink = sink + path_heading(prepared).size();
+        report("prepared path_heading()", bytes, path.size(), sw.elapsed_us());
+    }
+}
+
+static void bench_parallel_reductions(const std::string& file) {
+    const auto path = load_gpx_trk_mmap(file);
+    const auto bytes = static_cast<double>(path.size() * sizeof(path_point));
+    volatile double sink = 0;
+
+    for (const unsigned threads : { 1u, 0u }) {
+        const std::string suffix = threads == 1 ? " 1 thread" : "";
+
+        {
+            stopwatch sw;
+            sink = sink + path_distance_parallel(path, threads);
+            report("path_distance_parallel()" + suffix, bytes, path.size(), sw.elapsed_us());
+        }
+
+        {
+            stopwatch sw;
+            sink = sink + std::get<2>(path_elevation_summary_parallel(path, threads));
+            report("path_elevation_summary_parallel()" + suffix, bytes, path.size(), sw.elapsed_us());
+        }
+
+        {
+            stopwatch sw;
+            sink = sink + std::get<0>(axis_aligned_bounding_box_parallel(path, threads)).lat;
+            report("axis_aligned_bounding_box_parallel()" + suffix, bytes, path.size(), sw.elapsed_us());
+        }
+
+        {
+            stopwatch sw;
+            sink = sink + static_cast<double>(find_farthest_point_parallel(path, path.front().loc, threads) - path.begin());
+            report("find_farthest_point_parallel()" + suffix, bytes, path.size(), sw.elapsed_us());
+        }
+    }
+}
+
+static void bench_path_spatial_index(const std::string& file) {
+    const auto path = load_gpx_trk_mmap(file);
+    const auto bytes = static_cast<double>(path.size() * sizeof(path_point));
+    volatile size_t sink = 0;
+
+    std::vector<location> targets;
+
+    for (size_t i = 0; i < path.size(); i += path.size() / 100 + 1) {
+        targets.push_back({ path[i].loc.lat + 0.0001, path[i].loc.lon - 0.0001 });
+    }
+
+    const auto queries = targets.size();
+
+    {
+        stopwatch sw;
+
+        for (const auto& target : targets) {
+            sink = sink + (find_closest_path_point_dist(path, target) - path.begin());
+        }
+
+        report("find_closest_path_point_dist() x" + std::to_string(queries), bytes * static_cast<double>(queries), path.size() * queries, sw.elapsed_us());
+    }
+
+    stopwatch build_sw;
+    const auto index = make_path_spatial_index(path);
+    report("path_spatial_index()", bytes, path.size(), build_sw.elapsed_us());
+
+    {
+        stopwatch sw;
+
+        for (const auto& target : targets) {
+            sink = sink + (index.find_closest(target) - path.begin());
+        }
+
+        report("index find_closest() x" + std::to_string(queries), bytes * static_cast<double>(queries), path.size() * queries, sw.elapsed_us());
+    }
+
+    {
+        stopwatch sw;
+        sink = sink + index.find_closest(targets).size();
+        report("index batch find_closest() x" + std::to_string(queries), bytes * static_cast<double>(queries), path.size() * queries, sw.elapsed_us());
+    }
+}
+
+static void bench_path_time_index(const std::string& file) {
+    // The copies of the loop repeat its times, so space them a second apart
+    auto path = load_gpx_trk_mmap(file);
+
+    for (size_t i = 1; i != path.size(); ++i) {
+        path[i].timestamp = path[0].timestamp + std::chrono::seconds(i);
+    }
+
+    const auto bytes = static_cast<double>(path.size() * sizeof(path_point));
+    volatile double sink = 0;
+
+    // A frame every 100ms over the first few minutes
+    std::vector<path_time> frames;
+
+    for (auto t = path.front().timestamp; frames.size() != 2000; t += std::chrono::milliseconds(100)) {
+        frames.push_back(t);
+    }
+
+    const auto queries = frames.size();
+
+    {
+        stopwatch sw;
+
+        for (size_t q = 0; q != 100; ++q) {
+            sink = sink + static_cast<double>(find_closest_path_point_time(path, frames[q]) - path.begin());
+        }
+
+        report("find_closest_path_point_time() x100", bytes * 100, path.size() * 100, sw.elapsed_us());
+    }
+
+    stopwatch build_sw;
+    const auto index = make_path_time_index(path);
+    report("path_time_index()", bytes, path.size(), build_sw.elapsed_us());
+
+    {
+        stopwatch sw;
+
+        for (const auto& t : frames) {
+            sink = sink + index.position_at(t).lat;
+        }
+
+        report("position_at() x" + std::to_string(queries), bytes * static_cast<double>(queries), path.size() * queries, sw.elapsed_us());
+    }
+
+    {
+        stopwatch sw;
+        sink = sink + index.position_at(frames).back().lat;
+        report("batch position_at() x" + std::to_string(queries), bytes * static_cast<double>(queries), path.size() * queries, sw.elapsed_us());
+    }
+}
+
+static void bench_path_prefix_index(const std::string& file) {
+    const auto path = load_gpx_trk_mmap(file);
+    const auto bytes = static_cast<double>(path.size() * sizeof(path_point));
+    const size_t laps = 1000;
+    volatile double sink = 0;
+
+    // Laps of a tenth of the path
+    const auto lap = path.size() / 10;
+
+    {
+        stopwatch sw;
+
+        for (size_t q = 0; q != 100; ++q) {
+            const auto i = (q * 7919) % (path.size() - lap);
+            sink = sink + path_distance(path.begin() + i, path.begin() + i + lap);
+        }
+
+        report("path_distance() x100 laps", bytes / 10 * 100, lap * 100, sw.elapsed_us());
+    }
+
+    stopwatch build_sw;
+    const auto index = make_path_prefix_index(path);
+    report("path_prefix_index()", bytes, path.size(), build_sw.elapsed_us());
+
+    {
+        stopwatch sw;
+
+        for (size_t q = 0; q != laps; ++q) {
+            const auto i = (q * 7919) % (path.size() - lap);
+            sink = sink + index.distance(i, i + lap) + index.ascent(i, i + lap) + index.mean_speed(i, i + lap);
+        }
+
+        report("prefix index laps x" + std::to_string(laps), bytes / 10 * laps, lap * laps, sw.elapsed_us());
+    }
+}
+
+static void bench_path_range_index(const std::string& file) {
+    const auto path = load_gpx_trk_mmap(file);
+    const auto bytes = static_cast<double>(path.size() * sizeof(path_point));
+    const size_t queries = 1000;
+    volatile double sink = 0;
+
+    // Chart zooms of a tenth of the path
+    const auto window = path.size() / 10;
+
+    {
+        stopwatch sw;
+
+        for (size_t q = 0; q != 100; ++q) {
+            const auto i = (q * 7919) % (path.size() - window);
+            const auto start = path.begin() + i;
+            sink = sink + std::get<0>(path_elevation_summary(start, start + window))->loc.ele;
+            sink = sink + std::get<0>(axis_aligned_bounding_box(start, start + window)).lat;
+        }
+
+        report("path_elevation_summary() & box x100", bytes / 10 * 100, window * 100, sw.elapsed_us());
+    }
+
+    stopwatch build_sw;
+    const auto index = make_path_range_index(path);
+    report("path_range_index()", bytes, path.size(), build_sw.elapsed_us());
+
+    {
+        stopwatch sw;
+
+        for (size_t q = 0; q != queries; ++q) {
+            const auto i = (q * 7919) % (path.size() - window);
+            sink = sink + std::get<0>(index.elevation_range(i, i + window))->loc.ele;
+            sink = sink + std::get<0>(index.bounding_box(i, i + window)).lat;
+        }
+
+        report("range index queries x" + std::to_string(queries), bytes / 10 * queries, window * queries, sw.elapsed_us());
+    }
+}
+
+static void bench_path_linear_reference(const std::string& file) {
+    const auto path = load_gpx_trk_mmap(file);
+    const auto bytes = static_cast<double>(path.size() * sizeof(path_point));
+    volatile double sink = 0;
+
+    // Vehicles near the route
+    std::vector<location> targets;
+
+    for (size_t i = 0; i < path.size(); i += path.size() / 100 + 1) {
+        targets.push_back({ path[i].loc.lat + 0.0001, path[i].loc.lon - 0.0001 });
+    }
+
+    const auto queries = targets.size();
+
+    {
+        stopwatch sw;
+
+        for (const auto& target : targets) {
+            sink = sink + project_onto_path(path, target).distance_m;
+        }
+
+        report("project_onto_path() x" + std::to_string(queries), bytes * static_cast<double>(queries), path.size() * queries, sw.elapsed_us());
+    }
+
+    stopwatch build_sw;
+    const auto route = make_path_linear_reference(path);
+    report("path_linear_reference()", bytes, path.size(), build_sw.elapsed_us());
+
+    {
+        stopwatch sw;
+
+        for (const auto& target : targets) {
+            sink = sink + route.project_onto_path(target).distance_m;
+        }
+
+        report("route project_onto_path() x" + std::to_string(queries), bytes * static_cast<double>(queries), path.size() * queries, sw.elapsed_us());
+    }
+
+    {
+        stopwatch sw;
+
+        for (size_t q = 0; q != 10000; ++q) {
+            sink = sink + route.point_at_distance(route.length() * static_cast<double>(q) / 10000.0).loc.lat;
+        }
+
+        report("point_at_distance() x10000", bytes * 10000, path.size() * 10000, sw.elapsed_us());
+    }
+}
+
+int main(int argc, char** argv) {
+    const int scale = argc > 1 ? std::atoi(argv[1]) : 100;
+    const std::string file = "bench_scaled.gpx";
+
+    std::cout << "Generating GPX with " << scale << " copies of table_mountain_loop.gpx" << std::endl;
+    const auto bytes = make_scaled_gpx("../test_data/table_mountain_loop.gpx", file, scale);
+    std::cout << "File size: " << bytes / 1000000 << "MB" << std::endl;
+
+    bench_time_parse();
+    bench_gpx_load(file, bytes);
+    bench_gpx_save(file);
+    bench_path_bin(file);
+    bench_compressed_path(file);
+    bench_path_soa(file);
+    bench_compact_path(file);
+    bench_analyze_path(file);
+    bench_distance_batch(file);
+    bench_distance_models(file);
+    bench_ellipsoidal_distances(file);
+    bench_prepared_path(file);
+    bench_parallel_reductions(file);
+    bench_path_spatial_index(file);
+    bench_path_time_index(file);
+    bench_path_prefix_index(file);
+    bench_path_range_index(file);
+    bench_path_linear_reference(file);
+    bench_csv_load(scale);
+
+    std::remove(file.c_str());
+
+    return 0;
+}
@@ -21,6 +21,25 @@
 #include <fstream>
 #include <regex>
 #include <optional>
+#include <string_view>
+#include <charconv>
+#include <algorithm>
+#include <cstdint>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 namespace gps_path_tools {
 
@@ -149,7 +168,7 @@ path load_gpx_trk(const std::string& filename) {
             case gpx_state::have_closing_tag:
                 if (in_trkpt) {
                     if (closing.rfind("</ti", 0) == 0) {
-                        time = str_to_time_utc(element);
+                        time = parse_time_utc(element);
                     }
                     else if (closing.rfind("</el", 0) == 0) {
                         ele = atof(element.c_str());
@@ -169,116 +188,2204 @@ path load_gpx_trk(const std::string& filename) {
     return gpx_path;
 }
 
-inline bool internal_save_gpx_trk(const std::string filename,
-                                const path::iterator start_it,
-                                const path::iterator end_it,
-                                const std::optional<waypoints::iterator> start_way,
-                                const std::optional<waypoints::iterator> end_way) {
+namespace internal {
 
-    if (start_it == end_it)
-        return false;
-    
-    static const std::string_view header = R"(<?xml version="1.0" encoding="UTF-8" standalone="yes"?>
-                <gpx version="1.1" xmlns="http://www.topografix.com/GPX/1/1" xmlns:xsi="http://www.w3.org/2001/XMLSchema-instance" xsi:schemaLocation="http://www.topografix.com/GPX/1/1 http://www.topografix.com/GPX/1/1/gpx.xsd" xmlns:oa="http://www.outdooractive.com/GPX/Extensions/1">
-                  <metadata>
-                  </metadata>
-                  
-                )";
-    
-    static const std::string_view footer = R"(</trkseg>
-                            </trk>
-                            </gpx>)";
-    
-    std::ofstream out(filename);
-    
-    if (!out) {
-        return false;
+//
+// A read-only memory mapping of a whole file, the mapping
+// is released when the object goes out of scope.
+//
+class mapped_file {
+    const char* data = nullptr;
+    size_t size = 0;
+    bool open = false;
+
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#endif
+
+public:
+
+    explicit mapped_file(const std::string& filename) {
+#ifdef _WIN32
+        file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                            OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+
+        if (file == INVALID_HANDLE_VALUE) {
+            return;
+        }
+
+        LARGE_INTEGER file_size{};
+
+        if (!GetFileSizeEx(file, &file_size)) {
+            return;
+        }
+
+        size = static_cast<size_t>(file_size.QuadPart);
+
+        // Can't map an empty file, but it is still a valid (empty) file
+        if (size == 0) {
+            open = true;
+            return;
+        }
+
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+        if (mapping == nullptr) {
+            return;
+        }
+
+        data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        open = data != nullptr;
+#else
+        const int fd = ::open(filename.c_str(), O_RDONLY);
+
+        if (fd < 0) {
+            return;
+        }
+
+        struct stat st{};
+
+        if (fstat(fd, &st) != 0) {
+            ::close(fd);
+            return;
+        }
+
+        size = static_cast<size_t>(st.st_size);
+
+        if (size == 0) {
+            ::close(fd);
+            open = true;
+            return;
+        }
+
+        void* p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        // The mapping holds its own reference to the file
+        ::close(fd);
+
+        if (p == MAP_FAILED) {
+            return;
+        }
+
+        // We read front to back
+        madvise(p, size, MADV_SEQUENTIAL);
+
+        data = static_cast<const char*>(p);
+        open = true;
+#endif
     }
 
-    out << header;
-    out.precision(10);
-    
-    /*
-    Like:
-        <wpt lat="37.7749" lon="-122.4194">
-            <ele>16.0</ele>
-            <time>2026-02-20T15:00:00Z</time>
-            <name>San Francisco</name>
-            <cmt>Visited during trip</cmt>
-        </wpt>
-    
-    */
-   
-    // Stream waypoints if any
-    if (start_way && end_way) {
-        const auto end = end_way.value();
-        for (auto w = start_way.value(); w != end; ++w) {
-            const auto lat = w->loc.lat;
-            const auto lon = w->loc.lon;
+    ~mapped_file() {
+#ifdef _WIN32
+        if (data) {
+            UnmapViewOfFile(data);
+        }
 
-            out << "<wpt lat=\"" << lat << "\"" << " lon=\"" << lon << "\">" << std::endl;
-            out << "<ele>" << w->loc.ele << "</ele>" << std::endl;
+        if (mapping) {
+            CloseHandle(mapping);
+        }
 
-            if (w->timestamp != std::chrono::system_clock::time_point{}) {
-                const auto time = time_to_str_utc(w->timestamp);
-                out << "<time>" << time << "</time>" << std::endl;
-            }
+        if (file != INVALID_HANDLE_VALUE) {
+            CloseHandle(file);
+        }
+#else
+        if (data) {
+            munmap(const_cast<char*>(data), size);
+        }
+#endif
+    }
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    bool is_open() const {
+        return open;
+    }
+
+    std::string_view view() const {
+        return data ? std::string_view(data, size) : std::string_view();
+    }
+};
+
+inline bool starts_with(const std::string_view s, const std::string_view prefix) {
+    return s.size() >= prefix.size() && s.compare(0, prefix.size(), prefix) == 0;
+}
+
+inline std::string_view trim_left(std::string_view s) {
+    while (!s.empty() && is_space(s.front())) {
+        s.remove_prefix(1);
+    }
+
+    return s;
+}
+
+// Finds the value of the named attribute in the given tag, e.g. for the tag
+// <trkpt lat="52.988201" lon="-6.413192"> and the name "lat" it returns 52.988201
+inline bool parse_attribute(const std::string_view tag, const std::string_view name, double& value) {
+    size_t pos = 0;
+
+    while ((pos = tag.find(name, pos + 1)) != std::string_view::npos) {
+        const auto after = pos + name.size();
+
+        // Must be a whole attribute name, i.e. preceded by white space
+        // and followed by =" or ='
+        if (is_space(tag[pos - 1]) && after + 1 < tag.size() && tag[after] == '=' &&
+            (tag[after + 1] == '"' || tag[after + 1] == '\'')) {
+            return parse_double(tag.substr(after + 2), value);
+        }
+    }
+
+    return false;
+}
+
+//
+// Tag scanning, finds the characters and tags that the GPX parser
+// is interested in. There are SSE2 and AVX2 versions which look
+// at 16 or 32 bytes at a time and a portable scalar version, the
+// best one that the CPU supports is chosen at runtime.
+//
+
+enum class scan_backend {
+    scalar,
+    sse2,
+    avx2,
+};
+
+struct tag_scanner {
+    scan_backend backend;
 
-            if (!w->name.empty()) {
-                out << "<name>" << w->name << "</name>" << std::endl;
+    // Returns a pointer to the first c in [p, end) or end if not found
+    const char* (*find_char)(const char* p, const char* end, char c);
+
+    // Returns a pointer to the first occurrence of the n character
+    // tag in [p, end) or end if not found
+    const char* (*find_tag)(const char* p, const char* end, const char* tag, size_t n);
+};
+
+inline const char* find_char_scalar(const char* p, const char* end, const char c) {
+    if (p == end) {
+        return end;
+    }
+
+    const auto found = static_cast<const char*>(std::memchr(p, c, static_cast<size_t>(end - p)));
+    return found ? found : end;
+}
+
+inline const char* find_tag_scalar(const char* p, const char* end, const char* tag, const size_t n) {
+    const std::string_view s(p, static_cast<size_t>(end - p));
+    const auto pos = s.find(std::string_view(tag, n));
+    return pos == std::string_view::npos ? end : p + pos;
+}
+
+#ifdef GPS_PATH_TOOLS_X86_SIMD
+
+inline int count_trailing_zeros(const unsigned mask) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+GPS_PATH_TOOLS_TARGET_SSE2 inline const char* find_char_sse2(const char* p, const char* end, const char c) {
+    const __m128i v = _mm_set1_epi8(c);
+
+    for (; end - p >= 16; p += 16) {
+        const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        const auto mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, v)));
+
+        if (mask) {
+            return p + count_trailing_zeros(mask);
+        }
+    }
+
+    return find_char_scalar(p, end, c);
+}
+
+// Compares the first and last characters of the tag at 16 positions at
+// a time, only those positions where both match are checked in full.
+GPS_PATH_TOOLS_TARGET_SSE2 inline const char* find_tag_sse2(const char* p, const char* end, const char* tag, const size_t n) {
+    if (n < 2) {
+        return n == 0 ? p : find_char_sse2(p, end, tag[0]);
+    }
+
+    const __m128i first = _mm_set1_epi8(tag[0]);
+    const __m128i last = _mm_set1_epi8(tag[n - 1]);
+    const auto span = static_cast<std::ptrdiff_t>(16 + n - 1);
+
+    for (; end - p >= span; p += 16) {
+        const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + n - 1));
+        auto mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last))));
+
+        while (mask) {
+            const auto candidate = p + count_trailing_zeros(mask);
+
+            if (std::memcmp(candidate + 1, tag + 1, n - 2) == 0) {
+                return candidate;
             }
 
-            if (!w->cmt.empty()) {
-                out << "<cmt>" << w->cmt << "</cmt>" << std::endl;
+            mask &= mask - 1;
+        }
+    }
+
+    return find_tag_scalar(p, end, tag, n);
+}
+
+GPS_PATH_TOOLS_TARGET_AVX2 inline const char* find_char_avx2(const char* p, const char* end, const char c) {
+    const __m256i v = _mm256_set1_epi8(c);
+
+    for (; end - p >= 32; p += 32) {
+        const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        const auto mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, v)));
+
+        if (mask) {
+            return p + count_trailing_zeros(mask);
+        }
+    }
+
+    return find_char_sse2(p, end, c);
+}
+
+GPS_PATH_TOOLS_TARGET_AVX2 inline const char* find_tag_avx2(const char* p, const char* end, const char* tag, const size_t n) {
+    if (n < 2) {
+        return n == 0 ? p : find_char_avx2(p, end, tag[0]);
+    }
+
+    const __m256i first = _mm256_set1_epi8(tag[0]);
+    const __m256i last = _mm256_set1_epi8(tag[n - 1]);
+    const auto span = static_cast<std::ptrdiff_t>(32 + n - 1);
+
+    for (; end - p >= span; p += 32) {
+        const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + n - 1));
+        auto mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last))));
+
+        while (mask) {
+            const auto candidate = p + count_trailing_zeros(mask);
+
+            if (std::memcmp(candidate + 1, tag + 1, n - 2) == 0) {
+                return candidate;
             }
-            
-            out << "</wpt>";
-            out << std::endl;
+
+            mask &= mask - 1;
         }
     }
 
-    out << "<trk><trkseg>";
-                    
-    /*
-    Like: 
-    <trkpt lat="52.988222" lon="-6.413189">
-        <ele>166.27321</ele>
-        <time>2022-05-07T10:20:08.000Z</time>
-    </trkpt>    
-    */
-    
-    for (auto i = start_it; i != end_it; ++i) {
-        const auto lat = i->loc.lat;
-        const auto lon = i->loc.lon;
-        const auto time = time_to_str_utc(i->timestamp);
+    return find_tag_sse2(p, end, tag, n);
+}
+
+#endif
 
-        out << "<trkpt lat=\"" << lat << "\"" << " lon=\"" << lon << "\">" << std::endl;
-        out << "<ele>" << i->loc.ele << "</ele>" << std::endl;
-        out << "<time>" << time << "</time>" << std::endl;
-        out << "</trkpt>";
-        out << std::endl;
+// Returns the scanner for the given backend, or the scalar
+// scanner if the CPU doesn't support it.
+inline const tag_scanner& get_tag_scanner(const scan_backend backend) {
+    static const tag_scanner scalar { scan_backend::scalar, find_char_scalar, find_tag_scalar };
+
+#ifdef GPS_PATH_TOOLS_X86_SIMD
+    static const tag_scanner sse2 { scan_backend::sse2, find_char_sse2, find_tag_sse2 };
+    static const tag_scanner avx2 { scan_backend::avx2, find_char_avx2, find_tag_avx2 };
+
+    if (backend == scan_backend::avx2 && cpu_has_avx2()) {
+        return avx2;
     }
 
-    out << footer;
+    if (backend != scan_backend::scalar && cpu_has_sse2()) {
+        return sse2;
+    }
+#endif
 
-    return true;
+    return scalar;
 }
 
-inline bool save_gpx_trk(const std::string filename,
-                            const path::iterator start_it,
-                            const path::iterator end_it) {
-                                
-    return internal_save_gpx_trk(filename, start_it, end_it, {}, {});
+// Returns the best scanner supported by this CPU
+inline const tag_scanner& get_tag_scanner() {
+    static const tag_scanner& best = get_tag_scanner(scan_backend::avx2);
+    return best;
 }
 
-inline bool save_gpx_trk(const std::string filename,
-                        const path::iterator start_it,
-                        const path::iterator end_it,
-                        const waypoints::iterator start_way,
-                        const waypoints::iterator end_way) {
+//
+// Parses the track points from GPX data in place, i.e. without copying
+// tags or element text. The parser keeps its state between calls to
+// parse() so the data can be fed to it in pieces, see parse().
+//
+// The results are the same as those of load_gpx_trk().
+//
+struct gpx_trk_parser {
+    const tag_scanner* scanner = &get_tag_scanner();
 
-    return internal_save_gpx_trk(filename, start_it, end_it, start_way, end_way);
+    bool in_trkpt{};
+
+    double lat{};
+    double lon{};
+    double ele{};
+    int seq{};
+
+    path_time time{};
+
+    // Set once each of the point values has been read, and the number of
+    // points added before that. Those points hold the initial (zero) value
+    // rather than one carried over from an earlier point, which matters when
+    // a file is parsed in pieces, see parse_gpx_trk_parallel().
+    bool have_lat{};
+    bool have_lon{};
+    bool have_ele{};
+    bool have_time{};
+
+    size_t no_lat{};
+    size_t no_lon{};
+    size_t no_ele{};
+    size_t no_time{};
+
+    // Parses the tags in buf appending any completed track points to out.
+    // Returns the offset just past the last complete tag in buf, anything
+    // from there on (a partial tag or element text) has not been consumed
+    // and should be passed in again at the start of the next piece.
+    size_t parse(const std::string_view buf, path& out) {
+        size_t pos = 0;
+
+        for (;;) {
+            // Between track points there is nothing of interest,
+            // so jump straight to the next one.
+            if (!in_trkpt) {
+                const auto trkpt = find(buf, pos, "<trkpt");
+
+                if (trkpt == std::string_view::npos) {
+                    // Keep enough of the end to match a
+                    // <trkpt split across two pieces
+                    return std::max(pos, buf.size() - std::min(buf.size(), size_t{5}));
+                }
+
+                pos = trkpt;
+            }
+
+            const auto open = find(buf, pos, '<');
+
+            if (open == std::string_view::npos) {
+                return pos;
+            }
+
+            const auto close = find(buf, open + 1, '>');
+
+            if (close == std::string_view::npos) {
+                return pos;
+            }
+
+            const auto tag = buf.substr(open, close - open + 1);
+
+            if (tag.size() > 1 && tag[1] == '/') {
+                closing_tag(tag, buf.substr(pos, open - pos), out);
+            } else {
+                opening_tag(tag);
+            }
+
+            pos = close + 1;
+        }
+    }
+
+    size_t find(const std::string_view buf, const size_t pos, const char c) const {
+        const auto end = buf.data() + buf.size();
+        const auto found = scanner->find_char(buf.data() + pos, end, c);
+        return found == end ? std::string_view::npos : static_cast<size_t>(found - buf.data());
+    }
+
+    size_t find(const std::string_view buf, const size_t pos, const std::string_view tag) const {
+        const auto end = buf.data() + buf.size();
+        const auto found = scanner->find_tag(buf.data() + pos, end, tag.data(), tag.size());
+        return found == end ? std::string_view::npos : static_cast<size_t>(found - buf.data());
+    }
+
+    void opening_tag(const std::string_view tag) {
+        if (starts_with(tag, "<trkp")) {
+            in_trkpt = true;
+            have_lat = parse_attribute(tag, "lat", lat) || have_lat;
+            have_lon = parse_attribute(tag, "lon", lon) || have_lon;
+        }
+    }
+
+    // element is the text between the previous tag and this one
+    void closing_tag(const std::string_view tag, const std::string_view element, path& out) {
+        if (in_trkpt) {
+            if (starts_with(tag, "</ti")) {
+                time = parse_time_utc(element);
+                have_time = true;
+            } else if (starts_with(tag, "</el")) {
+                if (!parse_double(element, ele)) {
+                    ele = 0.0;
+                }
+
+                have_ele = true;
+            }
+        }
+
+        if (starts_with(tag, "</trkp")) {
+            in_trkpt = false;
+
+            no_lat += !have_lat;
+            no_lon += !have_lon;
+            no_ele += !have_ele;
+            no_time += !have_time;
+
+            out.emplace_back(path_point{{ lat, lon, ele }, time, seq++});
+        }
+    }
+};
+
+//
+// Parses the track points in a whole GPX buffer using several threads. The
+// buffer is split into chunks just before <trkpt tags, each chunk is parsed
+// separately and the results are joined back together in order. The result
+// is the same as parsing the whole buffer in one go.
+//
+inline path parse_gpx_trk_parallel(const std::string_view buf, const unsigned threads, const size_t min_chunk_size) {
+    const auto thread_count = threads ? threads : default_thread_count();
+
+    // A few chunks per thread helps to even out the load
+    const auto max_chunks = static_cast<size_t>(thread_count) * 4;
+    const auto chunk_count = std::max(size_t{1}, std::min(max_chunks, buf.size() / std::max(size_t{1}, min_chunk_size)));
+
+    const auto& scanner = get_tag_scanner();
+    const auto end = buf.data() + buf.size();
+
+    // Chunk boundaries, each chunk but the first starts on a <trkpt
+    std::vector<const char*> bounds { buf.data() };
+
+    for (size_t i = 1; i < chunk_count; ++i) {
+        const auto nominal = buf.data() + buf.size() / chunk_count * i;
+        const auto at = scanner.find_tag(std::max(nominal, bounds.back()), end, "<trkpt", 6);
+
+        if (at == end) {
+            break;
+        }
+
+        if (at != bounds.back()) {
+            bounds.push_back(at);
+        }
+    }
 
+    bounds.push_back(end);
+
+    const auto chunks = bounds.size() - 1;
+
+    std::vector<path> parts(chunks);
+    std::vector<gpx_trk_parser> parsers(chunks);
+
+    run_tasks(chunks, thread_count, [&](const size_t i) {
+        parsers[i].parse(std::string_view(bounds[i], static_cast<size_t>(bounds[i + 1] - bounds[i])), parts[i]);
+    });
+
+    // Points at the start of a chunk that are missing a value would have
+    // carried it over from the previous point, so fill those in from the
+    // end of the previous chunk, and work out where each chunk goes.
+    std::vector<size_t> offsets(chunks);
+    size_t total = 0;
+    const path_point* last = nullptr;
+
+    for (size_t i = 0; i != chunks; ++i) {
+        auto& part = parts[i];
+        const auto& parser = parsers[i];
+
+        if (last) {
+            for (size_t j = 0; j != parser.no_lat; ++j) part[j].loc.lat = last->loc.lat;
+            for (size_t j = 0; j != parser.no_lon; ++j) part[j].loc.lon = last->loc.lon;
+            for (size_t j = 0; j != parser.no_ele; ++j) part[j].loc.ele = last->loc.ele;
+            for (size_t j = 0; j != parser.no_time; ++j) part[j].timestamp = last->timestamp;
+        }
+
+        if (!part.empty()) {
+            last = &part.back();
+        }
+
+        offsets[i] = total;
+        total += part.size();
+    }
+
+    path out(total);
+
+    run_tasks(chunks, thread_count, [&](const size_t i) {
+        const auto offset = offsets[i];
+        const auto sequence = static_cast<int>(offset);
+
+        for (size_t j = 0; j != parts[i].size(); ++j) {
+            out[offset + j] = parts[i][j];
+            out[offset + j].sequence += sequence;
+        }
+
+        path().swap(parts[i]);
+    });
+
+    return out;
+}
+
+} // namespace internal
+
+//
+// Loads the track points from a GPX file, like load_gpx_trk() but the file is
+// memory mapped and parsed in place which is much faster for large files.
+//
+inline path load_gpx_trk_mmap(const std::string& filename) {
+    const internal::mapped_file file(filename);
+
+    if (!file.is_open()) {
+        return {};
+    }
+
+    path gpx_path;
+    internal::gpx_trk_parser parser;
+    parser.parse(file.view(), gpx_path);
+
+    return gpx_path;
+}
+
+//
+// Loads the track points from a GPX file using several threads, 0 means one
+// thread per core. Worthwhile for very large files, the result is the same
+// as load_gpx_trk().
+//
+inline path load_gpx_trk_parallel(const std::string& filename, const unsigned threads = 0) {
+    const internal::mapped_file file(filename);
+
+    if (!file.is_open()) {
+        return {};
+    }
+
+    // Each thread gets chunks of at least 4MB, smaller
+    // files are just parsed on this thread.
+    return internal::parse_gpx_trk_parallel(file.view(), threads, size_t{4} << 20);
+}
+
+namespace internal {
+
+static constexpr std::string_view gpx_header = R"(<?xml version="1.0" encoding="UTF-8" standalone="yes"?>
+                <gpx version="1.1" xmlns="http://www.topografix.com/GPX/1/1" xmlns:xsi="http://www.w3.org/2001/XMLSchema-instance" xsi:schemaLocation="http://www.topografix.com/GPX/1/1 http://www.topografix.com/GPX/1/1/gpx.xsd" xmlns:oa="http://www.outdooractive.com/GPX/Extensions/1">
+                  <metadata>
+                  </metadata>
+                  
+                )";
+
+static constexpr std::string_view gpx_footer = R"(</trkseg>
+                            </trk>
+                            </gpx>)";
+
+//
+// Formats times in the same way as time_to_str_utc(), e.g. 2016-08-30T08:18:51.867479Z
+// but without streams or gmtime(). Points are usually close together in time so the
+// "YYYY-MM-DDT" part is cached and only worked out again when the day changes.
+//
+class time_formatter {
+    long long day = -1;
+    char date[11]{};
+
+    static char* two_digits(char* out, const unsigned v) {
+        out[0] = static_cast<char>('0' + v / 10);
+        out[1] = static_cast<char>('0' + v % 10);
+        return out + 2;
+    }
+
+public:
+
+    // Enough room for any time that format() writes
+    static constexpr size_t max_size = 32;
+
+    // Writes the time to out and returns a pointer to just past it,
+    // out must have room for max_size chars.
+    char* format(char* out, const path_time time) {
+        const auto epoch_seconds = std::chrono::system_clock::to_time_t(time);
+
+        // Before 1970 or after 9999, leave these to time_to_str_utc()
+        if (epoch_seconds < 0 || epoch_seconds >= 253402300800LL) {
+            const auto str = time_to_str_utc(time);
+            return std::copy_n(str.data(), std::min(str.size(), max_size), out);
+        }
+
+        const auto seconds = static_cast<long long>(epoch_seconds);
+        const auto this_day = seconds / 86400;
+
+        if (this_day != day) {
+            int y, m, d;
+            civil_from_days(this_day, y, m, d);
+
+            auto p = date;
+            p = two_digits(p, static_cast<unsigned>(y / 100));
+            p = two_digits(p, static_cast<unsigned>(y % 100));
+            *p++ = '-';
+            p = two_digits(p, static_cast<unsigned>(m));
+            *p++ = '-';
+            p = two_digits(p, static_cast<unsigned>(d));
+            *p = 'T';
+
+            day = this_day;
+        }
+
+        out = std::copy_n(date, sizeof(date), out);
+
+        const auto secs_of_day = static_cast<unsigned>(seconds % 86400);
+        out = two_digits(out, secs_of_day / 3600);
+        *out++ = ':';
+        out = two_digits(out, secs_of_day / 60 % 60);
+        *out++ = ':';
+        out = two_digits(out, secs_of_day % 60);
+        *out++ = '.';
+
+        const auto truncated = std::chrono::system_clock::from_time_t(epoch_seconds);
+        auto us = static_cast<unsigned>(std::chrono::duration_cast<std::chrono::microseconds>(time - truncated).count());
+
+        for (int i = 5; i >= 0; --i) {
+            out[i] = static_cast<char>('0' + us % 10);
+            us /= 10;
+        }
+
+        out += 6;
+        *out++ = 'Z';
+
+        return out;
+    }
+};
+
+//
+// Builds up GPX text in a large in-memory buffer which is written out to the
+// stream in big blocks. Numbers are formatted with to_chars() the same way as
+// an ostream with a precision of 10 would.
+//
+class gpx_buffer {
+    std::ostream& out;
+    std::string buf;
+    size_t used = 0;
+    time_formatter times;
+
+    // Makes sure that there is room for n more chars
+    char* reserve(const size_t n) {
+        if (used + n > buf.size()) {
+            flush();
+
+            if (n > buf.size()) {
+                buf.resize(n);
+            }
+        }
+
+        return &buf[used];
+    }
+
+public:
+
+    // The buffer is written out whenever it fills up
+    explicit gpx_buffer(std::ostream& out, const size_t capacity = size_t{1} << 20) : out(out), buf(capacity, '\0') {}
+
+    ~gpx_buffer() {
+        flush();
+    }
+
+    gpx_buffer(const gpx_buffer&) = delete;
+    gpx_buffer& operator=(const gpx_buffer&) = delete;
+
+    // The number of chars waiting to be written
+    size_t size() const {
+        return used;
+    }
+
+    void flush() {
+        if (used) {
+            out.write(buf.data(), static_cast<std::streamsize>(used));
+            used = 0;
+        }
+    }
+
+    gpx_buffer& operator<<(const std::string_view s) {
+        // Long strings (e.g. waypoint names or
+        // comments) go straight through.
+        if (s.size() > buf.size() / 2) {
+            flush();
+            out.write(s.data(), static_cast<std::streamsize>(s.size()));
+            return *this;
+        }
+
+        auto p = reserve(s.size());
+        std::copy(s.begin(), s.end(), p);
+        used += s.size();
+
+        return *this;
+    }
+
+    gpx_buffer& operator<<(const double value) {
+        // 10 significant digits, sign, point and exponent
+        auto p = reserve(32);
+        const auto result = std::to_chars(p, p + 32, value, std::chars_format::general, 10);
+        used += static_cast<size_t>(result.ptr - p);
+
+        return *this;
+    }
+
+    gpx_buffer& operator<<(const path_time time) {
+        auto p = reserve(time_formatter::max_size);
+        used += static_cast<size_t>(times.format(p, time) - p);
+
+        return *this;
+    }
+
+    /*
+    Like: 
+    <trkpt lat="52.988222" lon="-6.413189">
+        <ele>166.27321</ele>
+        <time>2022-05-07T10:20:08.000Z</time>
+    </trkpt>    
+    */
+    void trkpt(const path_point& point) {
+        *this << "<trkpt lat=\"" << point.loc.lat << "\" lon=\"" << point.loc.lon << "\">\n"
+                << "<ele>" << point.loc.ele << "</ele>\n"
+                << "<time>" << point.timestamp << "</time>\n"
+                << "</trkpt>\n";
+    }
+
+    /*
+    Like:
+        <wpt lat="37.7749" lon="-122.4194">
+            <ele>16.0</ele>
+            <time>2026-02-20T15:00:00Z</time>
+            <name>San Francisco</name>
+            <cmt>Visited during trip</cmt>
+        </wpt>
+    
+    */
+    void wpt(const waypoint& w) {
+        *this << "<wpt lat=\"" << w.loc.lat << "\" lon=\"" << w.loc.lon << "\">\n"
+                << "<ele>" << w.loc.ele << "</ele>\n";
+
+        if (w.timestamp != std::chrono::system_clock::time_point{}) {
+            *this << "<time>" << w.timestamp << "</time>\n";
+        }
+
+        if (!w.name.empty()) {
+            *this << "<name>" << w.name << "</name>\n";
+        }
+
+        if (!w.cmt.empty()) {
+            *this << "<cmt>" << w.cmt << "</cmt>\n";
+        }
+
+        *this << "</wpt>\n";
+    }
+};
+
+} // namespace internal
+
+//
+// Writes a GPX track a point at a time, e.g. for live logging. The header is
+// written when the file is opened, points and waypoints are added with add()
+// as they arrive and the closing tags are written by finish() or when the
+// writer is destroyed.
+//
+// Output goes through a fixed size buffer so memory use doesn't grow with the
+// number of points, call flush() to push everything so far out to the file.
+// The file is in the same format as save_gpx_trk() writes.
+//
+// GPX puts waypoints before the track, so waypoints must be added before
+// the first track point, add() rejects any added after it. Holding them
+// back until finish() would let memory grow and lose them if the process
+// stopped before then.
+//
+class gpx_stream_writer {
+    std::ofstream out;
+    internal::gpx_buffer buf;
+    bool in_track = false;
+    bool finished = false;
+
+    void start_track() {
+        if (!in_track) {
+            buf << "<trk><trkseg>";
+            in_track = true;
+        }
+    }
+
+public:
+
+    explicit gpx_stream_writer(const std::string& filename, const size_t buffer_size = size_t{64} << 10)
+        : out(filename), buf(out, buffer_size) {
+
+        if (out) {
+            buf << internal::gpx_header;
+        } else {
+            finished = true;
+        }
+    }
+
+    ~gpx_stream_writer() {
+        finish();
+    }
+
+    gpx_stream_writer(const gpx_stream_writer&) = delete;
+    gpx_stream_writer& operator=(const gpx_stream_writer&) = delete;
+
+    // false if the file couldn't be opened or a write failed
+    bool good() const {
+        return static_cast<bool>(out);
+    }
+
+    // Returns false, and doesn't write the point, if the writer is finished
+    bool add(const path_point& point) {
+        if (finished) {
+            return false;
+        }
+
+        start_track();
+        buf.trkpt(point);
+
+        return true;
+    }
+
+    // Returns false if any of the points weren't written
+    bool add(const path::const_iterator start, const path::const_iterator end) {
+        bool added = true;
+
+        for (auto i = start; i != end; ++i) {
+            added = add(*i) && added;
+        }
+
+        return added;
+    }
+
+    // Returns false, and doesn't write the waypoint, if the
+    // track has started or the writer is finished.
+    bool add(const waypoint& w) {
+        if (finished || in_track) {
+            return false;
+        }
+
+        buf.wpt(w);
+
+        return true;
+    }
+
+    // Returns false if any of the waypoints weren't written
+    bool add(const waypoints::const_iterator start, const waypoints::const_iterator end) {
+        bool added = true;
+
+        for (auto i = start; i != end; ++i) {
+            added = add(*i) && added;
+        }
+
+        return added;
+    }
+
+    // Writes everything added so far out to the file
+    void flush() {
+        buf.flush();
+        out.flush();
+    }
+
+    // Writes the closing tags and closes the file, nothing more
+    // can be added after this. Returns false if any write failed.
+    bool finish() {
+        if (finished) {
+            return good();
+        }
+
+        start_track();
+        buf << internal::gpx_footer;
+        buf.flush();
+        out.close();
+        finished = true;
+
+        return good();
+    }
+};
+
+//
+// Reads the track points from a GPX file a batch at a time, the file is read
+// through a fixed size buffer so memory use doesn't depend on the size of the
+// file, e.g.
+//
+//      gpx_trk_reader reader("big.gpx", true);
+//      path batch;
+//      double dist = 0.0;
+//
+//      while (reader.next(batch)) {
+//          dist += path_distance(batch.begin(), batch.end());
+//      }
+//
+// When overlap is set each batch after the first starts with the last point of
+// the batch before it, so results for consecutive point pairs such as distance
+// or ascent/descent can simply be added up over the batches.
+//
+// The points are the same as those from load_gpx_trk().
+//
+class gpx_trk_reader {
+    std::ifstream in;
+    internal::gpx_trk_parser parser;
+    bool overlap;
+
+    // File data, [0, end) has been read but not yet parsed
+    std::string buf;
+    size_t end = 0;
+
+    // Parsed points not yet returned
+    path pending;
+    size_t pending_pos = 0;
+
+    path_point last{};
+    bool have_last = false;
+
+    // Parses the next buffer full of the file into pending,
+    // returns false at the end of the file.
+    bool read_more() {
+        // A tag or element bigger than the whole buffer
+        if (end == buf.size()) {
+            buf.resize(buf.size() * 2);
+        }
+
+        in.read(&buf[end], static_cast<std::streamsize>(buf.size() - end));
+        const auto n = static_cast<size_t>(in.gcount());
+
+        if (n == 0) {
+            return false;
+        }
+
+        end += n;
+
+        // Keep whatever wasn't consumed for next time
+        const auto consumed = parser.parse(std::string_view(buf.data(), end), pending);
+        std::copy(buf.begin() + static_cast<std::ptrdiff_t>(consumed), buf.begin() + static_cast<std::ptrdiff_t>(end), buf.begin());
+        end -= consumed;
+
+        return true;
+    }
+
+public:
+
+    explicit gpx_trk_reader(const std::string& filename, const bool overlap = false, const size_t buffer_size = size_t{1} << 20)
+        : in(filename, std::ios::binary), overlap(overlap), buf(std::max(buffer_size, size_t{64}), '\0') {}
+
+    bool is_open() const {
+        return static_cast<bool>(in.is_open());
+    }
+
+    // Replaces the contents of batch with up to max_points more points (plus
+    // the overlap point), returns false once there are no more points.
+    bool next(path& batch, const size_t max_points = 4096) {
+        batch.clear();
+
+        if (overlap && have_last) {
+            batch.push_back(last);
+        }
+
+        size_t added = 0;
+
+        while (added < max_points) {
+            if (pending_pos == pending.size()) {
+                pending.clear();
+                pending_pos = 0;
+
+                if (!read_more()) {
+                    break;
+                }
+
+                continue;
+            }
+
+            const auto n = std::min(max_points - added, pending.size() - pending_pos);
+            const auto from = pending.begin() + static_cast<std::ptrdiff_t>(pending_pos);
+
+            batch.insert(batch.end(), from, from + static_cast<std::ptrdiff_t>(n));
+            pending_pos += n;
+            added += n;
+        }
+
+        if (added == 0) {
+            return false;
+        }
+
+        last = batch.back();
+        have_last = true;
+
+        return true;
+    }
+};
+
+//
+// Calls fn(const path& batch) for each batch of points in a GPX file, see
+// gpx_trk_reader. Returns false if the file couldn't be opened.
+//
+template <typename Fn>
+bool for_each_gpx_trk_batch(const std::string& filename, Fn fn, const bool overlap = false, const size_t max_points = 4096) {
+    gpx_trk_reader reader(filename, overlap);
+
+    if (!reader.is_open()) {
+        return false;
+    }
+
+    path batch;
+    batch.reserve(max_points + 1);
+
+    while (reader.next(batch, max_points)) {
+        fn(static_cast<const path&>(batch));
+    }
+
+    return true;
+}
+
+inline bool internal_save_gpx_trk(const std::string filename,
+                                const path::iterator start_it,
+                                const path::iterator end_it,
+                                const std::optional<waypoints::iterator> start_way,
+                                const std::optional<waypoints::iterator> end_way) {
+
+    if (start_it == end_it)
+        return false;
+    
+    std::ofstream out(filename);
+    
+    if (!out) {
+        return false;
+    }
+
+    {
+        internal::gpx_buffer buf(out);
+
+        buf << internal::gpx_header;
+
+        // Waypoints if any
+        if (start_way && end_way) {
+            const auto end = end_way.value();
+            for (auto w = start_way.value(); w != end; ++w) {
+                buf.wpt(*w);
+            }
+        }
+
+        buf << "<trk><trkseg>";
+
+        for (auto i = start_it; i != end_it; ++i) {
+            buf.trkpt(*i);
+        }
+
+        buf << internal::gpx_footer;
+    }
+
+    return static_cast<bool>(out);
+}
+
+inline bool save_gpx_trk(const std::string filename,
+                            const path::iterator start_it,
+                            const path::iterator end_it) {
+                                
+    return internal_save_gpx_trk(filename, start_it, end_it, {}, {});
+}
+
+inline bool save_gpx_trk(const std::string filename,
+                        const path::iterator start_it,
+                        const path::iterator end_it,
+                        const waypoints::iterator start_way,
+                        const waypoints::iterator end_way) {
+
+    return internal_save_gpx_trk(filename, start_it, end_it, start_way, end_way);
+
+}
+
+//
+//-------------- CSV -------------- 
+//
+
+//
+// Columnar CSV loading, the schema describes the type of each column in the
+// file and each column is loaded into a typed vector, e.g. for a logger file
+// with lines like:
+//
+//      1661332353550,-375,53.429936,-6.955620,130.4,181.83,4,-0.71,-0.30,10.101,-1,0,0
+//
+// see gps_log_csv_schema().
+//
+
+enum class csv_type {
+    skip,       // Not loaded
+    integer,    // Loaded as a long long
+    real,       // Loaded as a double
+};
+
+struct csv_column_spec {
+    std::string name;
+    csv_type type;
+};
+
+typedef std::vector<csv_column_spec> csv_schema;
+
+struct csv_column {
+    std::string name;
+    csv_type type;
+
+    // Only the one that matches the type is filled in
+    std::vector<long long> integers;
+    std::vector<double> reals;
+};
+
+struct csv_table {
+    // The loaded (i.e. not skipped) columns, in file order
+    std::vector<csv_column> columns;
+
+    size_t rows = 0;
+
+    // Returns the named column or nullptr
+    const csv_column* column(const std::string_view name) const {
+        for (const auto& c : columns) {
+            if (c.name == name) {
+                return &c;
+            }
+        }
+
+        return nullptr;
+    }
+};
+
+//
+// The schema for GPS logger files like test_data/pass4_gps_track_log_24_08_2022.csv,
+// timestamps are milliseconds in the Unix epoch.
+//
+inline const csv_schema& gps_log_csv_schema() {
+    static const csv_schema schema {
+        { "timestamp", csv_type::integer },
+        { "received_delta", csv_type::integer },
+        { "lat", csv_type::real },
+        { "lon", csv_type::real },
+        { "ele", csv_type::real },
+        { "heading", csv_type::real },
+        { "gps_fix", csv_type::integer },
+        { "acc_x", csv_type::real },
+        { "acc_y", csv_type::real },
+        { "acc_z", csv_type::real },
+        { "frame", csv_type::integer },
+        { "image_timestamp", csv_type::integer },
+        { "image_received_delta", csv_type::integer },
+    };
+
+    return schema;
+}
+
+namespace internal {
+
+// Parses one line into the loaded columns, targets holds the column that
+// each field in the schema goes to (nullptr for skipped fields). Nothing is
+// added unless every loaded field in the line parses.
+inline bool parse_csv_line(const char* p, const char* const end, const csv_schema& schema,
+                            const std::vector<csv_column*>& targets, csv_table& table) {
+    size_t loaded = 0;
+    bool ok = true;
+
+    for (size_t i = 0; i != schema.size(); ++i) {
+        const auto target = targets[i];
+
+        if (target) {
+            // The number is parsed straight from the line, then
+            // whatever is left of the field is skipped below.
+            if (target->type == csv_type::integer) {
+                long long value{};
+                const auto after = parse_integer(p, end, value);
+
+                if (after) {
+                    target->integers.push_back(value);
+                    p = after;
+                }
+
+                ok = after != nullptr;
+            } else {
+                double value{};
+                const auto after = parse_double(p, end, value);
+
+                if (after) {
+                    target->reals.push_back(value);
+                    p = after;
+                }
+
+                ok = after != nullptr;
+            }
+
+            if (!ok) {
+                break;
+            }
+
+            ++loaded;
+        }
+
+        while (p != end && *p != ',') {
+            ++p;
+        }
+
+        if (p == end) {
+            // Too few fields?
+            ok = i + 1 == schema.size();
+            break;
+        }
+
+        ++p;
+    }
+
+    if (!ok) {
+        // Take back the fields already added from this line
+        for (size_t i = 0; i != loaded; ++i) {
+            auto& c = table.columns[i];
+
+            if (c.type == csv_type::integer) {
+                c.integers.pop_back();
+            } else {
+                c.reals.pop_back();
+            }
+        }
+
+        return false;
+    }
+
+    ++table.rows;
+
+    return true;
+}
+
+// An empty table with a column for each loaded field in the schema
+inline csv_table make_csv_table(const csv_schema& schema) {
+    csv_table table;
+
+    for (const auto& spec : schema) {
+        if (spec.type != csv_type::skip) {
+            table.columns.push_back({ spec.name, spec.type, {}, {} });
+        }
+    }
+
+    return table;
+}
+
+// Parses the lines in text into table
+inline void parse_csv_text(const std::string_view text, const csv_schema& schema, csv_table& table) {
+    // Guess the number of rows from the length of the first
+    // few lines to save on reallocations.
+    const auto sample = text.substr(0, 64 << 10);
+    const auto sample_lines = static_cast<size_t>(std::count(sample.begin(), sample.end(), '\n'));
+
+    if (sample_lines > 1) {
+        const auto rows = text.size() / (sample.size() / sample_lines) + 1;
+
+        for (auto& c : table.columns) {
+            if (c.type == csv_type::integer) {
+                c.integers.reserve(rows);
+            } else {
+                c.reals.reserve(rows);
+            }
+        }
+    }
+
+    std::vector<csv_column*> targets;
+    size_t next_column = 0;
+
+    for (const auto& spec : schema) {
+        targets.push_back(spec.type == csv_type::skip ? nullptr : &table.columns[next_column++]);
+    }
+
+    const auto& scanner = get_tag_scanner();
+    const char* p = text.data();
+    const char* const end = p + text.size();
+
+    while (p < end) {
+        const auto eol = scanner.find_char(p, end, '\n');
+        auto line_end = eol;
+
+        if (line_end != p && line_end[-1] == '\r') {
+            --line_end;
+        }
+
+        if (line_end != p) {
+            parse_csv_line(p, line_end, schema, targets, table);
+        }
+
+        p = eol + 1;
+    }
+}
+
+} // namespace internal
+
+//
+// Loads the columns in a CSV file according to the schema. The file is memory
+// mapped and parsed in place. Lines that don't match the schema, such as a
+// header line, are skipped, extra columns at the end of a line are ignored.
+//
+// Large files are split into chunks of lines which are parsed on up to
+// "threads" threads (0 means one per core).
+//
+inline csv_table load_csv_columns(const std::string& filename, const csv_schema& schema, const unsigned threads = 0) {
+    const internal::mapped_file file(filename);
+
+    if (!file.is_open()) {
+        return internal::make_csv_table(schema);
+    }
+
+    const auto text = file.view();
+
+    // Chunks of at least 4MB, a few per thread
+    const auto thread_count = threads ? threads : internal::default_thread_count();
+    const auto chunk_count = std::min(static_cast<size_t>(thread_count) * 4, text.size() / (size_t{4} << 20));
+
+    if (thread_count == 1 || chunk_count < 2) {
+        auto table = internal::make_csv_table(schema);
+        internal::parse_csv_text(text, schema, table);
+        return table;
+    }
+
+    // Split just after a new line
+    std::vector<size_t> bounds { 0 };
+
+    for (size_t i = 1; i < chunk_count; ++i) {
+        const auto eol = text.find('\n', std::max(bounds.back(), text.size() / chunk_count * i));
+
+        if (eol == std::string_view::npos) {
+            break;
+        }
+
+        bounds.push_back(eol + 1);
+    }
+
+    bounds.push_back(text.size());
+
+    const auto chunks = bounds.size() - 1;
+    std::vector<csv_table> parts(chunks, internal::make_csv_table(schema));
+
+    internal::run_tasks(chunks, thread_count, [&](const size_t i) {
+        internal::parse_csv_text(text.substr(bounds[i], bounds[i + 1] - bounds[i]), schema, parts[i]);
+    });
+
+    // Join the chunks together
+    auto table = internal::make_csv_table(schema);
+
+    for (const auto& part : parts) {
+        table.rows += part.rows;
+    }
+
+    for (size_t c = 0; c != table.columns.size(); ++c) {
+        auto& column = table.columns[c];
+
+        if (column.type == csv_type::integer) {
+            column.integers.reserve(table.rows);
+        } else {
+            column.reals.reserve(table.rows);
+        }
+
+        for (auto& part : parts) {
+            auto& from = part.columns[c];
+            column.integers.insert(column.integers.end(), from.integers.begin(), from.integers.end());
+            column.reals.insert(column.reals.end(), from.reals.begin(), from.reals.end());
+            std::vector<long long>().swap(from.integers);
+            std::vector<double>().swap(from.reals);
+        }
+    }
+
+    return table;
+}
+
+//
+// Makes a path from the "timestamp" (milliseconds in the Unix epoch), "lat",
+// "lon" and "ele" columns of a table, any that are missing are left as zero.
+//
+inline path csv_table_to_path(const csv_table& table) {
+    const auto timestamp = table.column("timestamp");
+    const auto lat = table.column("lat");
+    const auto lon = table.column("lon");
+    const auto ele = table.column("ele");
+
+    const auto value = [](const csv_column* c, const size_t i) {
+        if (!c) {
+            return 0.0;
+        }
+
+        return c->type == csv_type::real ? c->reals[i] : static_cast<double>(c->integers[i]);
+    };
+
+    path out(table.rows);
+
+    for (size_t i = 0; i != table.rows; ++i) {
+        auto& point = out[i];
+
+        point.loc = { value(lat, i), value(lon, i), value(ele, i) };
+        point.sequence = static_cast<int>(i);
+
+        if (timestamp) {
+            const auto ms = timestamp->type == csv_type::integer ? timestamp->integers[i] : static_cast<long long>(timestamp->reals[i]);
+            point.timestamp = path_time(std::chrono::milliseconds(ms));
+        }
+    }
+
+    return out;
+}
+
+//
+//-------------- Binary Path Files -------------- 
+//
+
+//
+// A compact binary file format for paths and waypoints that is much quicker
+// to load than GPX. All values are little-endian and every column starts on
+// an 8 byte boundary so a mapped file can be used in place, see path_bin_view.
+//
+//  Header (64 bytes):
+//      char[8]     magic "GPSPATHB"
+//      uint32      version (1)
+//      uint32      flags, bit 0 set if the blocks have checksums
+//      uint64      number of points
+//      uint32      number of points per block
+//      uint32      number of waypoints
+//      uint64      offset of the waypoints from the start of the file
+//      uint8[24]   reserved, zero
+//
+//  Point blocks, each with up to "points per block" points stored as columns:
+//      double[n]   latitude
+//      double[n]   longitude
+//      double[n]   elevation
+//      int64[n]    timestamp, nanoseconds in the Unix epoch
+//      int32[n]    sequence, padded to 8 bytes
+//
+//  Block checksums if flagged, uint64 per block (see internal::checksum64())
+//
+//  Waypoints, each:
+//      double      latitude, longitude, elevation
+//      int64       timestamp, nanoseconds in the Unix epoch
+//      uint32      name length in bytes
+//      uint32      comment length in bytes
+//      char[]      name then comment, padded to 8 bytes
+//
+
+namespace internal {
+
+static constexpr char path_bin_magic[8] = { 'G', 'P', 'S', 'P', 'A', 'T', 'H', 'B' };
+static constexpr uint32_t path_bin_version = 1;
+static constexpr uint32_t path_bin_checksums = 1;
+static constexpr size_t path_bin_header_size = 64;
+static constexpr uint32_t path_bin_block_points = 65536;
+
+struct path_bin_header {
+    uint32_t version;
+    uint32_t flags;
+    uint64_t points;
+    uint32_t block_points;
+    uint32_t waypoints;
+    uint64_t waypoints_offset;
+};
+
+inline bool host_is_little_endian() {
+    const uint16_t one = 1;
+    unsigned char first;
+    std::memcpy(&first, &one, 1);
+    return first == 1;
+}
+
+inline size_t pad8(const size_t n) {
+    return (n + 7) & ~size_t{7};
+}
+
+// Size in bytes of a block of n points
+inline size_t path_bin_block_size(const size_t n) {
+    return n * (3 * sizeof(double) + sizeof(int64_t)) + pad8(n * sizeof(int32_t));
+}
+
+// Fletcher style checksum over 32 bit little-endian words,
+// n must be a multiple of 4.
+inline uint64_t checksum64(const char* data, const size_t n) {
+    const uint64_t mod = 0xFFFFFFFF;
+    uint64_t a = 0;
+    uint64_t b = 0;
+    size_t i = 0;
+
+    while (i < n) {
+        // Reduce often enough that b can't overflow
+        const auto block_end = std::min(n, i + 4096 * 4);
+
+        for (; i < block_end; i += 4) {
+            uint32_t w;
+            std::memcpy(&w, data + i, 4);
+            a += w;
+            b += a;
+        }
+
+        a %= mod;
+        b %= mod;
+    }
+
+    return (b << 32) | a;
+}
+
+// Appends value to buf as little-endian bytes
+template <typename T>
+void put_le(std::string& buf, T value) {
+    char bytes[sizeof(T)];
+    std::memcpy(bytes, &value, sizeof(T));
+
+    if (!host_is_little_endian()) {
+        std::reverse(bytes, bytes + sizeof(T));
+    }
+
+    buf.append(bytes, sizeof(T));
+}
+
+template <typename T>
+T get_le(const char* p) {
+    char bytes[sizeof(T)];
+    std::memcpy(bytes, p, sizeof(T));
+
+    if (!host_is_little_endian()) {
+        std::reverse(bytes, bytes + sizeof(T));
+    }
+
+    T value;
+    std::memcpy(&value, bytes, sizeof(T));
+    return value;
+}
+
+inline int64_t to_epoch_ns(const path_time time) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
+inline path_time from_epoch_ns(const int64_t ns) {
+    return path_time(std::chrono::duration_cast<path_time::duration>(std::chrono::nanoseconds(ns)));
+}
+
+// Reads and checks the header of a binary path file
+inline bool read_path_bin_header(const std::string_view data, path_bin_header& header) {
+    if (data.size() < path_bin_header_size || std::memcmp(data.data(), path_bin_magic, 8) != 0) {
+        return false;
+    }
+
+    const char* p = data.data() + 8;
+    header.version = get_le<uint32_t>(p);
+    header.flags = get_le<uint32_t>(p + 4);
+    header.points = get_le<uint64_t>(p + 8);
+    header.block_points = get_le<uint32_t>(p + 16);
+    header.waypoints = get_le<uint32_t>(p + 20);
+    header.waypoints_offset = get_le<uint64_t>(p + 24);
+
+    if (header.version != path_bin_version || header.block_points == 0) {
+        return false;
+    }
+
+    // Make sure the blocks (and checksums) fit in the file, dividing rather
+    // than multiplying so that huge point counts can't overflow.
+    const uint64_t available = data.size() - path_bin_header_size;
+    const uint64_t block_size = path_bin_block_size(header.block_points);
+    const uint64_t full = header.points / header.block_points;
+
+    if (full > available / block_size) {
+        return false;
+    }
+
+    const uint64_t rest = header.points - full * header.block_points;
+    const uint64_t blocks = full + (rest ? 1 : 0);
+
+    uint64_t size = full * block_size + path_bin_block_size(static_cast<size_t>(rest));
+
+    if (header.flags & path_bin_checksums) {
+        size += blocks * sizeof(uint64_t);
+    }
+
+    if (size > available) {
+        return false;
+    }
+
+    size += path_bin_header_size;
+
+    if (header.waypoints && (header.waypoints_offset < size || header.waypoints_offset > data.size())) {
+        return false;
+    }
+
+    return true;
+}
+
+} // namespace internal
+
+//
+// A read-only view of a memory mapped binary path file, the columns
+// are used in place without copying, e.g.
+//
+//      path_bin_view view("track.bin");
+//
+//      for (size_t b = 0; b != view.block_count(); ++b) {
+//          const auto block = view.block(b);
+//          // block.lat[0 .. block.count) etc.
+//      }
+//
+// Files are always written little-endian but can only be read on
+// little-endian machines (x86, ARM etc.), otherwise is_open() is false.
+//
+class path_bin_view {
+    internal::mapped_file file;
+    internal::path_bin_header header{};
+    bool valid = false;
+
+public:
+
+    struct block_columns {
+        size_t count;
+        const double* lat;
+        const double* lon;
+        const double* ele;
+        const int64_t* timestamp_ns;
+        const int32_t* sequence;
+    };
+
+    explicit path_bin_view(const std::string& filename) : file(filename) {
+        valid = file.is_open() && internal::host_is_little_endian() &&
+                internal::read_path_bin_header(file.view(), header);
+    }
+
+    bool is_open() const {
+        return valid;
+    }
+
+    size_t size() const {
+        return valid ? static_cast<size_t>(header.points) : 0;
+    }
+
+    size_t block_count() const {
+        return valid && header.points ? static_cast<size_t>((header.points + header.block_points - 1) / header.block_points) : 0;
+    }
+
+    bool has_checksums() const {
+        return (header.flags & internal::path_bin_checksums) != 0;
+    }
+
+    block_columns block(const size_t i) const {
+        const auto first = static_cast<size_t>(header.block_points) * i;
+        const auto n = std::min(static_cast<size_t>(header.block_points), size() - first);
+        const char* p = file.view().data() + internal::path_bin_header_size + i * internal::path_bin_block_size(header.block_points);
+
+        // The file layout keeps these aligned
+        return {
+            n,
+            reinterpret_cast<const double*>(p),
+            reinterpret_cast<const double*>(p + n * 8),
+            reinterpret_cast<const double*>(p + n * 16),
+            reinterpret_cast<const int64_t*>(p + n * 24),
+            reinterpret_cast<const int32_t*>(p + n * 32),
+        };
+    }
+
+    path_point operator[](const size_t i) const {
+        const auto b = block(i / header.block_points);
+        const auto j = i % header.block_points;
+
+        return { { b.lat[j], b.lon[j], b.ele[j] }, internal::from_epoch_ns(b.timestamp_ns[j]), b.sequence[j] };
+    }
+
+    // Checks the block checksums, true if they match or if there are none
+    bool verify() const {
+        if (!valid) {
+            return false;
+        }
+
+        if (!has_checksums()) {
+            return true;
+        }
+
+        const auto blocks = block_count();
+        const char* data = file.view().data();
+        const char* sums = data + internal::path_bin_header_size +
+                            (blocks ? (blocks - 1) * internal::path_bin_block_size(header.block_points) + internal::path_bin_block_size(block(blocks - 1).count) : 0);
+
+        for (size_t i = 0; i != blocks; ++i) {
+            const auto b = block(i);
+            const auto sum = internal::checksum64(reinterpret_cast<const char*>(b.lat), internal::path_bin_block_size(b.count));
+
+            if (sum != internal::get_le<uint64_t>(sums + i * 8)) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    // Appends the points to out
+    void to_path(path& out) const {
+        out.reserve(out.size() + size());
+
+        for (size_t i = 0; i != block_count(); ++i) {
+            const auto b = block(i);
+
+            for (size_t j = 0; j != b.count; ++j) {
+                out.push_back({ { b.lat[j], b.lon[j], b.ele[j] }, internal::from_epoch_ns(b.timestamp_ns[j]), b.sequence[j] });
+            }
+        }
+    }
+
+    waypoints get_waypoints() const {
+        waypoints out;
+
+        if (!valid) {
+            return out;
+        }
+
+        const auto data = file.view();
+        size_t pos = static_cast<size_t>(header.waypoints_offset);
+
+        for (uint32_t i = 0; i != header.waypoints && pos + 40 <= data.size(); ++i) {
+            const char* p = data.data() + pos;
+            const auto name_len = internal::get_le<uint32_t>(p + 32);
+            const auto cmt_len = internal::get_le<uint32_t>(p + 36);
+
+            if (pos + 40 + name_len + cmt_len > data.size()) {
+                break;
+            }
+
+            waypoint w;
+            w.loc = { internal::get_le<double>(p), internal::get_le<double>(p + 8), internal::get_le<double>(p + 16) };
+            w.timestamp = internal::from_epoch_ns(internal::get_le<int64_t>(p + 24));
+            w.name.assign(p + 40, name_len);
+            w.cmt.assign(p + 40 + name_len, cmt_len);
+
+            out.push_back(std::move(w));
+
+            pos += internal::pad8(40 + name_len + cmt_len);
+        }
+
+        return out;
+    }
+};
+
+inline bool internal_save_path_bin(const std::string& filename,
+                                    const path::const_iterator start_it,
+                                    const path::const_iterator end_it,
+                                    const std::optional<waypoints::const_iterator> start_way,
+                                    const std::optional<waypoints::const_iterator> end_way,
+                                    const bool checksums) {
+
+    std::ofstream out(filename, std::ios::binary);
+
+    if (!out) {
+        return false;
+    }
+
+    const auto points = static_cast<size_t>(std::distance(start_it, end_it));
+    const size_t block_points = internal::path_bin_block_points;
+    const auto blocks = (points + block_points - 1) / block_points;
+
+    size_t way_count = 0;
+
+    if (start_way && end_way) {
+        way_count = static_cast<size_t>(std::distance(*start_way, *end_way));
+    }
+
+    // Waypoints go after the blocks and checksums
+    size_t points_size = 0;
+
+    for (size_t b = 0; b != blocks; ++b) {
+        points_size += internal::path_bin_block_size(std::min(block_points, points - b * block_points));
+    }
+
+    const auto waypoints_offset = internal::path_bin_header_size + points_size + (checksums ? blocks * 8 : 0);
+
+    std::string buf;
+    buf.reserve(internal::path_bin_block_size(block_points));
+
+    buf.append(internal::path_bin_magic, 8);
+    internal::put_le(buf, internal::path_bin_version);
+    internal::put_le(buf, checksums ? internal::path_bin_checksums : uint32_t{0});
+    internal::put_le(buf, static_cast<uint64_t>(points));
+    internal::put_le(buf, static_cast<uint32_t>(block_points));
+    internal::put_le(buf, static_cast<uint32_t>(way_count));
+    internal::put_le(buf, static_cast<uint64_t>(way_count ? waypoints_offset : 0));
+    buf.resize(internal::path_bin_header_size, '\0');
+
+    out.write(buf.data(), static_cast<std::streamsize>(buf.size()));
+
+    std::vector<uint64_t> sums;
+    sums.reserve(blocks);
+
+    auto it = start_it;
+
+    for (size_t b = 0; b != blocks; ++b) {
+        const auto n = static_cast<std::ptrdiff_t>(std::min(block_points, points - b * block_points));
+        const auto block_end = it + n;
+
+        buf.clear();
+
+        for (auto i = it; i != block_end; ++i) internal::put_le(buf, i->loc.lat);
+        for (auto i = it; i != block_end; ++i) internal::put_le(buf, i->loc.lon);
+        for (auto i = it; i != block_end; ++i) internal::put_le(buf, i->loc.ele);
+        for (auto i = it; i != block_end; ++i) internal::put_le(buf, internal::to_epoch_ns(i->timestamp));
+        for (auto i = it; i != block_end; ++i) internal::put_le(buf, static_cast<int32_t>(i->sequence));
+
+        buf.resize(internal::pad8(buf.size()), '\0');
+
+        if (checksums) {
+            sums.push_back(internal::checksum64(buf.data(), buf.size()));
+        }
+
+        out.write(buf.data(), static_cast<std::streamsize>(buf.size()));
+        it = block_end;
+    }
+
+    buf.clear();
+
+    for (const auto sum : sums) {
+        internal::put_le(buf, sum);
+    }
+
+    if (way_count) {
+        for (auto w = *start_way; w != *end_way; ++w) {
+            internal::put_le(buf, w->loc.lat);
+            internal::put_le(buf, w->loc.lon);
+            internal::put_le(buf, w->loc.ele);
+            internal::put_le(buf, internal::to_epoch_ns(w->timestamp));
+            internal::put_le(buf, static_cast<uint32_t>(w->name.size()));
+            internal::put_le(buf, static_cast<uint32_t>(w->cmt.size()));
+            buf += w->name;
+            buf += w->cmt;
+            buf.resize(internal::pad8(buf.size()), '\0');
+        }
+    }
+
+    out.write(buf.data(), static_cast<std::streamsize>(buf.size()));
+
+    return static_cast<bool>(out);
+}
+
+//
+// Saves a path to a binary path file, see path_bin_view for the format.
+// Checksums let load_path_bin() catch corrupted files.
+//
+inline bool save_path_bin(const std::string& filename,
+                            const path::const_iterator start_it,
+                            const path::const_iterator end_it,
+                            const bool checksums = true) {
+
+    return internal_save_path_bin(filename, start_it, end_it, {}, {}, checksums);
+}
+
+inline bool save_path_bin(const std::string& filename,
+                            const path::const_iterator start_it,
+                            const path::const_iterator end_it,
+                            const waypoints::const_iterator start_way,
+                            const waypoints::const_iterator end_way,
+                            const bool checksums = true) {
+
+    return internal_save_path_bin(filename, start_it, end_it, start_way, end_way, checksums);
+}
+
+//
+// Loads a path and any waypoints from a binary path file, replacing the
+// contents of out and way. Returns false, leaving them unchanged, if the file
+// can't be read, isn't a binary path file or fails its checksums.
+//
+inline bool load_path_bin(const std::string& filename, path& out, waypoints& way) {
+    const path_bin_view view(filename);
+
+    if (!view.is_open() || !view.verify()) {
+        return false;
+    }
+
+    out.clear();
+    view.to_path(out);
+    way = view.get_waypoints();
+
+    return true;
+}
+
+inline path load_path_bin(const std::string& filename) {
+    path out;
+    waypoints way;
+
+    if (!load_path_bin(filename, out, way)) {
+        return {};
+    }
+
+    return out;
+}
+
+//
+//-------------- Compressed Paths -------------- 
+//
+
+//
+// A compact lossy encoding of a path for archiving. Points are stored in
+// blocks that can each be decoded on their own, within a block each value is
+// stored as the zigzag varint of its difference from a prediction based on the
+// previous points:
+//
+//      lat, lon    1e-7 degrees (about 1cm), predicted by extrapolating the previous two points
+//      timestamp   milliseconds, predicted the same way, so a steady rate costs one byte
+//      elevation   centimetres, predicted by the previous point
+//      sequence    only stored if the block's sequence numbers are not consecutive
+//
+// The first point in a block is stored in full.
+//
+
+namespace internal {
+
+inline uint64_t zigzag(const int64_t v) {
+    return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+}
+
+inline int64_t unzigzag(const uint64_t v) {
+    return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+}
+
+inline void put_varint(std::vector<uint8_t>& out, uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back(static_cast<uint8_t>(v | 0x80));
+        v >>= 7;
+    }
+
+    out.push_back(static_cast<uint8_t>(v));
+}
+
+// Reads a varint at p, stops at end on bad data
+inline uint64_t get_varint(const uint8_t*& p, const uint8_t* const end) {
+    uint64_t v = 0;
+
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        const auto b = *p++;
+        v |= static_cast<uint64_t>(b & 0x7F) << shift;
+
+        if (b < 0x80) {
+            break;
+        }
+    }
+
+    return v;
+}
+
+// The quantised values that are encoded
+struct quantised_point {
+    int64_t lat;
+    int64_t lon;
+    int64_t ele;
+    int64_t time;
+    int64_t seq;
+};
+
+inline quantised_point quantise(const path_point& p) {
+    return {
+        std::llround(p.loc.lat * 1E7),
+        std::llround(p.loc.lon * 1E7),
+        std::llround(p.loc.ele * 100.0),
+        std::chrono::floor<std::chrono::milliseconds>(p.timestamp.time_since_epoch()).count(),
+        p.sequence,
+    };
+}
+
+static constexpr uint64_t compressed_consecutive = 1;
+
+} // namespace internal
+
+struct compressed_path {
+    struct block {
+        // Start of the block in data
+        size_t offset;
+
+        // Number of points in the block
+        uint32_t count;
+    };
+
+    std::vector<uint8_t> data;
+    std::vector<block> blocks;
+
+    // Total number of points
+    size_t size = 0;
+
+    size_t block_count() const {
+        return blocks.size();
+    }
+};
+
+//
+// Compresses a path, see compressed_path. Smaller blocks give
+// finer grained random access but compress slightly less.
+//
+inline compressed_path compress_path(const path::const_iterator start, const path::const_iterator end, const uint32_t block_points = 1024) {
+    compressed_path out;
+    out.size = static_cast<size_t>(std::distance(start, end));
+    out.data.reserve(out.size * 8);
+
+    for (auto first = start; first != end; ) {
+        const auto n = std::min(static_cast<size_t>(std::max(block_points, uint32_t{1})), static_cast<size_t>(std::distance(first, end)));
+        const auto last = first + static_cast<std::ptrdiff_t>(n);
+
+        out.blocks.push_back({ out.data.size(), static_cast<uint32_t>(n) });
+
+        bool consecutive = true;
+
+        for (auto i = first + 1; i < last; ++i) {
+            consecutive = consecutive && i->sequence == std::prev(i)->sequence + 1;
+        }
+
+        internal::put_varint(out.data, consecutive ? internal::compressed_consecutive : 0);
+
+        auto prev = internal::quantise(*first);
+        auto prev2 = prev;
+
+        internal::put_varint(out.data, internal::zigzag(prev.lat));
+        internal::put_varint(out.data, internal::zigzag(prev.lon));
+        internal::put_varint(out.data, internal::zigzag(prev.ele));
+        internal::put_varint(out.data, internal::zigzag(prev.time));
+        internal::put_varint(out.data, internal::zigzag(prev.seq));
+
+        for (auto i = first + 1; i != last; ++i) {
+            const auto q = internal::quantise(*i);
+
+            // The second point has nothing to extrapolate from, so prev2 == prev
+            internal::put_varint(out.data, internal::zigzag(q.lat - (2 * prev.lat - prev2.lat)));
+            internal::put_varint(out.data, internal::zigzag(q.lon - (2 * prev.lon - prev2.lon)));
+            internal::put_varint(out.data, internal::zigzag(q.ele - prev.ele));
+            internal::put_varint(out.data, internal::zigzag(q.time - (2 * prev.time - prev2.time)));
+
+            if (!consecutive) {
+                internal::put_varint(out.data, internal::zigzag(q.seq - prev.seq));
+            }
+
+            prev2 = prev;
+            prev = q;
+        }
+
+        first = last;
+    }
+
+    return out;
+}
+
+//
+// Decodes block i of a compressed path and appends its points to out.
+//
+inline void decompress_block(const compressed_path& in, const size_t i, path& out) {
+    const auto& block = in.blocks[i];
+    const uint8_t* p = in.data.data() + block.offset;
+    const uint8_t* const end = in.data.data() + (i + 1 < in.blocks.size() ? in.blocks[i + 1].offset : in.data.size());
+
+    const auto flags = internal::get_varint(p, end);
+    const bool consecutive = (flags & internal::compressed_consecutive) != 0;
+
+    internal::quantised_point prev;
+    prev.lat = internal::unzigzag(internal::get_varint(p, end));
+    prev.lon = internal::unzigzag(internal::get_varint(p, end));
+    prev.ele = internal::unzigzag(internal::get_varint(p, end));
+    prev.time = internal::unzigzag(internal::get_varint(p, end));
+    prev.seq = internal::unzigzag(internal::get_varint(p, end));
+
+    auto prev2 = prev;
+
+    const auto emit = [&out](const internal::quantised_point& q) {
+        out.push_back({ { static_cast<double>(q.lat) / 1E7, static_cast<double>(q.lon) / 1E7, static_cast<double>(q.ele) / 100.0 },
+                        path_time(std::chrono::duration_cast<path_time::duration>(std::chrono::milliseconds(q.time))),
+                        static_cast<int>(q.seq) });
+    };
+
+    emit(prev);
+
+    for (uint32_t j = 1; j < block.count; ++j) {
+        internal::quantised_point q;
+        q.lat = 2 * prev.lat - prev2.lat + internal::unzigzag(internal::get_varint(p, end));
+        q.lon = 2 * prev.lon - prev2.lon + internal::unzigzag(internal::get_varint(p, end));
+        q.ele = prev.ele + internal::unzigzag(internal::get_varint(p, end));
+        q.time = 2 * prev.time - prev2.time + internal::unzigzag(internal::get_varint(p, end));
+        q.seq = consecutive ? prev.seq + 1 : prev.seq + internal::unzigzag(internal::get_varint(p, end));
+
+        emit(q);
+
+        prev2 = prev;
+        prev = q;
+    }
+}
+
+inline path decompress_path(const compressed_path& in) {
+    path out;
+    out.reserve(in.size);
+
+    for (size_t i = 0; i != in.blocks.size(); ++i) {
+        decompress_block(in, i, out);
+    }
+
+    return out;
+}
+
+//
+// Saves a compressed path to a file:
+//
+//      char[8]     magic "GPSPATHZ"
+//      uint32      version (1)
+//      uint32      number of blocks
+//      uint64      number of points
+//      uint64      size of the data in bytes
+//      { uint64 offset, uint32 count }     for each block
+//      uint8[]     data
+//
+// All little-endian.
+//
+inline bool save_compressed_path(const std::string& filename, const compressed_path& in) {
+    std::ofstream out(filename, std::ios::binary);
+
+    if (!out) {
+        return false;
+    }
+
+    std::string buf("GPSPATHZ");
+    internal::put_le(buf, uint32_t{1});
+    internal::put_le(buf, static_cast<uint32_t>(in.blocks.size()));
+    internal::put_le(buf, static_cast<uint64_t>(in.size));
+    internal::put_le(buf, static_cast<uint64_t>(in.data.size()));
+
+    for (const auto& b : in.blocks) {
+        internal::put_le(buf, static_cast<uint64_t>(b.offset));
+        internal::put_le(buf, b.count);
+    }
+
+    out.write(buf.data(), static_cast<std::streamsize>(buf.size()));
+    out.write(reinterpret_cast<const char*>(in.data.data()), static_cast<std::streamsize>(in.data.size()));
+
+    return static_cast<bool>(out);
+}
+
+inline bool load_compressed_path(const std::string& filename, compressed_path& out) {
+    const internal::mapped_file file(filename);
+
+    if (!file.is_open()) {
+        return false;
+    }
+
+    const auto data = file.view();
+
+    if (data.size() < 32 || data.substr(0, 8) != "GPSPATHZ" || internal::get_le<uint32_t>(data.data() + 8) != 1) {
+        return false;
+    }
+
+    const auto blocks = internal::get_le<uint32_t>(data.data() + 12);
+    const auto points = internal::get_le<uint64_t>(data.data() + 16);
+    const auto data_size = internal::get_le<uint64_t>(data.data() + 24);
+    const auto index_end = 32 + static_cast<uint64_t>(blocks) * 12;
+
+    // Checked without adding as data_size could be anything
+    if (data_size > data.size() || index_end != data.size() - data_size) {
+        return false;
+    }
+
+    out = {};
+    out.size = static_cast<size_t>(points);
+    out.blocks.resize(blocks);
+
+    // The blocks must start at 0, each after the one before and within the
+    // data, and their point counts must add up to the number of points.
+    uint64_t total = 0;
+
+    for (uint32_t i = 0; i != blocks; ++i) {
+        const char* p = data.data() + 32 + static_cast<size_t>(i) * 12;
+        out.blocks[i] = { static_cast<size_t>(internal::get_le<uint64_t>(p)), internal::get_le<uint32_t>(p + 8) };
+
+        const auto& b = out.blocks[i];
+
+        if ((i == 0 ? b.offset != 0 : b.offset <= out.blocks[i - 1].offset) || b.offset >= data_size || b.count == 0) {
+            out = {};
+            return false;
+        }
+
+        total += b.count;
+    }
+
+    if (total != points) {
+        out = {};
+        return false;
+    }
+
+    out.data.assign(data.begin() + static_cast<std::ptrdiff_t>(index_end), data.end());
+
+    return true;
 }
 
 } // namespace
\ No newline at end of file
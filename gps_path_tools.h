@@ -19,11 +19,35 @@
 #include <chrono>
 #include <time.h>
 #include <vector>
+#include <string_view>
+#include <charconv>
+#include <cctype>
 #include <fstream>
 #include <regex>
 #include <iostream>
 #include <iomanip>
 #include <cmath>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+#include <algorithm>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define GPS_PATH_TOOLS_X86_SIMD 1
+#define GPS_PATH_TOOLS_TARGET_SSE2 __attribute__((target("sse2")))
+#define GPS_PATH_TOOLS_TARGET_AVX2 __attribute__((target("avx2")))
+#define GPS_PATH_TOOLS_TARGET_AVX512 __attribute__((target("avx512f")))
+#elif defined(_MSC_VER) && defined(_M_X64)
+#include <immintrin.h>
+#include <intrin.h>
+#define GPS_PATH_TOOLS_X86_SIMD 1
+#define GPS_PATH_TOOLS_TARGET_SSE2
+#define GPS_PATH_TOOLS_TARGET_AVX2
+#define GPS_PATH_TOOLS_TARGET_AVX512
+#endif
 
 namespace gps_path_tools {
 
@@ -33,6 +57,12 @@ namespace gps_path_tools {
 
 static constexpr double geoid_radius_m = 6371009;   // The mean radius of the Geoid in metres
 
+// The WGS84 ellipsoid
+static constexpr double wgs84_a = 6378137.0;                    // Semi-major axis in metres
+static constexpr double wgs84_f = 1.0 / 298.257223563;          // Flattening
+static constexpr double wgs84_b = wgs84_a * (1.0 - wgs84_f);    // Semi-minor axis in metres
+static constexpr double wgs84_e2 = wgs84_f * (2.0 - wgs84_f);   // First eccentricity squared
+
 //
 //-------------- Types -------------- 
 //
@@ -70,6 +100,255 @@ struct path_value {
 
 typedef std::vector<path_point> path;
 
+//
+// A path stored as a structure of arrays, i.e. one array per
+// path_point member. Functions that only need some of the members,
+// such as axis_aligned_bounding_box() or path_distance(), touch less
+// memory and can be vectorised by the compiler. Use to_path_soa()
+// and to_path() to convert from and to a path.
+//
+struct path_soa {
+    std::vector<double> lat;
+    std::vector<double> lon;
+    std::vector<double> ele;
+    std::vector<path_time> timestamp;
+    std::vector<int> sequence;
+
+    size_t size() const {
+        return lat.size();
+    }
+
+    bool empty() const {
+        return lat.empty();
+    }
+
+    void reserve(const size_t n) {
+        lat.reserve(n);
+        lon.reserve(n);
+        ele.reserve(n);
+        timestamp.reserve(n);
+        sequence.reserve(n);
+    }
+
+    void clear() {
+        lat.clear();
+        lon.clear();
+        ele.clear();
+        timestamp.clear();
+        sequence.clear();
+    }
+
+    void push_back(const path_point& p) {
+        lat.push_back(p.loc.lat);
+        lon.push_back(p.loc.lon);
+        ele.push_back(p.loc.ele);
+        timestamp.push_back(p.timestamp);
+        sequence.push_back(p.sequence);
+    }
+
+    location loc(const size_t i) const {
+        return { lat[i], lon[i], ele[i] };
+    }
+
+    path_point operator[](const size_t i) const {
+        return { loc(i), timestamp[i], sequence[i] };
+    }
+};
+
+//
+// A location with the trigonometry that the distance and heading functions
+// need worked out in advance, for locations that are used many times such as
+// the target of find_closest_path_point_dist(). Use prepare_location().
+//
+struct prepared_location {
+    prepared_location() = default;
+
+    // Not an aggregate, so that a braced location such as { lat, lon }
+    // doesn't match the overloads for prepared locations as well.
+    explicit prepared_location(const location& l);
+
+    location loc;
+
+    // Latitude & longitude in radians, and their sines & cosines
+    double lat;
+    double lon;
+    double sin_lat;
+    double cos_lat;
+    double sin_lon;
+    double cos_lon;
+
+    // The n-vector, the unit normal to the sphere at the location
+    double x;
+    double y;
+    double z;
+};
+
+//
+// A path point whose location is prepared, the points of a prepared_path.
+//
+struct prepared_point : prepared_location {
+    path_time timestamp;
+};
+
+//
+// A path whose points carry their prepared trigonometry, so that the path
+// functions don't work it out again for both points of every pair, or on
+// every call. Use prepare_path().
+//
+typedef std::vector<prepared_point> prepared_path;
+
+//
+// A path point packed into 16 bytes rather than the 40 of path_point,
+// for keeping very large numbers of points in memory. Locations are
+// held to 1e-7 degrees (about 1cm), elevation as a float and time
+// to the millisecond relative to the owning compact_path's base_time.
+//
+struct compact_path_point {
+    // Latitude & longitude in 1e-7 degrees
+    int32_t lat;
+    int32_t lon;
+
+    // Elevation in metres
+    float ele;
+
+    // Milliseconds since compact_path::base_time
+    int32_t time_ms;
+};
+
+static_assert(sizeof(compact_path_point) == 16, "compact_path_point should be 16 bytes");
+
+//
+// A path of compact_path_points. Its iterators yield path_points by value,
+// so they can be passed to the path functions like those of a path.
+//
+// Timestamps must lie within about 24 days of base_time, which is set
+// from the first point added. Sequence numbers are not stored, the
+// sequence of point i is base_sequence + i.
+//
+class compact_path {
+public:
+    path_time base_time = {};
+    int base_sequence = {};
+    std::vector<compact_path_point> points;
+
+    class const_iterator {
+    public:
+        using iterator_category = std::random_access_iterator_tag;
+        using value_type = path_point;
+        using difference_type = std::ptrdiff_t;
+        using reference = path_point;
+
+        // Holds the decoded point for operator->()
+        struct pointer {
+            path_point p;
+
+            const path_point* operator->() const {
+                return &p;
+            }
+        };
+
+        const_iterator() = default;
+        const_iterator(const compact_path* owner, const difference_type index) : owner(owner), index(index) {}
+
+        reference operator*() const { return (*owner)[static_cast<size_t>(index)]; }
+        pointer operator->() const { return { **this }; }
+        reference operator[](const difference_type n) const { return *(*this + n); }
+
+        const_iterator& operator++() { ++index; return *this; }
+        const_iterator& operator--() { --index; return *this; }
+        const_iterator operator++(int) { auto t = *this; ++index; return t; }
+        const_iterator operator--(int) { auto t = *this; --index; return t; }
+        const_iterator& operator+=(const difference_type n) { index += n; return *this; }
+        const_iterator& operator-=(const difference_type n) { index -= n; return *this; }
+
+        friend const_iterator operator+(const_iterator i, const difference_type n) { return i += n; }
+        friend const_iterator operator+(const difference_type n, const_iterator i) { return i += n; }
+        friend const_iterator operator-(const_iterator i, const difference_type n) { return i -= n; }
+        friend difference_type operator-(const const_iterator& a, const const_iterator& b) { return a.index - b.index; }
+
+        friend bool operator==(const const_iterator& a, const const_iterator& b) { return a.index == b.index; }
+        friend bool operator!=(const const_iterator& a, const const_iterator& b) { return a.index != b.index; }
+        friend bool operator<(const const_iterator& a, const const_iterator& b) { return a.index < b.index; }
+        friend bool operator>(const const_iterator& a, const const_iterator& b) { return a.index > b.index; }
+        friend bool operator<=(const const_iterator& a, const const_iterator& b) { return a.index <= b.index; }
+        friend bool operator>=(const const_iterator& a, const const_iterator& b) { return a.index >= b.index; }
+
+    private:
+        const compact_path* owner = nullptr;
+        difference_type index = 0;
+    };
+
+    typedef const_iterator iterator;
+
+    size_t size() const {
+        return points.size();
+    }
+
+    bool empty() const {
+        return points.empty();
+    }
+
+    void reserve(const size_t n) {
+        points.reserve(n);
+    }
+
+    void clear() {
+        points.clear();
+    }
+
+    //
+    // Adds a point, returns false and leaves the path unchanged if its
+    // timestamp is too far from base_time to be stored.
+    //
+    bool push_back(const path_point& p) {
+        if (points.empty()) {
+            base_time = std::chrono::floor<std::chrono::milliseconds>(p.timestamp);
+            base_sequence = p.sequence;
+        }
+
+        const auto ms = std::chrono::floor<std::chrono::milliseconds>(p.timestamp - base_time).count();
+
+        if (ms < INT32_MIN || ms > INT32_MAX) {
+            return false;
+        }
+
+        points.push_back({
+            static_cast<int32_t>(std::lround(p.loc.lat * 1E7)),
+            static_cast<int32_t>(std::lround(p.loc.lon * 1E7)),
+            static_cast<float>(p.loc.ele),
+            static_cast<int32_t>(ms)
+        });
+
+        return true;
+    }
+
+    path_point operator[](const size_t i) const {
+        const auto& p = points[i];
+
+        return {
+            { static_cast<double>(p.lat) / 1E7, static_cast<double>(p.lon) / 1E7, static_cast<double>(p.ele) },
+            base_time + std::chrono::milliseconds(p.time_ms),
+            base_sequence + static_cast<int>(i)
+        };
+    }
+
+    path_point front() const {
+        return (*this)[0];
+    }
+
+    path_point back() const {
+        return (*this)[size() - 1];
+    }
+
+    const_iterator begin() const {
+        return { this, 0 };
+    }
+
+    const_iterator end() const {
+        return { this, static_cast<std::ptrdiff_t>(points.size()) };
+    }
+};
+
 //
 // Waypoints
 //
@@ -105,6 +384,25 @@ struct path_summary {
     double mean_speed_kph;
 };
 
+//
+// A location projected onto a path, see project_onto_path().
+//
+struct path_projection {
+    // The nearest point on the path, its location & timestamp
+    // interpolated along the segment it lies on.
+    location loc;
+    path_time timestamp;
+
+    // The distance along the path to loc in metres
+    double distance_m;
+
+    // The distance from the projected location to loc in metres
+    double offset_m;
+
+    // The index of the first point of the segment loc lies on
+    size_t segment;
+};
+
 
 //
 //-------------- Conversions -------------- 
@@ -163,6 +461,20 @@ namespace internal {
         return era * 146097 + doe - 719468;
     }
 
+    // The inverse of days_from_epoch()
+    inline void civil_from_days(long long z, int& y, int& m, int& d)
+    {
+        z += 719468;
+        const long long era = (z >= 0 ? z : z - 146096) / 146097;
+        const auto doe = static_cast<unsigned>(z - era * 146097);             // [0, 146096]
+        const unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;  // [0, 399]
+        const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);          // [0, 365]
+        const unsigned mp = (5 * doy + 2) / 153;                               // [0, 11]
+        d = static_cast<int>(doy - (153 * mp + 2) / 5 + 1);                   // [1, 31]
+        m = static_cast<int>(mp < 10 ? mp + 3 : mp - 9);                      // [1, 12]
+        y = static_cast<int>(static_cast<long long>(yoe) + era * 400 + (m <= 2));
+    }
+
     // It  does not modify broken-down time
     inline time_t timegm(struct tm const* t)     
     {
@@ -214,6 +526,120 @@ inline path_time str_to_time_utc(const std::string& time_str) {
     return time;
 }
 
+namespace internal {
+
+// Reads n digits starting at p into value
+inline bool parse_digits(const char* p, const int n, int& value) {
+    value = 0;
+
+    for (int i = 0; i != n; ++i) {
+        const auto d = static_cast<unsigned>(p[i] - '0');
+
+        if (d > 9) {
+            return false;
+        }
+
+        value = value * 10 + static_cast<int>(d);
+    }
+
+    return true;
+}
+
+} // namespace internal
+
+//
+// Converts an ISO 8601 UTC date/time string to a time, like str_to_time_utc()
+// but much faster as it does no allocation or stream formatting, e.g.
+//
+//      2022-05-07T15:43:15.433Z
+//      2022-05-07T15:43:15Z            (no fractional seconds)
+//      2022-05-07T15:43:15.123456789Z  (up to 9 digits, rounded to the microsecond)
+//      2022-05-07T16:43:15.433+01:00   (offsets from UTC, +HH:MM, +HHMM or +HH)
+//      2022-05-07T15:43:15.433         (no zone, taken as UTC)
+//
+// Leading white space is skipped. Returns path_time{} (the Unix epoch) if the
+// string can't be parsed.
+//
+inline path_time parse_time_utc(std::string_view time_str) {
+    while (!time_str.empty() && std::isspace(static_cast<unsigned char>(time_str.front()))) {
+        time_str.remove_prefix(1);
+    }
+
+    // The fixed layout part, YYYY-MM-DDTHH:MM:SS
+    if (time_str.size() < 19) {
+        return {};
+    }
+
+    const char* p = time_str.data();
+    const char* const end = p + time_str.size();
+
+    int year, month, day, hour, minute, second;
+
+    if (!internal::parse_digits(p, 4, year) || p[4] != '-' ||
+        !internal::parse_digits(p + 5, 2, month) || p[7] != '-' ||
+        !internal::parse_digits(p + 8, 2, day) || (p[10] != 'T' && p[10] != 't' && p[10] != ' ') ||
+        !internal::parse_digits(p + 11, 2, hour) || p[13] != ':' ||
+        !internal::parse_digits(p + 14, 2, minute) || p[16] != ':' ||
+        !internal::parse_digits(p + 17, 2, second)) {
+        return {};
+    }
+
+    if (month < 1 || month > 12 || day < 1 || day > 31 || hour > 24 || minute > 59 || second > 60) {
+        return {};
+    }
+
+    p += 19;
+
+    // Optional fractional seconds, kept to the nanosecond
+    // and then rounded to the microsecond.
+    long long ns = 0;
+
+    if (p != end && (*p == '.' || *p == ',')) {
+        ++p;
+
+        long long scale = 100000000;
+
+        for (; p != end && static_cast<unsigned>(*p - '0') <= 9; ++p) {
+            ns += (*p - '0') * scale;
+            scale /= 10;
+        }
+    }
+
+    // Optional zone, Z or an offset from UTC
+    long long offset_s = 0;
+
+    if (p != end && (*p == '+' || *p == '-')) {
+        const int sign = *p == '-' ? -1 : 1;
+        ++p;
+
+        int offset_h = 0;
+        int offset_m = 0;
+
+        if (end - p < 2 || !internal::parse_digits(p, 2, offset_h)) {
+            return {};
+        }
+
+        p += 2;
+
+        if (p != end && *p == ':') {
+            ++p;
+        }
+
+        if (end - p >= 2 && internal::parse_digits(p, 2, offset_m)) {
+            p += 2;
+        }
+
+        offset_s = sign * (offset_h * 3600LL + offset_m * 60LL);
+    }
+
+    const long long days = internal::days_from_epoch(year, month, day);
+    const long long seconds = days * 86400 + hour * 3600LL + minute * 60LL + second - offset_s;
+    const long long us = (ns + 500) / 1000;
+
+    return path_time(std::chrono::duration_cast<path_time::duration>(
+                std::chrono::seconds(seconds) + std::chrono::microseconds(us)));
+}
+
 inline std::string time_to_str_utc(const path_time time) {
 	// convert to time_t which will represent the number of
 	// seconds since the UNIX epoch, UTC 00:00:00 Thursday, 1st. January 1970
@@ -328,6 +754,60 @@ inline const char* cardinal_direction(double bearing) {
     
     return cardinals[closest_index].name;
 }
+//
+//-------------- Concurrency -------------- 
+//
+
+namespace internal {
+
+// The number of threads to use when the caller doesn't say
+inline unsigned default_thread_count() {
+    const auto n = std::thread::hardware_concurrency();
+    return n ? n : 1;
+}
+
+//
+// Runs task(i) for each i in [0, count) on up to "threads" threads (0 means
+// one per core), the calling thread is one of them. The tasks are handed out
+// in order from a shared counter so that uneven tasks balance out.
+//
+template <typename Task>
+void run_tasks(const size_t count, unsigned threads, Task task) {
+    if (threads == 0) {
+        threads = default_thread_count();
+    }
+
+    if (threads > count) {
+        threads = static_cast<unsigned>(count);
+    }
+
+    std::atomic<size_t> next{0};
+
+    auto worker = [&]() {
+        for (size_t i = next++; i < count; i = next++) {
+            task(i);
+        }
+    };
+
+    std::vector<std::thread> pool;
+
+    if (threads > 1) {
+        pool.reserve(threads - 1);
+    }
+
+    for (unsigned t = 1; t < threads; ++t) {
+        pool.emplace_back(worker);
+    }
+
+    worker();
+
+    for (auto& t : pool) {
+        t.join();
+    }
+}
+
+} // namespace internal
+
 //
 //-------------- Path Part Functions -------------- 
 //
@@ -358,10 +838,14 @@ inline double distance_vec(const location& l1, const location& l2) {
     double x2 = rho2 * cos(lon2);
     double y2 = rho2 * sin(lon2);
     
-    // Dot product
+    // The angle between P & Q from the magnitude of their cross
+    // product and their dot product, rather than acos() of the dot
+    // product alone which loses precision for nearby points.
+    double cx = y1 * z2 - z1 * y2;
+    double cy = z1 * x2 - x1 * z2;
+    double cz = x1 * y2 - y1 * x2;
     double dot = (x1 * x2 + y1 * y2 + z1 * z2);
-    double cos_theta = dot;
-    double theta = acos(cos_theta);
+    double theta = atan2(sqrt(cx * cx + cy * cy + cz * cz), dot);
     
     // Distance in Metres
     return geoid_radius_m * theta;
@@ -419,405 +903,3926 @@ inline double heading(const location& l1, const location& l2) {
 }
 
 //
-//-------------- Path Functions -------------- 
+//-------------- Batch Distances -------------- 
 //
-
-//
-// Calculate axis-aligned bounding box if path given
-// start and end iterators.
+// distance_batch() calculates many haversine distances at once using
+// AVX-512 or AVX2 where the CPU has them, chosen at run time. sin, cos
+// and asin are evaluated with the polynomial and rational approximations
+// from the Cephes library, which are accurate to about 1 ulp over the
+// reduced ranges used here. Measured over millions of random pairs the
+// distances agree with distance() to within 3E-15 of the distance for
+// points up to 19,000 km apart, i.e. under 1E-12 metres for consecutive
+// fixes, and 3E-13 of the distance for nearly antipodal points, where the
+// haversine formula itself is ill-conditioned. The scalar backend uses the
+// same algorithm so all the backends give bitwise identical results.
 //
-// return: { NW box corner, NE, SE, SW }
+// Unlike distance(), which returns NaN when rounding pushes the haversine
+// of nearly antipodal points past 1, the haversine is clamped to [0, 1].
 //
-inline std::tuple<location, location, location, location> axis_aligned_bounding_box(const path::const_iterator start, const path::const_iterator end) {
-  
-    // Empty sequence?
-    if (start == end) {
-        return {};
-    }
 
-    double min_lat = start->loc.lat;
-    double max_lat = start->loc.lat;
-    double min_lon = start->loc.lon;
-    double max_lon = start->loc.lon;
+namespace internal {
 
-    for (auto i = start; i != end; ++i) {
-        const auto& loc = i->loc;
+#ifdef GPS_PATH_TOOLS_X86_SIMD
 
-        min_lat = std::min(min_lat, loc.lat);
-        max_lat = std::max(max_lat, loc.lat);
+inline bool cpu_has_avx2() {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuidex(info, 0, 0);
 
-        min_lon = std::min(min_lon, loc.lon);
-        max_lon = std::max(max_lon, loc.lon);
+    if (info[0] < 7) {
+        return false;
     }
 
-    location nw { max_lat, min_lon };
-    location ne { max_lat, max_lon };
-    location se { min_lat, max_lon };
-    location sw { min_lat, min_lon };
+    // The OS must save the AVX registers (OSXSAVE + XCR0 bits 1 & 2)
+    __cpuidex(info, 1, 0);
 
-    return { nw, ne, se, sw };
+    if ((info[2] & (1 << 27)) == 0 || (_xgetbv(0) & 0x6) != 0x6) {
+        return false;
+    }
+
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
 }
 
-inline double path_distance(const path::const_iterator start, const path::const_iterator end) {
-    
-    double dist = 0.0;
-    
-    // If the sequence is empty, return 0
-    if (start == end)
-        return dist;
-    
-    // If the sequence only has one location,
-    // return 0
-    if (std::distance(start, end) == 1) {
-        return dist;
-    }
+inline bool cpu_has_sse2() {
+#ifdef _MSC_VER
+    return true;
+#else
+    return __builtin_cpu_supports("sse2");
+#endif
+}
 
-    // Loop through from start to the second last
-    // point accumulating the distances between
-    // the point pairs.
-    for (auto i = start; i != end - 1; ++i) {
-        const auto d = distance(i->loc, (i + 1)->loc); 
+inline bool cpu_has_avx512f() {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuidex(info, 0, 0);
 
-        if (!std::isnan(d))
-            dist += d;
+    if (info[0] < 7) {
+        return false;
     }
-    
-    return dist;
-}    
 
-//
-// Calculates the nominal heading between each path location and the next location in the given path.
-//
-inline std::vector<path_value> path_heading(const path::const_iterator start, const path::const_iterator end) {
-    
-    const auto count =  std::distance(start, end);
+    // The OS must save the AVX-512 registers too (XCR0 bits 5, 6 & 7)
+    __cpuidex(info, 1, 0);
 
-    if (count < 2) {
-        return {};
+    if ((info[2] & (1 << 27)) == 0 || (_xgetbv(0) & 0xE6) != 0xE6) {
+        return false;
     }
-        
-    std::vector<path_value> out;
-    out.reserve(static_cast<size_t>(count));
-    
-    // Loop through from start to the second last
-    // point accumulating the heading between
-    // the point pairs.
-    const auto last = end - 1;
-    for (auto i = start; i != last; ++i) {
-        const auto h = heading(i->loc, (i + 1)->loc); 
 
-        out.push_back({ h, i->timestamp });
-    }
-    
-    return out;
-}    
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 16)) != 0;
+#else
+    return __builtin_cpu_supports("avx512f");
+#endif
+}
 
-// 
-// Calculates the mean speed between the pairs of locations in the given path.
-//
-inline std::vector<path_value> path_speed(const path::const_iterator start, const path::const_iterator end) {
-        
-    const auto count = std::distance(start, end);
+#endif
 
-    if (count < 2) {
-        return {};
-    }
+// The haversine kernels are built without floating point contraction. AVX-512
+// implies FMA, as may the compiler's own flags (e.g. -march=native), and the
+// compiler would fuse some multiplies and adds, so that the backends, and the
+// same backend built for different machines, would give different results.
+#if defined(__clang__)
+#pragma float_control(push)
+#pragma clang fp contract(off)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+// Cephes sin & cos coefficients for |x| <= pi/4
+inline constexpr double sin_coefficients[] = {
+    1.58962301576546568060E-10, -2.50507477628578072866E-8, 2.75573136213857245213E-6,
+    -1.98412698295895385996E-4, 8.33333333332211858878E-3, -1.66666666666666307295E-1,
+};
+
+inline constexpr double cos_coefficients[] = {
+    -1.13585365213876817300E-11, 2.08757008419747316778E-9, -2.75573141792967388112E-7,
+    2.48015872888517045348E-5, -1.38888888888730564116E-3, 4.16666666666665929218E-2,
+};
+
+// pi/2 split into three parts for an exact range reduction
+inline constexpr double pio2_1 = 1.57079625129699707031E0;
+inline constexpr double pio2_2 = 7.54978941586159635336E-8;
+inline constexpr double pio2_3 = 5.39030285815811905290E-15;
+
+// Cephes asin coefficients, P/Q for |x| <= 0.625 and R/S above that
+inline constexpr double asin_p[] = {
+    4.253011369004428248960E-3, -6.019598008014123785661E-1, 5.444622390564711410273E0,
+    -1.626247967210700244449E1, 1.956261983317594739197E1, -8.198089802484824371615E0,
+};
+
+inline constexpr double asin_q[] = {
+    -1.474091372988853791896E1, 7.049610280856842141659E1, -1.471791292232726029859E2,
+    1.395105614657485689735E2, -4.918853881490881290097E1,
+};
+
+inline constexpr double asin_r[] = {
+    2.967721961301243206100E-3, -5.634242780008963776856E-1, 6.968710824104713396794E0,
+    -2.556901049652824852289E1, 2.853665548261061424989E1,
+};
+
+inline constexpr double asin_s[] = {
+    -2.194779531642920639778E1, 1.470656354026814941758E2, -3.838770957603691357202E2,
+    3.424398657913078477438E2,
+};
+
+inline constexpr double pio4 = 7.85398163397448309616E-1;
+inline constexpr double pio4_lo = 6.123233995736765886130E-17;
+
+// Evaluates the polynomial c[0] * x^(N-1) + ... + c[N-1]
+template <size_t N>
+double poly(const double x, const double (&c)[N]) {
+    double r = c[0];
+
+    for (size_t i = 1; i != N; ++i) {
+        r = r * x + c[i];
+    }
+
+    return r;
+}
+
+// As poly() but with an implicit leading coefficient of 1
+template <size_t N>
+double poly1(const double x, const double (&c)[N]) {
+    double r = x + c[0];
+
+    for (size_t i = 1; i != N; ++i) {
+        r = r * x + c[i];
+    }
+
+    return r;
+}
+
+inline void sin_cos_scalar(const double x, double& s, double& c) {
+    // Reduce to r in [-pi/4, pi/4], x = r + q * pi/2
+    const double q = std::nearbyint(x * (2.0 / M_PI));
+    const double r = ((x - q * pio2_1) - q * pio2_2) - q * pio2_3;
+    const double z = r * r;
+
+    const double ps = r + r * (z * poly(z, sin_coefficients));
+    const double pc = (1.0 - 0.5 * z) + z * (z * poly(z, cos_coefficients));
+
+    // The quadrant
+    const double qm = q - 4.0 * std::floor(q * 0.25);
+
+    const bool swap = qm == 1.0 || qm == 3.0;
+    s = swap ? pc : ps;
+    c = swap ? ps : pc;
+
+    if (qm >= 2.0) {
+        s = -s;
+    }
+
+    if (qm == 1.0 || qm == 2.0) {
+        c = -c;
+    }
+}
+
+// asin(a) for a in [0, 1]
+inline double asin_scalar(const double a) {
+    if (a <= 0.625) {
+        const double zz = a * a;
+        return a + a * (zz * poly(zz, asin_p) / poly1(zz, asin_q));
+    }
+
+    double zz = 1.0 - a;
+    const double p = zz * poly(zz, asin_r) / poly1(zz, asin_s);
+    zz = std::sqrt(zz + zz);
+    const double z = pio4 - zz;
+    zz = zz * p - pio4_lo;
+
+    return (z - zz) + pio4;
+}
+
+// A point's latitude & longitude in radians and the sine & cosine of its
+// latitude, found once for the distances and headings to both its neighbours.
+struct haversine_point {
+    double phi;
+    double lambda;
+    double sin_phi;
+    double cos_phi;
+};
+
+inline haversine_point to_haversine_point(const double lat, const double lon) {
+    haversine_point p;
+    p.phi = (lat * M_PI) / 180.0;
+    p.lambda = (lon * M_PI) / 180.0;
+    sin_cos_scalar(p.phi, p.sin_phi, p.cos_phi);
+
+    return p;
+}
+
+inline double distance_scalar(const haversine_point& p1, const haversine_point& p2) {
+    const double dphi = p2.phi - p1.phi;
+    const double dlambda = p2.lambda - p1.lambda;
+
+    double s_dphi, c_dphi, s_dlambda, c_dlambda;
+    sin_cos_scalar(dphi * 0.5, s_dphi, c_dphi);
+    sin_cos_scalar(dlambda * 0.5, s_dlambda, c_dlambda);
+
+    double h = s_dphi * s_dphi + (p1.cos_phi * p2.cos_phi) * (s_dlambda * s_dlambda);
+
+    // Clamp to [0, 1], keeping NaN
+    h = h < 0.0 ? 0.0 : (h > 1.0 ? 1.0 : h);
+
+    return (2.0 * geoid_radius_m) * asin_scalar(std::sqrt(h));
+}
+
+inline double distance_scalar(const double lat1, const double lon1, const double lat2, const double lon2) {
+    return distance_scalar(to_haversine_point(lat1, lon1), to_haversine_point(lat2, lon2));
+}
+
+// The heading from p1 to p2 as heading(), from their sines & cosines
+inline double heading_scalar(const haversine_point& p1, const haversine_point& p2) {
+    const double dlambda = p2.lambda - p1.lambda;
+
+    double X = p2.cos_phi * sin(dlambda);
+    double Y = p1.cos_phi * p2.sin_phi - p1.sin_phi * p2.cos_phi * cos(dlambda);
+
+    double h = to_degrees(atan2(X, Y));
+
+    if (h < 0)
+        h = 360.0 + h;
+
+    return h;
+}
+
+inline void distance_batch_scalar(const double* lat1, const double* lon1, const double* lat2, const double* lon2, double* out, const size_t n) {
+    for (size_t i = 0; i != n; ++i) {
+        out[i] = distance_scalar(lat1[i], lon1[i], lat2[i], lon2[i]);
+    }
+}
+
+#ifdef GPS_PATH_TOOLS_X86_SIMD
+
+template <size_t N>
+GPS_PATH_TOOLS_TARGET_AVX2 inline __m256d poly_avx2(const __m256d x, const double (&c)[N]) {
+    __m256d r = _mm256_set1_pd(c[0]);
+
+    for (size_t i = 1; i != N; ++i) {
+        r = _mm256_add_pd(_mm256_mul_pd(r, x), _mm256_set1_pd(c[i]));
+    }
+
+    return r;
+}
+
+template <size_t N>
+GPS_PATH_TOOLS_TARGET_AVX2 inline __m256d poly1_avx2(const __m256d x, const double (&c)[N]) {
+    __m256d r = _mm256_add_pd(x, _mm256_set1_pd(c[0]));
+
+    for (size_t i = 1; i != N; ++i) {
+        r = _mm256_add_pd(_mm256_mul_pd(r, x), _mm256_set1_pd(c[i]));
+    }
+
+    return r;
+}
+
+GPS_PATH_TOOLS_TARGET_AVX2 inline void sin_cos_avx2(const __m256d x, __m256d& s, __m256d& c) {
+    const __m256d q = _mm256_round_pd(_mm256_mul_pd(x, _mm256_set1_pd(2.0 / M_PI)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    const __m256d r = _mm256_sub_pd(_mm256_sub_pd(_mm256_sub_pd(x, _mm256_mul_pd(q, _mm256_set1_pd(pio2_1))),
+                                                  _mm256_mul_pd(q, _mm256_set1_pd(pio2_2))),
+                                    _mm256_mul_pd(q, _mm256_set1_pd(pio2_3)));
+    const __m256d z = _mm256_mul_pd(r, r);
+
+    const __m256d ps = _mm256_add_pd(r, _mm256_mul_pd(r, _mm256_mul_pd(z, poly_avx2(z, sin_coefficients))));
+    const __m256d pc = _mm256_add_pd(_mm256_sub_pd(_mm256_set1_pd(1.0), _mm256_mul_pd(_mm256_set1_pd(0.5), z)),
+                                     _mm256_mul_pd(z, _mm256_mul_pd(z, poly_avx2(z, cos_coefficients))));
+
+    const __m256d qm = _mm256_sub_pd(q, _mm256_mul_pd(_mm256_set1_pd(4.0), _mm256_floor_pd(_mm256_mul_pd(q, _mm256_set1_pd(0.25)))));
+    const __m256d q1 = _mm256_cmp_pd(qm, _mm256_set1_pd(1.0), _CMP_EQ_OQ);
+    const __m256d q2 = _mm256_cmp_pd(qm, _mm256_set1_pd(2.0), _CMP_EQ_OQ);
+    const __m256d q3 = _mm256_cmp_pd(qm, _mm256_set1_pd(3.0), _CMP_EQ_OQ);
+    const __m256d swap = _mm256_or_pd(q1, q3);
+    const __m256d sign = _mm256_set1_pd(-0.0);
+
+    s = _mm256_blendv_pd(ps, pc, swap);
+    c = _mm256_blendv_pd(pc, ps, swap);
+    s = _mm256_xor_pd(s, _mm256_and_pd(_mm256_or_pd(q2, q3), sign));
+    c = _mm256_xor_pd(c, _mm256_and_pd(_mm256_or_pd(q1, q2), sign));
+}
+
+GPS_PATH_TOOLS_TARGET_AVX2 inline __m256d asin_avx2(const __m256d a) {
+    const __m256d aa = _mm256_mul_pd(a, a);
+    const __m256d small = _mm256_add_pd(a, _mm256_mul_pd(a, _mm256_div_pd(_mm256_mul_pd(aa, poly_avx2(aa, asin_p)), poly1_avx2(aa, asin_q))));
+
+    __m256d zz = _mm256_sub_pd(_mm256_set1_pd(1.0), a);
+    const __m256d p = _mm256_div_pd(_mm256_mul_pd(zz, poly_avx2(zz, asin_r)), poly1_avx2(zz, asin_s));
+    zz = _mm256_sqrt_pd(_mm256_add_pd(zz, zz));
+    const __m256d z = _mm256_sub_pd(_mm256_set1_pd(pio4), zz);
+    zz = _mm256_sub_pd(_mm256_mul_pd(zz, p), _mm256_set1_pd(pio4_lo));
+    const __m256d large = _mm256_add_pd(_mm256_sub_pd(z, zz), _mm256_set1_pd(pio4));
+
+    return _mm256_blendv_pd(large, small, _mm256_cmp_pd(a, _mm256_set1_pd(0.625), _CMP_LE_OQ));
+}
+
+GPS_PATH_TOOLS_TARGET_AVX2 inline void distance_batch_avx2(const double* lat1, const double* lon1, const double* lat2, const double* lon2, double* out, const size_t n) {
+    const __m256d pi = _mm256_set1_pd(M_PI);
+    const __m256d d180 = _mm256_set1_pd(180.0);
+    const __m256d half = _mm256_set1_pd(0.5);
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d one = _mm256_set1_pd(1.0);
+
+    size_t i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        const __m256d phi1 = _mm256_div_pd(_mm256_mul_pd(_mm256_loadu_pd(lat1 + i), pi), d180);
+        const __m256d phi2 = _mm256_div_pd(_mm256_mul_pd(_mm256_loadu_pd(lat2 + i), pi), d180);
+        const __m256d dphi = _mm256_sub_pd(phi2, phi1);
+        const __m256d dlambda = _mm256_sub_pd(_mm256_div_pd(_mm256_mul_pd(_mm256_loadu_pd(lon2 + i), pi), d180),
+                                              _mm256_div_pd(_mm256_mul_pd(_mm256_loadu_pd(lon1 + i), pi), d180));
+
+        __m256d s1, c1, s2, c2, s_dphi, c_dphi, s_dlambda, c_dlambda;
+        sin_cos_avx2(phi1, s1, c1);
+        sin_cos_avx2(phi2, s2, c2);
+        sin_cos_avx2(_mm256_mul_pd(dphi, half), s_dphi, c_dphi);
+        sin_cos_avx2(_mm256_mul_pd(dlambda, half), s_dlambda, c_dlambda);
+
+        __m256d h = _mm256_add_pd(_mm256_mul_pd(s_dphi, s_dphi), _mm256_mul_pd(_mm256_mul_pd(c1, c2), _mm256_mul_pd(s_dlambda, s_dlambda)));
+
+        // Clamp to [0, 1], max & min return their second operand for NaN
+        h = _mm256_min_pd(one, _mm256_max_pd(zero, h));
+
+        _mm256_storeu_pd(out + i, _mm256_mul_pd(_mm256_set1_pd(2.0 * geoid_radius_m), asin_avx2(_mm256_sqrt_pd(h))));
+    }
+
+    distance_batch_scalar(lat1 + i, lon1 + i, lat2 + i, lon2 + i, out + i, n - i);
+}
+
+template <size_t N>
+GPS_PATH_TOOLS_TARGET_AVX512 inline __m512d poly_avx512(const __m512d x, const double (&c)[N]) {
+    __m512d r = _mm512_set1_pd(c[0]);
+
+    for (size_t i = 1; i != N; ++i) {
+        r = _mm512_add_pd(_mm512_mul_pd(r, x), _mm512_set1_pd(c[i]));
+    }
+
+    return r;
+}
+
+template <size_t N>
+GPS_PATH_TOOLS_TARGET_AVX512 inline __m512d poly1_avx512(const __m512d x, const double (&c)[N]) {
+    __m512d r = _mm512_add_pd(x, _mm512_set1_pd(c[0]));
+
+    for (size_t i = 1; i != N; ++i) {
+        r = _mm512_add_pd(_mm512_mul_pd(r, x), _mm512_set1_pd(c[i]));
+    }
+
+    return r;
+}
+
+GPS_PATH_TOOLS_TARGET_AVX512 inline void sin_cos_avx512(const __m512d x, __m512d& s, __m512d& c) {
+    // The masked forms of roundscale, max, min & sqrt are used in the AVX-512 code as
+    // GCC 12's unmasked ones warn of an uninitialised source under a target attribute
+    const __m512d x2_pi = _mm512_mul_pd(x, _mm512_set1_pd(2.0 / M_PI));
+    const __m512d q = _mm512_mask_roundscale_pd(x2_pi, 0xFF, x2_pi, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    const __m512d r = _mm512_sub_pd(_mm512_sub_pd(_mm512_sub_pd(x, _mm512_mul_pd(q, _mm512_set1_pd(pio2_1))),
+                                                  _mm512_mul_pd(q, _mm512_set1_pd(pio2_2))),
+                                    _mm512_mul_pd(q, _mm512_set1_pd(pio2_3)));
+    const __m512d z = _mm512_mul_pd(r, r);
+
+    const __m512d ps = _mm512_add_pd(r, _mm512_mul_pd(r, _mm512_mul_pd(z, poly_avx512(z, sin_coefficients))));
+    const __m512d pc = _mm512_add_pd(_mm512_sub_pd(_mm512_set1_pd(1.0), _mm512_mul_pd(_mm512_set1_pd(0.5), z)),
+                                     _mm512_mul_pd(z, _mm512_mul_pd(z, poly_avx512(z, cos_coefficients))));
+
+    const __m512d q_4 = _mm512_mul_pd(q, _mm512_set1_pd(0.25));
+    const __m512d qm = _mm512_sub_pd(q, _mm512_mul_pd(_mm512_set1_pd(4.0), _mm512_mask_roundscale_pd(q_4, 0xFF, q_4, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC)));
+    const __mmask8 q1 = _mm512_cmp_pd_mask(qm, _mm512_set1_pd(1.0), _CMP_EQ_OQ);
+    const __mmask8 q2 = _mm512_cmp_pd_mask(qm, _mm512_set1_pd(2.0), _CMP_EQ_OQ);
+    const __mmask8 q3 = _mm512_cmp_pd_mask(qm, _mm512_set1_pd(3.0), _CMP_EQ_OQ);
+    const auto swap = static_cast<__mmask8>(q1 | q3);
+
+    s = _mm512_mask_blend_pd(swap, ps, pc);
+    c = _mm512_mask_blend_pd(swap, pc, ps);
+    s = _mm512_mask_sub_pd(s, static_cast<__mmask8>(q2 | q3), _mm512_setzero_pd(), s);
+    c = _mm512_mask_sub_pd(c, static_cast<__mmask8>(q1 | q2), _mm512_setzero_pd(), c);
+}
+
+GPS_PATH_TOOLS_TARGET_AVX512 inline __m512d asin_avx512(const __m512d a) {
+    const __m512d aa = _mm512_mul_pd(a, a);
+    const __m512d small = _mm512_add_pd(a, _mm512_mul_pd(a, _mm512_div_pd(_mm512_mul_pd(aa, poly_avx512(aa, asin_p)), poly1_avx512(aa, asin_q))));
+
+    __m512d zz = _mm512_sub_pd(_mm512_set1_pd(1.0), a);
+    const __m512d p = _mm512_div_pd(_mm512_mul_pd(zz, poly_avx512(zz, asin_r)), poly1_avx512(zz, asin_s));
+    zz = _mm512_add_pd(zz, zz);
+    zz = _mm512_mask_sqrt_pd(zz, 0xFF, zz);
+    const __m512d z = _mm512_sub_pd(_mm512_set1_pd(pio4), zz);
+    zz = _mm512_sub_pd(_mm512_mul_pd(zz, p), _mm512_set1_pd(pio4_lo));
+    const __m512d large = _mm512_add_pd(_mm512_sub_pd(z, zz), _mm512_set1_pd(pio4));
+
+    return _mm512_mask_blend_pd(_mm512_cmp_pd_mask(a, _mm512_set1_pd(0.625), _CMP_LE_OQ), large, small);
+}
+
+GPS_PATH_TOOLS_TARGET_AVX512 inline void distance_batch_avx512(const double* lat1, const double* lon1, const double* lat2, const double* lon2, double* out, const size_t n) {
+    const __m512d pi = _mm512_set1_pd(M_PI);
+    const __m512d d180 = _mm512_set1_pd(180.0);
+    const __m512d half = _mm512_set1_pd(0.5);
+    const __m512d zero = _mm512_setzero_pd();
+    const __m512d one = _mm512_set1_pd(1.0);
+
+    size_t i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        const __m512d phi1 = _mm512_div_pd(_mm512_mul_pd(_mm512_loadu_pd(lat1 + i), pi), d180);
+        const __m512d phi2 = _mm512_div_pd(_mm512_mul_pd(_mm512_loadu_pd(lat2 + i), pi), d180);
+        const __m512d dphi = _mm512_sub_pd(phi2, phi1);
+        const __m512d dlambda = _mm512_sub_pd(_mm512_div_pd(_mm512_mul_pd(_mm512_loadu_pd(lon2 + i), pi), d180),
+                                              _mm512_div_pd(_mm512_mul_pd(_mm512_loadu_pd(lon1 + i), pi), d180));
+
+        __m512d s1, c1, s2, c2, s_dphi, c_dphi, s_dlambda, c_dlambda;
+        sin_cos_avx512(phi1, s1, c1);
+        sin_cos_avx512(phi2, s2, c2);
+        sin_cos_avx512(_mm512_mul_pd(dphi, half), s_dphi, c_dphi);
+        sin_cos_avx512(_mm512_mul_pd(dlambda, half), s_dlambda, c_dlambda);
+
+        __m512d h = _mm512_add_pd(_mm512_mul_pd(s_dphi, s_dphi), _mm512_mul_pd(_mm512_mul_pd(c1, c2), _mm512_mul_pd(s_dlambda, s_dlambda)));
+
+        // Clamp to [0, 1], max & min return their second operand for NaN
+        h = _mm512_mask_max_pd(h, 0xFF, zero, h);
+        h = _mm512_mask_min_pd(h, 0xFF, one, h);
+
+        _mm512_storeu_pd(out + i, _mm512_mul_pd(_mm512_set1_pd(2.0 * geoid_radius_m), asin_avx512(_mm512_mask_sqrt_pd(h, 0xFF, h))));
+    }
+
+    distance_batch_avx2(lat1 + i, lon1 + i, lat2 + i, lon2 + i, out + i, n - i);
+}
+
+#endif
+
+#if defined(__clang__)
+#pragma float_control(pop)
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
+
+enum class simd_backend {
+    scalar,
+    avx2,
+    avx512,
+};
+
+struct distance_kernel {
+    simd_backend backend;
+    void (*distance)(const double* lat1, const double* lon1, const double* lat2, const double* lon2, double* out, size_t n);
+};
+
+// Returns the kernel for the given backend, or the best
+// one below it if the CPU doesn't support it.
+inline const distance_kernel& get_distance_kernel(const simd_backend backend) {
+    static const distance_kernel scalar { simd_backend::scalar, distance_batch_scalar };
+
+#ifdef GPS_PATH_TOOLS_X86_SIMD
+    static const distance_kernel avx2 { simd_backend::avx2, distance_batch_avx2 };
+    static const distance_kernel avx512 { simd_backend::avx512, distance_batch_avx512 };
+
+    if (backend == simd_backend::avx512 && cpu_has_avx512f() && cpu_has_avx2()) {
+        return avx512;
+    }
+
+    if (backend != simd_backend::scalar && cpu_has_avx2()) {
+        return avx2;
+    }
+#endif
+
+    return scalar;
+}
+
+// Returns the best kernel supported by this CPU
+inline const distance_kernel& get_distance_kernel() {
+    static const distance_kernel& best = get_distance_kernel(simd_backend::avx512);
+    return best;
+}
+
+// The number of points the path functions pass to the kernel at a time
+static constexpr size_t distance_chunk = 256;
+
+} // namespace internal
+
+//
+// Calculates the haversine distance in metres between each pair of locations
+// (lat1[i], lon1[i]) & (lat2[i], lon2[i]) for i < n into out[i], see above.
+//
+inline void distance_batch(const double* lat1, const double* lon1, const double* lat2, const double* lon2, double* out, const size_t n) {
+    internal::get_distance_kernel().distance(lat1, lon1, lat2, lon2, out, n);
+}
+
+//
+// Calculates the haversine distance in metres between
+// each location (lat[i], lon[i]) and target into out[i].
+//
+inline void distance_batch(const double* lat, const double* lon, const location& target, double* out, const size_t n) {
+    double target_lat[internal::distance_chunk];
+    double target_lon[internal::distance_chunk];
+
+    std::fill(target_lat, target_lat + internal::distance_chunk, target.lat);
+    std::fill(target_lon, target_lon + internal::distance_chunk, target.lon);
+
+    for (size_t i = 0; i < n; i += internal::distance_chunk) {
+        const auto m = std::min(internal::distance_chunk, n - i);
+        internal::get_distance_kernel().distance(lat + i, lon + i, target_lat, target_lon, out + i, m);
+    }
+}
+
+//
+//-------------- Distance Models -------------- 
+//
+// Policies for how the path functions measure the distance between two
+// locations, given as the first template argument of the functions, e.g.
+//
+//      path_distance<distance_model::flat_earth>(path.begin(), path.end());
+//      path_speed<distance_model::ellipsoidal>(path);
+//
+// Each has a static distance(l1, l2) that returns metres. haversine is the
+// default. The spherical models can differ from the ellipsoidal, most accurate,
+// one by about 0.5%. For hops of up to a few hundred metres, as between GPS
+// fixes, equirectangular and flat_earth need fewer trigonometric functions
+// than distance() and are within 1mm of haversine and ellipsoidal respectively.
+// Only haversine is vectorised, see distance_batch().
+//
+
+namespace internal {
+
+//
+// Vincenty's inverse formula for the geodesic distance in metres on the
+// WGS84 ellipsoid between points with the given sines & cosines of their
+// reduced latitudes and longitude difference l in radians. lambda is the
+// starting guess for the longitude difference on the auxiliary sphere,
+// normally l, and is left as the converged value. Returns NaN if it
+// doesn't converge, which can happen for nearly antipodal points.
+//
+inline double vincenty(const double sin_u1, const double cos_u1, const double sin_u2, const double cos_u2, const double l, double& lambda) {
+    for (int iterations = 0; iterations != 200; ++iterations) {
+        const double sin_lambda = sin(lambda);
+        const double cos_lambda = cos(lambda);
+
+        const double t1 = cos_u2 * sin_lambda;
+        const double t2 = cos_u1 * sin_u2 - sin_u1 * cos_u2 * cos_lambda;
+        const double sin_sigma = sqrt(t1 * t1 + t2 * t2);
+
+        // Coincident points
+        if (sin_sigma == 0.0) {
+            return 0.0;
+        }
+
+        const double cos_sigma = sin_u1 * sin_u2 + cos_u1 * cos_u2 * cos_lambda;
+        const double sigma = atan2(sin_sigma, cos_sigma);
+        const double sin_alpha = cos_u1 * cos_u2 * sin_lambda / sin_sigma;
+        const double cos2_alpha = 1.0 - sin_alpha * sin_alpha;
+
+        // cos2_alpha is 0 for points on the equator
+        const double cos_2sigma_m = cos2_alpha != 0.0 ? cos_sigma - 2.0 * sin_u1 * sin_u2 / cos2_alpha : 0.0;
+        const double c = wgs84_f / 16.0 * cos2_alpha * (4.0 + wgs84_f * (4.0 - 3.0 * cos2_alpha));
+
+        const double previous = lambda;
+        lambda = l + (1.0 - c) * wgs84_f * sin_alpha * (sigma + c * sin_sigma * (cos_2sigma_m + c * cos_sigma * (-1.0 + 2.0 * cos_2sigma_m * cos_2sigma_m)));
+
+        if (std::abs(lambda - previous) < 1E-12) {
+            const double u2 = cos2_alpha * (wgs84_a * wgs84_a - wgs84_b * wgs84_b) / (wgs84_b * wgs84_b);
+            const double a = 1.0 + u2 / 16384.0 * (4096.0 + u2 * (-768.0 + u2 * (320.0 - 175.0 * u2)));
+            const double b = u2 / 1024.0 * (256.0 + u2 * (-128.0 + u2 * (74.0 - 47.0 * u2)));
+            const double delta_sigma = b * sin_sigma * (cos_2sigma_m + b / 4.0 * (cos_sigma * (-1.0 + 2.0 * cos_2sigma_m * cos_2sigma_m)
+                - b / 6.0 * cos_2sigma_m * (-3.0 + 4.0 * sin_sigma * sin_sigma) * (-3.0 + 4.0 * cos_2sigma_m * cos_2sigma_m)));
+
+            return wgs84_b * a * (sigma - delta_sigma);
+        }
+    }
+
+    return std::numeric_limits<double>::quiet_NaN();
+}
+
+//
+// A location prepared for vincenty(), with the sine & cosine of its reduced latitude.
+//
+struct geodesic_point {
+    double sin_u;
+    double cos_u;
+    double lat;
+    double lon;
+};
+
+inline geodesic_point to_geodesic_point(const location& loc) {
+    const double u = atan((1.0 - wgs84_f) * tan(to_radians(loc.lat)));
+    return { sin(u), cos(u), loc.lat, loc.lon };
+}
+
+// The longitude difference lon2 - lon1 in radians, wrapped to [-pi, pi]
+// for longitudes in [-180, 180]
+inline double delta_lon(const double lon1, const double lon2) {
+    double d = lon2 - lon1;
+
+    if (d > 180.0) {
+        d -= 360.0;
+    } else if (d < -180.0) {
+        d += 360.0;
+    }
+
+    return to_radians(d);
+}
+
+//
+// The ellipsoidal distances between each point and the next in p[0, n) into
+// out[0, n - 1), each point's reduced latitude having been found only once.
+// Each pair's iteration starts from the previous pair's solution, scaling
+// the longitude difference by the previous ratio of lambda to it, which for
+// the short hops of a path changes little from pair to pair. Nearly antipodal
+// pairs for which Vincenty's formula doesn't converge get the haversine distance.
+//
+inline void vincenty_pairs(const geodesic_point* p, const size_t n, double* out) {
+    double ratio = 1.0;
+
+    for (size_t i = 0; i + 1 < n; ++i) {
+        const auto& a = p[i];
+        const auto& b = p[i + 1];
+        const double l = delta_lon(a.lon, b.lon);
+
+        double lambda = l * ratio;
+        double d = vincenty(a.sin_u, a.cos_u, b.sin_u, b.cos_u, l, lambda);
+
+        if (std::isnan(d)) {
+            d = distance({ a.lat, a.lon }, { b.lat, b.lon });
+            ratio = 1.0;
+        } else if (l != 0.0) {
+            ratio = lambda / l;
+        }
+
+        out[i] = d;
+    }
+}
+
+// The path functions hand vincenty_pairs() this many pairs at a time, so the
+// warm starts, and so the results, don't depend on how a path is split up.
+static constexpr size_t geodesic_block = 256;
+
+// The number of points above which ellipsoidal_distances() uses several threads
+static constexpr size_t geodesic_parallel_min = 1 << 16;
+
+} // namespace internal
+
+namespace distance_model {
+
+//
+// The haversine distance on a sphere of radius geoid_radius_m, as distance().
+// The path functions find it a chunk at a time with distance_batch().
+//
+struct haversine {
+    static double distance(const location& l1, const location& l2) {
+        return gps_path_tools::distance(l1, l2);
+    }
+};
+
+//
+// The great circle distance on the same sphere found from the angle between
+// the n-vectors, the unit normals to the sphere, of the locations, as distance_vec().
+//
+struct nvector {
+    static double distance(const location& l1, const location& l2) {
+        return distance_vec(l1, l2);
+    }
+};
+
+//
+// The equirectangular approximation on the same sphere, Pythagoras with the
+// longitude difference scaled by the cosine of the mean latitude. Needs one
+// cos and a sqrt, and is within 1E-8 of the haversine distance for hops of
+// up to a kilometre, 1E-6 for 10km and 1E-4 for 100km.
+//
+struct equirectangular {
+    static double distance(const location& l1, const location& l2) {
+        const double x = internal::delta_lon(l1.lon, l2.lon) * cos(to_radians((l1.lat + l2.lat) / 2.0));
+        const double y = to_radians(l2.lat - l1.lat);
+
+        return geoid_radius_m * sqrt(x * x + y * y);
+    }
+};
+
+//
+// Local flat earth, the distance in the east-north plane tangent to the WGS84
+// ellipsoid midway between the locations, using the ellipsoid's meridional
+// and prime vertical radii of curvature there. About as cheap as
+// equirectangular but, as it allows for the flattening, within 1E-6 of the
+// ellipsoidal distance, under 1cm, for hops of up to 10km and 1E-4 for 100km.
+//
+struct flat_earth {
+    static double distance(const location& l1, const location& l2) {
+        const double lat = to_radians((l1.lat + l2.lat) / 2.0);
+        const double sin_lat = sin(lat);
+        const double w2 = 1.0 - wgs84_e2 * sin_lat * sin_lat;
+        const double prime_vertical = wgs84_a / sqrt(w2);
+        const double meridional = prime_vertical * (1.0 - wgs84_e2) / w2;
+
+        const double north = meridional * to_radians(l2.lat - l1.lat);
+        const double east = prime_vertical * cos(lat) * internal::delta_lon(l1.lon, l2.lon);
+
+        return sqrt(north * north + east * east);
+    }
+};
+
+//
+// The geodesic distance on the WGS84 ellipsoid by Vincenty's inverse formula,
+// accurate to well under a millimetre, but iterative and several times the
+// cost of haversine. Vincenty's formula can fail to converge for nearly
+// antipodal points, then the haversine distance is returned. The path
+// functions find it in blocks, see ellipsoidal_distances().
+//
+struct ellipsoidal {
+    static double distance(const location& l1, const location& l2) {
+        const internal::geodesic_point p[] = { internal::to_geodesic_point(l1), internal::to_geodesic_point(l2) };
+
+        double d;
+        internal::vincenty_pairs(p, 2, &d);
+
+        return d;
+    }
+};
+
+} // namespace distance_model
+
+//
+//-------------- Prepared Locations -------------- 
+//
+// The distance, heading & speed functions for prepared locations take the
+// sines & cosines they need from the prepared locations. They agree with
+// those for locations to within 1E-8 metres and, for points at least 1m
+// apart, 1E-5 degrees, distance_vec() exactly.
+//
+
+inline prepared_location::prepared_location(const location& l) {
+    loc = l;
+    lat = to_radians(l.lat);
+    lon = to_radians(l.lon);
+    sin_lat = sin(lat);
+    cos_lat = cos(lat);
+    sin_lon = sin(lon);
+    cos_lon = cos(lon);
+
+    x = cos_lat * cos_lon;
+    y = cos_lat * sin_lon;
+    z = sin_lat;
+}
+
+inline prepared_location prepare_location(const location& loc) {
+    return prepared_location(loc);
+}
+
+//
+// The haversine distance in metres, as distance(). The haversine of the angle
+// between two n-vectors is a quarter of the square of the chord between them,
+// so the only trigonometry left is the asin of ahav().
+//
+inline double distance(const prepared_location& l1, const prepared_location& l2) {
+    const double dx = l1.x - l2.x;
+    const double dy = l1.y - l2.y;
+    const double dz = l1.z - l2.z;
+
+    return geoid_radius_m * ahav((dx * dx + dy * dy + dz * dz) / 4.0);
+}
+
+//
+// The great circle distance in metres from the n-vectors, as distance_vec().
+//
+inline double distance_vec(const prepared_location& l1, const prepared_location& l2) {
+    double cx = l1.y * l2.z - l1.z * l2.y;
+    double cy = l1.z * l2.x - l1.x * l2.z;
+    double cz = l1.x * l2.y - l1.y * l2.x;
+    double dot = (l1.x * l2.x + l1.y * l2.y + l1.z * l2.z);
+
+    return geoid_radius_m * atan2(sqrt(cx * cx + cy * cy + cz * cz), dot);
+}
+
+inline double speed(const prepared_location& l1, const prepared_location& l2, const double seconds) {
+    return distance(l1, l2) / seconds;
+}
+
+//
+// The heading from l1 to l2 in degrees, as heading(), the sine & cosine of the
+// longitude difference come from the angle difference identities.
+//
+inline double heading(const prepared_location& l1, const prepared_location& l2) {
+    const double sin_dlon = l2.sin_lon * l1.cos_lon - l2.cos_lon * l1.sin_lon;
+    const double cos_dlon = l2.cos_lon * l1.cos_lon + l2.sin_lon * l1.sin_lon;
+
+    double X = l2.cos_lat * sin_dlon;
+    double Y = l1.cos_lat * l2.sin_lat - l1.sin_lat * l2.cos_lat * cos_dlon;
+
+    double h = to_degrees(atan2(X, Y));
+
+    if (h < 0)
+        h = 360.0 + h;
+
+    return h;
+}
+
+//
+//-------------- Path Functions --------------
+//
+// The path functions take a range of random access iterators, or a range
+// such as a container, of points. The location and time of a point are read
+// through path_point_traits, so the functions work on path_points, waypoints,
+// compact_paths and any other point type for which path_point_traits is
+// specialised, without copying them into a path first. The functions that
+// measure distances take a distance model as their first template argument,
+// see Distance Models above, haversine by default.
+//
+
+//
+// Customisation point for reading the location and timestamp of a point,
+// by default from its loc and timestamp members. Specialise it in the
+// gps_path_tools namespace for point types that store them differently:
+//
+//      template <>
+//      struct path_point_traits<my_point> {
+//          static location loc(const my_point& p) { return { p.latitude, p.longitude, p.altitude }; }
+//          static path_time timestamp(const my_point& p) { return path_time(std::chrono::microseconds(p.time_us)); }
+//      };
+//
+template <typename T>
+struct path_point_traits {
+    static location loc(const T& p) {
+        return p.loc;
+    }
+
+    static path_time timestamp(const T& p) {
+        return p.timestamp;
+    }
+};
+
+namespace internal {
+
+// The location and time of the point at i, these return values rather than
+// references as proxy iterators such as compact_path's return points by value.
+template <typename It>
+location point_loc(const It& i) {
+    return path_point_traits<typename std::iterator_traits<It>::value_type>::loc(*i);
+}
+
+template <typename It>
+path_time point_time(const It& i) {
+    return path_point_traits<typename std::iterator_traits<It>::value_type>::timestamp(*i);
+}
+
+// True if the points of It carry prepared trigonometry, e.g. those of a prepared_path.
+template <typename It>
+static constexpr bool is_prepared = std::is_base_of_v<prepared_location, typename std::iterator_traits<It>::value_type>;
+
+// The distance between the points at i & j by the distance model,
+// from their prepared trigonometry where they have it.
+template <typename Distance, typename It>
+double point_distance(const It& i, const It& j) {
+    if constexpr (is_prepared<It> && std::is_same_v<Distance, distance_model::haversine>) {
+        return distance(*i, *j);
+    } else {
+        return Distance::distance(point_loc(i), point_loc(j));
+    }
+}
+
+// The heading from the point at i to the point at j.
+template <typename It>
+double point_heading(const It& i, const It& j) {
+    if constexpr (is_prepared<It>) {
+        return heading(*i, *j);
+    } else {
+        return heading(point_loc(i), point_loc(j));
+    }
+}
+
+//
+// Neumaier's compensated summation, the rounding error of each addition is
+// accumulated separately and added back at the end, so long sums don't drift.
+//
+struct compensated_sum {
+    double sum = 0.0;
+    double compensation = 0.0;
+
+    void add(const double x) {
+        const double t = sum + x;
+
+        if (std::abs(sum) >= std::abs(x)) {
+            compensation += (sum - t) + x;
+        } else {
+            compensation += (x - t) + sum;
+        }
+
+        sum = t;
+    }
+
+    double value() const {
+        return sum + compensation;
+    }
+};
+
+// The number of points, or point pairs, in each block of the path reductions
+static constexpr size_t reduction_block = 4096;
+
+//
+// Sums values x(i) for i = 0, 1, 2... in blocks of reduction_block, each with
+// a compensated sum, then adds up the block sums in order. The parallel
+// reductions give each thread whole blocks, so they get the same result as
+// the serial functions whatever the number of threads.
+//
+struct block_sum {
+    compensated_sum total;
+    compensated_sum block;
+
+    void add(const size_t i, const double x) {
+        if (i % reduction_block == 0 && i != 0) {
+            total.add(block.value());
+            block = {};
+        }
+
+        block.add(x);
+    }
+
+    double value() const {
+        auto t = total;
+        t.add(block.value());
+        return t.value();
+    }
+};
+
+// The iterator type of a range, used to only enable the range overloads for ranges.
+template <typename Range>
+using range_iterator = decltype(std::begin(std::declval<const Range&>()));
+
+// The common type of a start and an end iterator of different types, e.g. a
+// path's cbegin() & end(), used to only enable the mixed iterator overloads for them.
+template <typename Start, typename End, typename = void>
+struct common_iterator {};
+
+template <typename Start, typename End>
+struct common_iterator<Start, End, std::enable_if_t<!std::is_same_v<Start, End>, std::void_t<
+        typename std::iterator_traits<Start>::iterator_category,
+        typename std::iterator_traits<End>::iterator_category,
+        std::common_type_t<Start, End>>>> {
+    using type = std::common_type_t<Start, End>;
+};
+
+template <typename Start, typename End>
+using common_iterator_t = typename common_iterator<Start, End>::type;
+
+//
+// Calls fn(i, d) in order for the distance d between point i and point i + 1
+// measured by the distance model, haversine distances are found a chunk at
+// a time by distance_batch() and the others a pair at a time.
+//
+template <typename Distance, typename It, typename Fn>
+void for_each_pair_distance(const It start, const It end, Fn fn) {
+    const auto n = static_cast<size_t>(std::distance(start, end));
+
+    if (n < 2) {
+        return;
+    }
+
+    if constexpr (is_prepared<It> && std::is_same_v<Distance, distance_model::haversine>) {
+        size_t i = 0;
+
+        for (auto it = start; i + 1 != n; ++it, ++i) {
+            fn(i, distance(*it, *std::next(it)));
+        }
+
+        return;
+    } else if constexpr (std::is_same_v<Distance, distance_model::ellipsoidal>) {
+        geodesic_point p[geodesic_block + 1];
+        double d[geodesic_block];
+
+        auto it = start;
+        p[0] = to_geodesic_point(point_loc(it));
+
+        for (size_t base = 0; base + 1 < n; ) {
+            const auto m = std::min(geodesic_block, n - 1 - base);
+
+            for (size_t k = 1; k <= m; ++k) {
+                p[k] = to_geodesic_point(point_loc(++it));
+            }
+
+            vincenty_pairs(p, m + 1, d);
+
+            for (size_t k = 0; k != m; ++k) {
+                fn(base + k, d[k]);
+            }
+
+            p[0] = p[m];
+            base += m;
+        }
+
+        return;
+    } else if constexpr (!std::is_same_v<Distance, distance_model::haversine>) {
+        location loc = point_loc(start);
+        size_t i = 0;
+
+        for (auto it = std::next(start); it != end; ++it, ++i) {
+            const location next = point_loc(it);
+            fn(i, Distance::distance(loc, next));
+            loc = next;
+        }
+
+        return;
+    }
+
+    const auto& kernel = get_distance_kernel();
+
+    double lat[distance_chunk + 1];
+    double lon[distance_chunk + 1];
+    double d[distance_chunk];
+
+    auto it = start;
+    const location first = point_loc(it);
+    lat[0] = first.lat;
+    lon[0] = first.lon;
+
+    for (size_t base = 0; base + 1 < n; ) {
+        const auto m = std::min(distance_chunk, n - 1 - base);
+
+        for (size_t k = 1; k <= m; ++k) {
+            const location loc = point_loc(++it);
+            lat[k] = loc.lat;
+            lon[k] = loc.lon;
+        }
+
+        kernel.distance(lat, lon, lat + 1, lon + 1, d, m);
+
+        for (size_t k = 0; k != m; ++k) {
+            fn(base + k, d[k]);
+        }
+
+        lat[0] = lat[m];
+        lon[0] = lon[m];
+        base += m;
+    }
+}
+
+//
+// Sums the distances between the point pairs in blocks of reduction_block
+// pairs shared between up to "threads" threads (0 means one per core), the
+// block sums are added in order, so the result is the same as block_sum's
+// for any number of threads.
+//
+template <typename Distance, typename It>
+double pair_distance_sum(const It start, const It end, const unsigned threads) {
+    const auto n = static_cast<size_t>(std::distance(start, end));
+
+    if (n < 2) {
+        return 0.0;
+    }
+
+    // Blocks of pairs
+    const auto pairs = n - 1;
+    const auto blocks = (pairs + reduction_block - 1) / reduction_block;
+    std::vector<double> partial(blocks);
+
+    run_tasks(blocks, threads, [&](const size_t b) {
+        const auto first = b * reduction_block;
+        const auto last = std::min(first + reduction_block, pairs);
+
+        compensated_sum dist;
+
+        for_each_pair_distance<Distance>(start + first, start + (last + 1), [&](size_t, const double d) {
+            dist.add(std::isnan(d) ? 0.0 : d);
+        });
+
+        partial[b] = dist.value();
+    });
+
+    compensated_sum dist;
+
+    for (const auto d : partial) {
+        dist.add(d);
+    }
+
+    return dist.value();
+}
+
+//
+// Calls fn(i, d) in order for the distance d between point i and target
+// measured by the distance model, as for_each_pair_distance().
+//
+template <typename Distance, typename It, typename Fn>
+void for_each_target_distance(const It start, const It end, const prepared_location& target, Fn fn);
+
+template <typename Distance, typename It, typename Fn>
+void for_each_target_distance(const It start, const It end, const location& target, Fn fn) {
+    const auto n = static_cast<size_t>(std::distance(start, end));
+
+    if constexpr (!std::is_same_v<Distance, distance_model::haversine>) {
+        size_t i = 0;
+
+        for (auto it = start; it != end; ++it, ++i) {
+            fn(i, Distance::distance(point_loc(it), target));
+        }
+
+        return;
+    }
+
+    const auto& kernel = get_distance_kernel();
+
+    double lat[distance_chunk];
+    double lon[distance_chunk];
+    double target_lat[distance_chunk];
+    double target_lon[distance_chunk];
+    double d[distance_chunk];
+
+    std::fill(target_lat, target_lat + distance_chunk, target.lat);
+    std::fill(target_lon, target_lon + distance_chunk, target.lon);
+
+    auto it = start;
+
+    for (size_t base = 0; base < n; ) {
+        const auto m = std::min(distance_chunk, n - base);
+
+        for (size_t k = 0; k != m; ++k, ++it) {
+            const location loc = point_loc(it);
+            lat[k] = loc.lat;
+            lon[k] = loc.lon;
+        }
+
+        kernel.distance(lat, lon, target_lat, target_lon, d, m);
+
+        for (size_t k = 0; k != m; ++k) {
+            fn(base + k, d[k]);
+        }
+
+        base += m;
+    }
+}
+
+// For a prepared target, with prepared points the distances come from the n-vectors.
+template <typename Distance, typename It, typename Fn>
+void for_each_target_distance(const It start, const It end, const prepared_location& target, Fn fn) {
+    if constexpr (is_prepared<It> && std::is_same_v<Distance, distance_model::haversine>) {
+        size_t i = 0;
+
+        for (auto it = start; it != end; ++it, ++i) {
+            fn(i, distance(*it, target));
+        }
+    } else {
+        for_each_target_distance<Distance>(start, end, target.loc, fn);
+    }
+}
+
+// The location fraction f of the way from a to b, across
+// the antimeridian the short way round.
+inline location interpolate_location(const location& a, const location& b, const double f) {
+    double dlon = b.lon - a.lon;
+
+    if (dlon > 180.0) {
+        dlon -= 360.0;
+    } else if (dlon < -180.0) {
+        dlon += 360.0;
+    }
+
+    double lon = a.lon + f * dlon;
+
+    if (lon > 180.0) {
+        lon -= 360.0;
+    } else if (lon < -180.0) {
+        lon += 360.0;
+    }
+
+    return { a.lat + f * (b.lat - a.lat), lon, a.ele + f * (b.ele - a.ele) };
+}
+
+inline path_time interpolate_time(const path_time a, const path_time b, const double f) {
+    return a + std::chrono::duration_cast<path_time::duration>((b - a) * f);
+}
+
+//
+// Projects the n-vector p onto the straight line from the n-vector a to b,
+// t is set to the fraction of the way along it, clamped to the line's ends,
+// and returns the square of the distance from p to the projection.
+//
+inline double project_onto_chord(const double* a, const double* b, const double* p, double& t) {
+    const double ab[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+    const double ap[3] = { p[0] - a[0], p[1] - a[1], p[2] - a[2] };
+    const double length2 = ab[0] * ab[0] + ab[1] * ab[1] + ab[2] * ab[2];
+
+    t = length2 > 0 ? (ap[0] * ab[0] + ap[1] * ab[1] + ap[2] * ab[2]) / length2 : 0.0;
+    t = std::min(std::max(t, 0.0), 1.0);
+
+    const double d[3] = { ap[0] - t * ab[0], ap[1] - t * ab[1], ap[2] - t * ab[2] };
+
+    return d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+}
+
+//
+// The projection of target onto the segment from the point at a to the point
+// at b, t of the way along it, which is length metres long and starts along
+// metres along the path. The location is found from the n-vectors, back on the sphere.
+//
+template <typename It>
+path_projection make_projection(const It a, const It b, const double t, const double along, const double length, const size_t segment, const location& target) {
+    const location a_loc = point_loc(a);
+    const location b_loc = point_loc(b);
+
+    path_projection out;
+    out.segment = segment;
+    out.distance_m = along + t * length;
+    out.timestamp = interpolate_time(point_time(a), point_time(b), t);
+
+    if (t == 0.0) {
+        out.loc = a_loc;
+    } else if (t == 1.0) {
+        out.loc = b_loc;
+    } else {
+        const auto pa = prepare_location(a_loc);
+        const auto pb = prepare_location(b_loc);
+        const double x = pa.x + t * (pb.x - pa.x);
+        const double y = pa.y + t * (pb.y - pa.y);
+        const double z = pa.z + t * (pb.z - pa.z);
+
+        out.loc = { to_degrees(atan2(z, sqrt(x * x + y * y))), to_degrees(atan2(y, x)), a_loc.ele + t * (b_loc.ele - a_loc.ele) };
+    }
+
+    out.offset_m = distance(out.loc, target);
+
+    return out;
+}
+
+// The closest point to target, see find_closest_path_point_dist().
+template <typename Distance, typename It, typename Target>
+It closest_point_dist(const It start, const It end, const Target& target) {
+
+    // Check for empty/bad range
+    if (start == end)
+        return end;
+
+    size_t closest = 0;
+    auto smallest_delta = std::numeric_limits<double>::infinity();
+
+    for_each_target_distance<Distance>(start, end, target, [&](const size_t i, const double delta) {
+        if (delta < smallest_delta) {
+            smallest_delta = delta;
+            closest = i;
+        }
+    });
+
+    return start + closest;
+}
+
+// The farthest point from "from", see find_farthest_point().
+template <typename Distance, typename It, typename Target>
+It farthest_point(const It start, const It end, const Target& from) {
+
+    // Empty sequence
+    if (start == end || start > end) {
+        return end;
+    }
+
+    size_t farthest = 0;
+    double max_dist = 0;
+
+    for_each_target_distance<Distance>(start, end, from, [&](const size_t i, const double dist) {
+        if (dist > max_dist) {
+            max_dist = dist;
+            farthest = i;
+        }
+    });
+
+    return start + farthest;
+}
+
+} // namespace internal
+
+//
+// Calculate axis-aligned bounding box if path given
+// start and end iterators.
+//
+// return: { NW box corner, NE, SE, SW }
+//
+template <typename It>
+std::tuple<location, location, location, location> axis_aligned_bounding_box(const It start, const It end) {
+  
+    // Empty sequence?
+    if (start == end) {
+        return {};
+    }
+
+    const location first = internal::point_loc(start);
+
+    double min_lat = first.lat;
+    double max_lat = first.lat;
+    double min_lon = first.lon;
+    double max_lon = first.lon;
+
+    for (auto i = start; i != end; ++i) {
+        const location loc = internal::point_loc(i);
+
+        min_lat = std::min(min_lat, loc.lat);
+        max_lat = std::max(max_lat, loc.lat);
+
+        min_lon = std::min(min_lon, loc.lon);
+        max_lon = std::max(max_lon, loc.lon);
+    }
+
+    location nw { max_lat, min_lon };
+    location ne { max_lat, max_lon };
+    location se { min_lat, max_lon };
+    location sw { min_lat, min_lon };
+
+    return { nw, ne, se, sw };
+}
+
+//
+// Calculates the ellipsoidal distance, as distance_model::ellipsoidal, between
+// each point and the next into out, n - 1 values for n points. Each point's
+// reduced latitude is found once, each pair's iteration is warm started from
+// the previous pair's solution, and paths of more than 65536 points are split
+// into blocks shared between up to "threads" threads (0 means one per core).
+// The results are the same for any number of threads, path_distance() sums
+// them on several threads for paths this long.
+//
+template <typename It>
+void ellipsoidal_distances(const It start, const It end, double* out, unsigned threads = 0) {
+    const auto n = static_cast<size_t>(std::distance(start, end));
+
+    if (n < 2) {
+        return;
+    }
+
+    if (n <= internal::geodesic_parallel_min) {
+        threads = 1;
+    }
+
+    const auto blocks = (n - 1 + internal::geodesic_block - 1) / internal::geodesic_block;
+
+    internal::run_tasks(blocks, threads, [&](const size_t i) {
+        const auto base = i * internal::geodesic_block;
+        const auto m = std::min(internal::geodesic_block, n - 1 - base);
+
+        internal::geodesic_point p[internal::geodesic_block + 1];
+
+        for (size_t k = 0; k <= m; ++k) {
+            p[k] = internal::to_geodesic_point(internal::point_loc(start + (base + k)));
+        }
+
+        internal::vincenty_pairs(p, m + 1, out + base);
+    });
+}
+
+template <typename It>
+std::vector<double> ellipsoidal_distances(const It start, const It end, const unsigned threads = 0) {
+    const auto count = std::distance(start, end);
+
+    if (count < 2) {
+        return {};
+    }
+
+    std::vector<double> out(static_cast<size_t>(count) - 1);
+    ellipsoidal_distances(start, end, out.data(), threads);
+
+    return out;
+}
+
+template <typename Distance = distance_model::haversine, typename It>
+double path_distance(const It start, const It end) {
+    
+    // If the sequence is empty, return 0
+    if (start == end)
+        return 0.0;
+
+    // If the sequence only has one location,
+    // return 0
+    if (std::distance(start, end) == 1) {
+        return 0.0;
+    }
+
+    // Long paths are measured on several threads
+    // for the ellipsoid, with the same result.
+    if constexpr (std::is_same_v<Distance, distance_model::ellipsoidal>) {
+        if (static_cast<size_t>(std::distance(start, end)) > internal::geodesic_parallel_min) {
+            return internal::pair_distance_sum<Distance>(start, end, 0);
+        }
+    }
+
+    // Accumulate the distances between the point
+    // pairs, found a chunk at a time by distance_batch(),
+    // in compensated blocks as path_distance_parallel().
+    internal::block_sum dist;
+
+    internal::for_each_pair_distance<Distance>(start, end, [&](const size_t i, const double d) {
+        dist.add(i, std::isnan(d) ? 0.0 : d);
+    });
+
+    return dist.value();
+}    
+
+//
+// Calculates the nominal heading between each path location and the next location in the given path.
+//
+// Writes one path_value for each point but the last to out, e.g. a pointer into
+// a buffer, and returns the end of the output, so doesn't allocate.
+//
+template <typename It, typename Out>
+Out path_heading(const It start, const It end, Out out) {
+
+    if (std::distance(start, end) < 2) {
+        return out;
+    }
 
-    std::vector<path_value> out;
-    out.reserve(static_cast<size_t>(count));
-    
     // Loop through from start to the second last
-    // point accumulating the speed between
+    // point accumulating the heading between
     // the point pairs.
     const auto last = end - 1;
-    for (auto i = start; i != last; ++i) {
-        const auto h = speed(i->loc, (i + 1)->loc, (double)std::chrono::duration_cast<std::chrono::microseconds>(std::next(i)->timestamp - i->timestamp).count() / 1E6); 
 
-        out.push_back({ h, i->timestamp });
+    if constexpr (internal::is_prepared<It>) {
+        for (auto i = start; i != last; ++i) {
+            const auto h = internal::point_heading(i, i + 1);
+
+            *out++ = path_value{ h, internal::point_time(i) };
+        }
+    } else {
+        // Each point's sine and cosine are found once
+        // for the headings to and from it.
+        const location first = internal::point_loc(start);
+        auto p = internal::to_haversine_point(first.lat, first.lon);
+
+        for (auto i = start; i != last; ++i) {
+            const location next_loc = internal::point_loc(i + 1);
+            const auto next = internal::to_haversine_point(next_loc.lat, next_loc.lon);
+
+            *out++ = path_value{ internal::heading_scalar(p, next), internal::point_time(i) };
+            p = next;
+        }
+    }
+
+    return out;
+}
+
+template <typename It>
+std::vector<path_value> path_heading(const It start, const It end) {
+
+    const auto count =  std::distance(start, end);
+
+    if (count < 2) {
+        return {};
+    }
+
+    std::vector<path_value> out;
+    out.reserve(static_cast<size_t>(count));
+    path_heading(start, end, std::back_inserter(out));
+
+    return out;
+}
+
+//
+// Calculates the mean speed between the pairs of locations in the given path.
+//
+// Writes one path_value for each point but the last to out and returns the end of the output.
+//
+template <typename Distance = distance_model::haversine, typename It, typename Out>
+Out path_speed(const It start, const It end, Out out) {
+
+    if (std::distance(start, end) < 2) {
+        return out;
+    }
+
+    // The speed between each point pair, the
+    // distances are found by distance_batch().
+    internal::for_each_pair_distance<Distance>(start, end, [&](const size_t i, const double d) {
+        const auto time = internal::point_time(start + i);
+        const auto h = d / ((double)std::chrono::duration_cast<std::chrono::microseconds>(internal::point_time(start + i + 1) - time).count() / 1E6);
+
+        *out++ = path_value{ h, time };
+    });
+
+    return out;
+}
+
+template <typename Distance = distance_model::haversine, typename It>
+std::vector<path_value> path_speed(const It start, const It end) {
+
+    const auto count = std::distance(start, end);
+
+    if (count < 2) {
+        return {};
+    }
+
+    std::vector<path_value> out;
+    out.reserve(static_cast<size_t>(count));
+    path_speed<Distance>(start, end, std::back_inserter(out));
+
+    return out;
+}
+
+//
+// Sums up the location to location distances on the given path.
+//
+// Writes one path_value for each point but the first to out and returns the end of the output.
+//
+template <typename Distance = distance_model::haversine, typename It, typename Out>
+Out path_cumulative_distance(const It start, const It end, Out out) {
+
+    if (std::distance(start, end) < 2) {
+        return out;
+    }
+
+    internal::compensated_sum dist;
+
+    // Accumulate the distances between the point
+    // pairs, found by distance_batch().
+    internal::for_each_pair_distance<Distance>(start, end, [&](const size_t i, const double d) {
+        dist.add(d);
+
+        *out++ = path_value{ dist.value(), internal::point_time(start + i + 1) };
+    });
+
+    return out;
+}
+
+template <typename Distance = distance_model::haversine, typename It>
+std::vector<path_value> path_cumulative_distance(const It start, const It end) {
+
+    const auto count = std::distance(start, end);
+
+    if (count < 2) {
+        return {};
+    }
+
+    std::vector<path_value> out;
+    out.reserve(static_cast<size_t>(count));
+    path_cumulative_distance<Distance>(start, end, std::back_inserter(out));
+
+    return out;
+}    
+
+//
+// Finds the closest path point to the provided target location based on time.
+// For many searches of the same path see path_time_index, which uses a
+// binary search.
+//
+template <typename It>
+It find_closest_path_point_time(const It start, const It end, path_time target_timestamp) {
+
+    // Check for empty/bad range
+    if (start == end) {
+        return end;
+    }
+
+    // We assume that the points in the path are in ascending
+    // chronological order!
+    auto closest = start;
+    auto smallest_time_delta = std::abs((internal::point_time(start) - target_timestamp).count());
+
+    for (auto i = start; i != end; ++i) {
+        const auto delta = std::abs((internal::point_time(i) - target_timestamp).count());
+        
+        if (delta < smallest_time_delta) {
+            smallest_time_delta = delta;
+            closest = i;
+        }
+    }
+    
+    return closest;
+}
+
+//
+// Finds the closest path point to the provided target location based on distance.
+//
+template <typename Distance = distance_model::haversine, typename It>
+It find_closest_path_point_dist(const It start, const It end, const location& target) {
+    return internal::closest_point_dist<Distance>(start, end, target);
+}
+
+//
+// As above for a target prepared with prepare_location(), e.g. for
+// several searches, with a prepared_path the search needs no trigonometry
+// but an asin per point.
+//
+template <typename Distance = distance_model::haversine, typename It>
+It find_closest_path_point_dist(const It start, const It end, const prepared_location& target) {
+    return internal::closest_point_dist<Distance>(start, end, target);
+}
+
+//
+// Finds the first region within a path where progress halted, i.e. where the traveler 'stopped'.
+// Returns a tuple of iterators representing the start and end points of the "stationary" region.
+//
+// TODO: if a stationary region occurs at the end of a path it won';'t be returned.
+//
+template <typename Distance = distance_model::haversine, typename It>
+std::tuple<It, It> find_stationary_points(const It start_it, const It end_it, const int radius_m, const int time_s) {
+    // Find the points where successive distance traveled values
+    // does not go further than radius_m
+    
+    auto start = start_it;
+    bool time_ok = false;
+    const auto end = std::prev(end_it);
+
+    for (auto i = start_it; i != end; ++i) {
+        const auto next = std::next(i);
+    
+        // The distance between the last candidate start location
+        // and this location.
+        const auto delta = internal::point_distance<Distance>(start, next);
+        
+        // Is this distance within our "stationary" circle?
+        if (delta < radius_m) {
+            // yes, and is the time difference large enough such that
+            // we can expect a reasonable distance traveled and so count 
+            // this as a stationary region?            
+            if (internal::point_time(i) - internal::point_time(start) >  std::chrono::seconds(time_s)) {
+                time_ok = true;
+            }
+        } else {
+
+            // We are now outside the circle, if the last time delta
+            // was greater than our filter then we are on the move
+            // again so return the start and end iterators of the
+            // "stationary" region.
+            if (time_ok) {
+                return { start, i };
+            }
+            
+            start = i;
+        }
+    }
+    
+    // none found
+    return { end_it, end_it };
+}
+
+//
+// Finds the path location that is farthest (as the crow files) from the location
+// specified by the "from" argument.  If there are multiple locations with the same maximum
+// distance then it returns the first.
+//
+template <typename Distance = distance_model::haversine, typename It>
+It find_farthest_point(const It start, const It end, const location& from) {
+    return internal::farthest_point<Distance>(start, end, from);
+}
+
+//
+// As above for a "from" location prepared with prepare_location().
+//
+template <typename Distance = distance_model::haversine, typename It>
+It find_farthest_point(const It start, const It end, const prepared_location& from) {
+    return internal::farthest_point<Distance>(start, end, from);
+}
+
+//
+//-------------- Elevation Path Functions -------------- 
+//
+
+//
+// Calculate some elevation stats for the path, returns:
+//
+// { iterator to location with min elevation, iterator to max elevation,
+//    cumulative ascent over path, cumulative descent over path (-ve) }
+//
+template <typename It>
+std::tuple<It, It, double, double> path_elevation_summary(const It start, const It end) {
+    const auto count =  std::distance(start, end);
+
+    if (count < 2) {
+        return {};
+    }
+
+    // Current min/max
+    double min_elevation = internal::point_loc(start).ele;
+    double max_elevation = internal::point_loc(start).ele;
+
+    // Iterators to the min/max elevations
+    auto min_it = start;
+    auto max_it = start;
+    
+    // Summed in compensated blocks as path_elevation_summary_parallel()
+    internal::block_sum cumulative_ascent;
+    internal::block_sum cumulative_descent;
+    double last_ele = internal::point_loc(start).ele;
+    size_t index = 0;
+
+    for (auto i = start; i != end; ++i, ++index) {
+        const double ele = internal::point_loc(i).ele;
+
+        // Is this a min/max?
+        if (ele > max_elevation) {
+            max_it = i;
+            max_elevation = ele;
+        } else if (ele < min_elevation) {
+            min_it = i;
+            min_elevation = ele;
+        }
+
+        // Accrue ascent or descent
+        auto delta_ele = ele - last_ele;
+        last_ele = ele;
+
+        cumulative_ascent.add(index, delta_ele >= 0 ? delta_ele : 0.0);
+        cumulative_descent.add(index, delta_ele >= 0 ? 0.0 : delta_ele);
+    }
+
+    return { min_it, max_it, cumulative_ascent.value(), cumulative_descent.value() };
+}
+
+//
+//-------------- Parallel Path Functions -------------- 
+//
+// Versions of the path reductions that share the path between up to
+// "threads" threads (0 means one per core). The path is split into fixed
+// blocks of points whatever the number of threads, each block is reduced
+// on its own and the block results are merged in order, so the results are
+// the same for any number of threads and the same as the serial functions.
+//
+
+template <typename Distance = distance_model::haversine, typename It>
+double path_distance_parallel(const It start, const It end, const unsigned threads = 0) {
+    return internal::pair_distance_sum<Distance>(start, end, threads);
+}
+
+template <typename It>
+std::tuple<location, location, location, location> axis_aligned_bounding_box_parallel(const It start, const It end, const unsigned threads = 0) {
+    const auto n = static_cast<size_t>(std::distance(start, end));
+
+    if (n == 0) {
+        return {};
+    }
+
+    const auto blocks = (n + internal::reduction_block - 1) / internal::reduction_block;
+    std::vector<std::tuple<location, location, location, location>> partial(blocks);
+
+    internal::run_tasks(blocks, threads, [&](const size_t b) {
+        const auto first = b * internal::reduction_block;
+        const auto last = std::min(first + internal::reduction_block, n);
+
+        partial[b] = axis_aligned_bounding_box(start + first, start + last);
+    });
+
+    // Merge the NW & SE corners
+    location nw = std::get<0>(partial[0]);
+    location se = std::get<2>(partial[0]);
+
+    for (const auto& box : partial) {
+        nw.lat = std::max(nw.lat, std::get<0>(box).lat);
+        nw.lon = std::min(nw.lon, std::get<0>(box).lon);
+        se.lat = std::min(se.lat, std::get<2>(box).lat);
+        se.lon = std::max(se.lon, std::get<2>(box).lon);
+    }
+
+    return { nw, { nw.lat, se.lon }, se, { se.lat, nw.lon } };
+}
+
+template <typename It>
+std::tuple<It, It, double, double> path_elevation_summary_parallel(const It start, const It end, const unsigned threads = 0) {
+    const auto n = static_cast<size_t>(std::distance(start, end));
+
+    if (n < 2) {
+        return {};
+    }
+
+    struct block_result {
+        size_t min_index;
+        size_t max_index;
+        double min_elevation;
+        double max_elevation;
+        double ascent;
+        double descent;
+    };
+
+    const auto blocks = (n + internal::reduction_block - 1) / internal::reduction_block;
+    std::vector<block_result> partial(blocks);
+
+    internal::run_tasks(blocks, threads, [&](const size_t b) {
+        const auto first = b * internal::reduction_block;
+        const auto last = std::min(first + internal::reduction_block, n);
+
+        block_result r;
+        r.min_index = r.max_index = first;
+        r.min_elevation = r.max_elevation = internal::point_loc(start + first).ele;
+
+        internal::compensated_sum ascent;
+        internal::compensated_sum descent;
+
+        // The first point of the path adds a zero delta, as in path_elevation_summary()
+        double last_ele = internal::point_loc(start + (first ? first - 1 : 0)).ele;
+
+        for (auto i = first; i != last; ++i) {
+            const double ele = internal::point_loc(start + i).ele;
+
+            if (ele > r.max_elevation) {
+                r.max_index = i;
+                r.max_elevation = ele;
+            } else if (ele < r.min_elevation) {
+                r.min_index = i;
+                r.min_elevation = ele;
+            }
+
+            const auto delta_ele = ele - last_ele;
+            last_ele = ele;
+
+            ascent.add(delta_ele >= 0 ? delta_ele : 0.0);
+            descent.add(delta_ele >= 0 ? 0.0 : delta_ele);
+        }
+
+        r.ascent = ascent.value();
+        r.descent = descent.value();
+        partial[b] = r;
+    });
+
+    // Strict comparisons keep the first of equal elevations, as the serial loop does
+    auto merged = partial[0];
+    internal::compensated_sum ascent;
+    internal::compensated_sum descent;
+
+    for (const auto& r : partial) {
+        if (r.max_elevation > merged.max_elevation) {
+            merged.max_index = r.max_index;
+            merged.max_elevation = r.max_elevation;
+        }
+
+        if (r.min_elevation < merged.min_elevation) {
+            merged.min_index = r.min_index;
+            merged.min_elevation = r.min_elevation;
+        }
+
+        ascent.add(r.ascent);
+        descent.add(r.descent);
+    }
+
+    return { start + merged.min_index, start + merged.max_index, ascent.value(), descent.value() };
+}
+
+template <typename Distance = distance_model::haversine, typename It>
+It find_farthest_point_parallel(const It start, const It end, const location& from, const unsigned threads = 0) {
+    const auto n = static_cast<size_t>(std::distance(start, end));
+
+    if (n == 0) {
+        return end;
+    }
+
+    const auto blocks = (n + internal::reduction_block - 1) / internal::reduction_block;
+    std::vector<std::pair<size_t, double>> partial(blocks);
+
+    internal::run_tasks(blocks, threads, [&](const size_t b) {
+        const auto first = b * internal::reduction_block;
+        const auto last = std::min(first + internal::reduction_block, n);
+
+        size_t farthest = first;
+        double max_dist = 0;
+
+        internal::for_each_target_distance<Distance>(start + first, start + last, from, [&](const size_t i, const double dist) {
+            if (dist > max_dist) {
+                max_dist = dist;
+                farthest = first + i;
+            }
+        });
+
+        partial[b] = { farthest, max_dist };
+    });
+
+    size_t farthest = 0;
+    double max_dist = 0;
+
+    for (const auto& [index, dist] : partial) {
+        if (dist > max_dist) {
+            max_dist = dist;
+            farthest = index;
+        }
+    }
+
+    return start + farthest;
+}
+
+
+//
+//-------------- Range Path Functions -------------- 
+//
+// Overloads of the path functions that take a whole range, e.g. a path,
+// compact_path or std::vector of your own point type.
+//
+
+template <typename Range, typename It = internal::range_iterator<Range>>
+std::tuple<location, location, location, location> axis_aligned_bounding_box(const Range& in) {
+    return axis_aligned_bounding_box(std::begin(in), std::end(in));
+}
+
+template <typename Distance = distance_model::haversine, typename Range, typename It = internal::range_iterator<Range>>
+double path_distance(const Range& in) {
+    return path_distance<Distance>(std::begin(in), std::end(in));
+}
+
+template <typename Range, typename It = internal::range_iterator<Range>>
+std::vector<path_value> path_heading(const Range& in) {
+    return path_heading(std::begin(in), std::end(in));
+}
+
+template <typename Distance = distance_model::haversine, typename Range, typename It = internal::range_iterator<Range>>
+std::vector<path_value> path_speed(const Range& in) {
+    return path_speed<Distance>(std::begin(in), std::end(in));
+}
+
+template <typename Distance = distance_model::haversine, typename Range, typename It = internal::range_iterator<Range>>
+std::vector<path_value> path_cumulative_distance(const Range& in) {
+    return path_cumulative_distance<Distance>(std::begin(in), std::end(in));
+}
+
+template <typename Range, typename It = internal::range_iterator<Range>>
+It find_closest_path_point_time(const Range& in, const path_time target_timestamp) {
+    return find_closest_path_point_time(std::begin(in), std::end(in), target_timestamp);
+}
+
+template <typename Distance = distance_model::haversine, typename Range, typename It = internal::range_iterator<Range>>
+It find_closest_path_point_dist(const Range& in, const location& target) {
+    return find_closest_path_point_dist<Distance>(std::begin(in), std::end(in), target);
+}
+
+template <typename Distance = distance_model::haversine, typename Range, typename It = internal::range_iterator<Range>>
+It find_closest_path_point_dist(const Range& in, const prepared_location& target) {
+    return find_closest_path_point_dist<Distance>(std::begin(in), std::end(in), target);
+}
+
+template <typename Distance = distance_model::haversine, typename Range, typename It = internal::range_iterator<Range>>
+std::tuple<It, It> find_stationary_points(const Range& in, const int radius_m, const int time_s) {
+    return find_stationary_points<Distance>(std::begin(in), std::end(in), radius_m, time_s);
+}
+
+template <typename Distance = distance_model::haversine, typename Range, typename It = internal::range_iterator<Range>>
+It find_farthest_point(const Range& in, const location& from) {
+    return find_farthest_point<Distance>(std::begin(in), std::end(in), from);
+}
+
+template <typename Distance = distance_model::haversine, typename Range, typename It = internal::range_iterator<Range>>
+It find_farthest_point(const Range& in, const prepared_location& from) {
+    return find_farthest_point<Distance>(std::begin(in), std::end(in), from);
+}
+
+//
+//-------------- Prepared Path Functions -------------- 
+//
+
+//
+// Makes a prepared_path from a range of points, see prepared_location.
+// The path functions take a prepared_path like any other path and use
+// the prepared trigonometry for haversine distances and headings.
+//
+template <typename It>
+prepared_path prepare_path(const It start, const It end) {
+    prepared_path out;
+    out.reserve(static_cast<size_t>(std::distance(start, end)));
+
+    for (auto i = start; i != end; ++i) {
+        out.push_back({ prepare_location(internal::point_loc(i)), internal::point_time(i) });
+    }
+
+    return out;
+}
+
+template <typename Range, typename It = internal::range_iterator<Range>>
+prepared_path prepare_path(const Range& in) {
+    return prepare_path(std::begin(in), std::end(in));
+}
+
+template <typename Range, typename It = internal::range_iterator<Range>>
+std::tuple<It, It, double, double> path_elevation_summary(const Range& in) {
+    return path_elevation_summary(std::begin(in), std::end(in));
+}
+
+template <typename Distance = distance_model::haversine, typename Range, typename It = internal::range_iterator<Range>>
+double path_distance_parallel(const Range& in, const unsigned threads = 0) {
+    return path_distance_parallel<Distance>(std::begin(in), std::end(in), threads);
+}
+
+template <typename Range, typename It = internal::range_iterator<Range>>
+std::tuple<location, location, location, location> axis_aligned_bounding_box_parallel(const Range& in, const unsigned threads = 0) {
+    return axis_aligned_bounding_box_parallel(std::begin(in), std::end(in), threads);
+}
+
+template <typename Range, typename It = internal::range_iterator<Range>>
+std::tuple<It, It, double, double> path_elevation_summary_parallel(const Range& in, const unsigned threads = 0) {
+    return path_elevation_summary_parallel(std::begin(in), std::end(in), threads);
+}
+
+template <typename Distance = distance_model::haversine, typename Range, typename It = internal::range_iterator<Range>>
+It find_farthest_point_parallel(const Range& in, const location& from, const unsigned threads = 0) {
+    return find_farthest_point_parallel<Distance>(std::begin(in), std::end(in), from, threads);
+}
+
+//
+//-------------- Spatial Index -------------- 
+//
+
+//
+// An index for finding the closest point of a path to many target locations,
+// in logarithmic rather than linear time. It's a KD-tree on the points'
+// n-vectors, the straight line (chord) distance between n-vectors grows with
+// the great circle distance, so the tree finds the points that could be
+// closest and their haversine distances, found as by find_closest_path_point_dist(),
+// pick between them. find_closest() returns the same iterator as
+// find_closest_path_point_dist(), the first point at the smallest distance.
+//
+// The index holds iterators into the path, so the path must outlive it and
+// not be changed while it's used. e.g.
+//
+//      const path_spatial_index index(path.begin(), path.end());
+//      auto closest = index.find_closest(target);
+//
+template <typename It>
+class path_spatial_index {
+public:
+    path_spatial_index() = default;
+
+    path_spatial_index(const It start, const It end) : start(start), end(end) {
+        const auto n = static_cast<size_t>(std::distance(start, end));
+
+        nodes.reserve(n);
+        axes.resize(n);
+
+        size_t index = 0;
+
+        for (auto i = start; i != end; ++i, ++index) {
+            const auto p = prepare_location(internal::point_loc(i));
+            nodes.push_back({ { p.x, p.y, p.z }, p.loc.lat, p.loc.lon, index });
+        }
+
+        build(0, n);
+    }
+
+    size_t size() const {
+        return nodes.size();
+    }
+
+    bool empty() const {
+        return nodes.empty();
+    }
+
+    //
+    // Finds the closest path point to target, as find_closest_path_point_dist(),
+    // or the end of the path if it's empty.
+    //
+    It find_closest(const location& target) const {
+        if (nodes.empty()) {
+            return end;
+        }
+
+        const auto p = prepare_location(target);
+
+        query q;
+        q.v[0] = p.x;
+        q.v[1] = p.y;
+        q.v[2] = p.z;
+        q.lat = target.lat;
+        q.lon = target.lon;
+
+        search(q, 0, nodes.size());
+
+        return start + static_cast<std::ptrdiff_t>(q.closest);
+    }
+
+    //
+    // Finds the closest path point to each of the n targets into out,
+    // sharing the targets between up to "threads" threads (0 means one per core).
+    //
+    void find_closest(const location* targets, const size_t n, It* out, const unsigned threads = 0) const {
+        const auto blocks = (n + query_block - 1) / query_block;
+
+        internal::run_tasks(blocks, threads, [&](const size_t b) {
+            const auto last = std::min((b + 1) * query_block, n);
+
+            for (auto i = b * query_block; i != last; ++i) {
+                out[i] = find_closest(targets[i]);
+            }
+        });
+    }
+
+    std::vector<It> find_closest(const std::vector<location>& targets, const unsigned threads = 0) const {
+        std::vector<It> out(targets.size(), end);
+        find_closest(targets.data(), targets.size(), out.data(), threads);
+
+        return out;
+    }
+
+private:
+    // Ranges of up to this many points are searched point by point
+    static constexpr size_t leaf_size = 8;
+
+    // The number of targets handed to a thread at a time
+    static constexpr size_t query_block = 256;
+
+    struct node {
+        double v[3];
+        double lat;
+        double lon;
+        size_t index;
+    };
+
+    struct query {
+        double v[3];
+        double lat;
+        double lon;
+        double smallest_chord2 = std::numeric_limits<double>::infinity();
+        double bound2 = std::numeric_limits<double>::infinity();
+        double smallest_delta = std::numeric_limits<double>::infinity();
+        size_t closest = 0;
+    };
+
+    It start = {};
+    It end = {};
+
+    // The points in tree order, the node of the range [lo, hi) is at
+    // (lo + hi) / 2 and splits it on axes[(lo + hi) / 2].
+    std::vector<node> nodes;
+    std::vector<uint8_t> axes;
+
+    void build(const size_t lo, const size_t hi) {
+        if (hi - lo <= leaf_size) {
+            return;
+        }
+
+        // Split on the axis with the widest spread
+        double min_v[3] = { 2.0, 2.0, 2.0 };
+        double max_v[3] = { -2.0, -2.0, -2.0 };
+
+        for (auto i = lo; i != hi; ++i) {
+            for (int a = 0; a != 3; ++a) {
+                min_v[a] = std::min(min_v[a], nodes[i].v[a]);
+                max_v[a] = std::max(max_v[a], nodes[i].v[a]);
+            }
+        }
+
+        uint8_t axis = 0;
+
+        for (uint8_t a = 1; a != 3; ++a) {
+            if (max_v[a] - min_v[a] > max_v[axis] - min_v[axis]) {
+                axis = a;
+            }
+        }
+
+        const auto mid = lo + (hi - lo) / 2;
+
+        std::nth_element(nodes.begin() + lo, nodes.begin() + mid, nodes.begin() + hi, [axis](const node& a, const node& b) {
+            return a.v[axis] < b.v[axis];
+        });
+
+        axes[mid] = axis;
+
+        build(lo, mid);
+        build(mid + 1, hi);
+    }
+
+    void visit(query& q, const node& p) const {
+        const double dx = p.v[0] - q.v[0];
+        const double dy = p.v[1] - q.v[1];
+        const double dz = p.v[2] - q.v[2];
+        const double chord2 = dx * dx + dy * dy + dz * dz;
+
+        if (chord2 < q.smallest_chord2) {
+            q.smallest_chord2 = chord2;
+
+            // Rounding can put the point with the smallest haversine distance a
+            // little farther away by chord than the closest by chord, so points
+            // this near the closest are measured too.
+            const double bound = std::sqrt(chord2) * (1.0 + 1E-9) + 1E-12;
+            q.bound2 = bound * bound;
+        }
+
+        if (chord2 > q.bound2) {
+            return;
+        }
+
+        const double delta = internal::distance_scalar(p.lat, p.lon, q.lat, q.lon);
+
+        if (delta < q.smallest_delta || (delta == q.smallest_delta && p.index < q.closest)) {
+            q.smallest_delta = delta;
+            q.closest = p.index;
+        }
+    }
+
+    void search(query& q, const size_t lo, const size_t hi) const {
+        if (hi - lo <= leaf_size) {
+            for (auto i = lo; i != hi; ++i) {
+                visit(q, nodes[i]);
+            }
+
+            return;
+        }
+
+        const auto mid = lo + (hi - lo) / 2;
+        const auto axis = axes[mid];
+        const double delta = q.v[axis] - nodes[mid].v[axis];
+
+        visit(q, nodes[mid]);
+
+        // The side holding the target first, then the other
+        // if it could hold a point within the bound.
+        if (delta < 0) {
+            search(q, lo, mid);
+
+            if (delta * delta <= q.bound2) {
+                search(q, mid + 1, hi);
+            }
+        } else {
+            search(q, mid + 1, hi);
+
+            if (delta * delta <= q.bound2) {
+                search(q, lo, mid);
+            }
+        }
+    }
+};
+
+template <typename Range, typename It = internal::range_iterator<Range>>
+path_spatial_index<It> make_path_spatial_index(const Range& in) {
+    return path_spatial_index<It>(std::begin(in), std::end(in));
+}
+
+//
+//-------------- Time Index -------------- 
+//
+
+//
+// An index of a path's timestamps for finding points by time with a binary
+// search rather than find_closest_path_point_time()'s linear scan. The
+// timestamps are checked when the index is made, if they aren't in ascending
+// order sorted() is false and the searches fall back to scanning the path.
+//
+// The index holds iterators into the path, so the path must outlive it and
+// not be changed while it's used. e.g.
+//
+//      const path_time_index index(path.begin(), path.end());
+//      auto loc = index.position_at(frame_time);
+//
+template <typename It>
+class path_time_index {
+public:
+    path_time_index() = default;
+
+    path_time_index(const It start, const It end) : start(start), end(end) {
+        times.reserve(static_cast<size_t>(std::distance(start, end)));
+
+        for (auto i = start; i != end; ++i) {
+            const auto t = internal::point_time(i);
+
+            if (!times.empty() && t < times.back()) {
+                in_order = false;
+            }
+
+            times.push_back(t);
+        }
+    }
+
+    size_t size() const {
+        return times.size();
+    }
+
+    bool empty() const {
+        return times.empty();
+    }
+
+    // True if the timestamps are in ascending order, equal timestamps are allowed
+    bool sorted() const {
+        return in_order;
+    }
+
+    //
+    // Finds the closest path point to target_timestamp, as
+    // find_closest_path_point_time(), the first if there are several
+    // at the same time from it, or the end of the path if it's empty.
+    //
+    It find_closest(const path_time target_timestamp) const {
+        if (!in_order) {
+            return find_closest_path_point_time(start, end, target_timestamp);
+        }
+
+        const auto k = std::lower_bound(times.begin(), times.end(), target_timestamp) - times.begin();
+
+        return start + static_cast<std::ptrdiff_t>(closest_from(static_cast<size_t>(k), target_timestamp));
+    }
+
+    //
+    // The location at time t interpolated between the points either side of
+    // it, or the first or last point's location if t is outside the path.
+    // If the timestamps aren't sorted it's the closest point's location.
+    //
+    location position_at(const path_time t) const {
+        if (times.empty()) {
+            return {};
+        }
+
+        if (!in_order) {
+            return internal::point_loc(find_closest(t));
+        }
+
+        const auto k = std::upper_bound(times.begin(), times.end(), t) - times.begin();
+
+        return interpolate(static_cast<size_t>(k), t);
+    }
+
+    //
+    // The batch versions answer n queries into out. If the query times are in
+    // ascending order, as for the frames of a video, they're answered in a
+    // single pass that merges them with the path's timestamps.
+    //
+    void find_closest(const path_time* targets, const size_t n, It* out) const {
+        if (!in_order || !std::is_sorted(targets, targets + n)) {
+            for (size_t q = 0; q != n; ++q) {
+                out[q] = find_closest(targets[q]);
+            }
+
+            return;
+        }
+
+        size_t k = 0;
+
+        for (size_t q = 0; q != n; ++q) {
+            // The first point at or after the target
+            while (k != times.size() && times[k] < targets[q]) {
+                ++k;
+            }
+
+            out[q] = start + static_cast<std::ptrdiff_t>(closest_from(k, targets[q]));
+        }
+    }
+
+    std::vector<It> find_closest(const std::vector<path_time>& targets) const {
+        std::vector<It> out(targets.size(), end);
+        find_closest(targets.data(), targets.size(), out.data());
+
+        return out;
+    }
+
+    void position_at(const path_time* targets, const size_t n, location* out) const {
+        if (times.empty() || !in_order || !std::is_sorted(targets, targets + n)) {
+            for (size_t q = 0; q != n; ++q) {
+                out[q] = position_at(targets[q]);
+            }
+
+            return;
+        }
+
+        size_t k = 0;
+
+        for (size_t q = 0; q != n; ++q) {
+            // The first point after the target
+            while (k != times.size() && !(targets[q] < times[k])) {
+                ++k;
+            }
+
+            out[q] = interpolate(k, targets[q]);
+        }
+    }
+
+    std::vector<location> position_at(const std::vector<path_time>& targets) const {
+        std::vector<location> out(targets.size());
+        position_at(targets.data(), targets.size(), out.data());
+
+        return out;
+    }
+
+private:
+    It start = {};
+    It end = {};
+    std::vector<path_time> times;
+    bool in_order = true;
+
+    // The closest point to t given k, the first point at or after t. Of the
+    // last point before t and point k the nearer wins, the earlier if they're
+    // as near, and of several points at the same time the first.
+    size_t closest_from(const size_t k, const path_time t) const {
+        if (times.empty()) {
+            return 0;
+        }
+
+        if (k != 0 && (k == times.size() || t - times[k - 1] <= times[k] - t)) {
+            auto first = k - 1;
+
+            while (first != 0 && times[first - 1] == times[first]) {
+                --first;
+            }
+
+            return first;
+        }
+
+        return k;
+    }
+
+    // The location at t given k, the first point after t
+    location interpolate(const size_t k, const path_time t) const {
+        if (k == 0) {
+            return internal::point_loc(start);
+        }
+
+        const location a = internal::point_loc(start + static_cast<std::ptrdiff_t>(k - 1));
+
+        if (k == times.size() || t == times[k - 1]) {
+            return a;
+        }
+
+        const location b = internal::point_loc(start + static_cast<std::ptrdiff_t>(k));
+        const double f = static_cast<double>((t - times[k - 1]).count()) / static_cast<double>((times[k] - times[k - 1]).count());
+
+        return internal::interpolate_location(a, b, f);
+    }
+};
+
+template <typename Range, typename It = internal::range_iterator<Range>>
+path_time_index<It> make_path_time_index(const Range& in) {
+    return path_time_index<It>(std::begin(in), std::end(in));
+}
+
+//
+//-------------- Prefix Index -------------- 
+//
+
+//
+// Running totals of a path's distance, ascent & descent, and its timestamps,
+// so that the distance, duration, mean speed and climb of any range of its
+// points take constant time rather than a pass over the range, e.g. for laps
+// and segment efforts. The totals are built in a single pass, like
+// path_cumulative_distance(), and points can be appended. The ranges [i, j)
+// are of point indices, a range's values are the differences of the totals
+// at its ends so agree with path_distance() & path_elevation_summary() over
+// the range to within rounding. Ranges must have i <= j <= size(). The
+// distances are measured by the distance model, e.g.
+//
+//      const path_prefix_index<distance_model::ellipsoidal> index(path.begin(), path.end());
+//
+template <typename Distance = distance_model::haversine>
+class path_prefix_index {
+public:
+    path_prefix_index() = default;
+
+    template <typename It>
+    path_prefix_index(const It start, const It end) {
+        append(start, end);
+    }
+
+    size_t size() const {
+        return times.size();
+    }
+
+    bool empty() const {
+        return times.empty();
+    }
+
+    // Adds a point to the end of the path
+    void push_back(const location& loc, const path_time timestamp) {
+        if (!times.empty()) {
+            add(pair_distance(last, loc), loc.ele - last.ele);
+        } else {
+            add(0.0, 0.0);
+        }
+
+        last = loc;
+        times.push_back(timestamp);
+    }
+
+    void push_back(const path_point& p) {
+        push_back(p.loc, p.timestamp);
+    }
+
+    // Adds the points in [start, end) to the end of the path
+    template <typename It>
+    void append(const It start, const It end) {
+        const auto n = static_cast<size_t>(std::distance(start, end));
+
+        if (n == 0) {
+            return;
+        }
+
+        reserve(size() + n);
+        push_back(internal::point_loc(start), internal::point_time(start));
+
+        // The distances between the new points, haversine ones
+        // found a chunk at a time by distance_batch()
+        internal::for_each_pair_distance<Distance>(start, end, [&](const size_t i, const double d) {
+            const location loc = internal::point_loc(start + static_cast<std::ptrdiff_t>(i + 1));
+
+            add(d, loc.ele - last.ele);
+
+            last = loc;
+            times.push_back(internal::point_time(start + static_cast<std::ptrdiff_t>(i + 1)));
+        });
+    }
+
+    void reserve(const size_t n) {
+        times.reserve(n);
+        cumulative_distance.reserve(n);
+        cumulative_ascent.reserve(n);
+        cumulative_descent.reserve(n);
+    }
+
+    void clear() {
+        *this = {};
+    }
+
+    // The path distance of the points [i, j) in metres, as path_distance()
+    double distance(const size_t i, const size_t j) const {
+        return j - i < 2 ? 0.0 : cumulative_distance[j - 1] - cumulative_distance[i];
+    }
+
+    // The time from point i to point j - 1 in seconds
+    double duration(const size_t i, const size_t j) const {
+        return j - i < 2 ? 0.0 : duration_to_seconds(times[i], times[j - 1]);
+    }
+
+    // The mean speed over the points [i, j) in m/s
+    double mean_speed(const size_t i, const size_t j) const {
+        const auto seconds = duration(i, j);
+
+        return seconds > 0 ? distance(i, j) / seconds : 0.0;
+    }
+
+    // The cumulative ascent, and descent (-ve), over the points [i, j) in metres, as path_elevation_summary()
+    double ascent(const size_t i, const size_t j) const {
+        return j - i < 2 ? 0.0 : cumulative_ascent[j - 1] - cumulative_ascent[i];
+    }
+
+    double descent(const size_t i, const size_t j) const {
+        return j - i < 2 ? 0.0 : cumulative_descent[j - 1] - cumulative_descent[i];
+    }
+
+    // The summary of the points [i, j), as generate_path_summary()
+    path_summary summary(const size_t i, const size_t j) const {
+        path_summary out{};
+        out.points = j - i;
+
+        if (out.points < 2) {
+            return out;
+        }
+
+        out.start_time = time_to_str_utc(times[i]);
+        out.end_time = time_to_str_utc(times[j - 1]);
+        out.duration_s = duration(i, j);
+        out.distance_m = distance(i, j);
+        out.mean_speed_kph = mps_to_kph(mean_speed(i, j));
+
+        return out;
+    }
+
+private:
+    std::vector<path_time> times;
+
+    // The totals from the first point to each point
+    std::vector<double> cumulative_distance;
+    std::vector<double> cumulative_ascent;
+    std::vector<double> cumulative_descent;
+
+    // The running totals and the last point, for appending
+    internal::compensated_sum total_distance;
+    internal::compensated_sum total_ascent;
+    internal::compensated_sum total_descent;
+    location last = {};
+
+    // The distance from one point to the next, haversine
+    // ones as distance_batch() for the same results as append()
+    static double pair_distance(const location& l1, const location& l2) {
+        if constexpr (std::is_same_v<Distance, distance_model::haversine>) {
+            return internal::distance_scalar(l1.lat, l1.lon, l2.lat, l2.lon);
+        } else {
+            return Distance::distance(l1, l2);
+        }
+    }
+
+    void add(const double d, const double delta_ele) {
+        total_distance.add(std::isnan(d) ? 0.0 : d);
+
+        if (delta_ele >= 0) {
+            total_ascent.add(delta_ele);
+        } else {
+            total_descent.add(delta_ele);
+        }
+
+        cumulative_distance.push_back(total_distance.value());
+        cumulative_ascent.push_back(total_ascent.value());
+        cumulative_descent.push_back(total_descent.value());
+    }
+};
+
+template <typename Distance = distance_model::haversine, typename Range, typename It = internal::range_iterator<Range>>
+path_prefix_index<Distance> make_path_prefix_index(const Range& in) {
+    return path_prefix_index<Distance>(std::begin(in), std::end(in));
+}
+
+//
+//-------------- Range Index -------------- 
+//
+
+//
+// An index for the lowest & highest points and the bounding box of any range
+// of a path's points, e.g. as a chart is zoomed, in constant time rather than
+// a pass over the range. The points are grouped in blocks, a sparse table
+// holds the extremes of each run of 1, 2, 4... blocks, so a range's full
+// blocks are covered by two runs and the few points either side are scanned.
+//
+// The ranges [i, j) are of point indices, with i <= j <= size(). The index holds
+// iterators into the path, so the path must outlive it and not be changed while
+// it's used.
+//
+template <typename It>
+class path_range_index {
+public:
+    path_range_index() = default;
+
+    path_range_index(const It start, const It end) : start(start), end(end) {
+        const auto n = static_cast<size_t>(std::distance(start, end));
+
+        lat.reserve(n);
+        lon.reserve(n);
+        ele.reserve(n);
+
+        for (auto i = start; i != end; ++i) {
+            const location loc = internal::point_loc(i);
+            lat.push_back(loc.lat);
+            lon.push_back(loc.lon);
+            ele.push_back(loc.ele);
+        }
+
+        // The blocks, then runs of twice as many blocks from the runs before
+        const auto blocks = n / block_size;
+
+        if (blocks == 0) {
+            return;
+        }
+
+        table.emplace_back(blocks);
+
+        for (size_t b = 0; b != blocks; ++b) {
+            table[0][b] = scan(b * block_size, (b + 1) * block_size);
+        }
+
+        for (size_t k = 1; (size_t(1) << k) <= blocks; ++k) {
+            const auto half = size_t(1) << (k - 1);
+            const auto& previous = table[k - 1];
+            std::vector<extent> level(blocks - 2 * half + 1);
+
+            for (size_t b = 0; b != level.size(); ++b) {
+                level[b] = merge(previous[b], previous[b + half]);
+            }
+
+            table.push_back(std::move(level));
+        }
+    }
+
+    size_t size() const {
+        return ele.size();
+    }
+
+    bool empty() const {
+        return ele.empty();
+    }
+
+    //
+    // The points with the min & max elevation in [i, j), the first of any with
+    // the same elevation as path_elevation_summary(), or the end of the path
+    // if the range is empty.
+    //
+    std::tuple<It, It> elevation_range(const size_t i, const size_t j) const {
+        if (i == j) {
+            return { end, end };
+        }
+
+        const auto e = query(i, j);
+
+        return { start + static_cast<std::ptrdiff_t>(e.min_index), start + static_cast<std::ptrdiff_t>(e.max_index) };
+    }
+
+    //
+    // The bounding box of [i, j), as axis_aligned_bounding_box()
+    //
+    // return: { NW box corner, NE, SE, SW }
+    //
+    std::tuple<location, location, location, location> bounding_box(const size_t i, const size_t j) const {
+        if (i == j) {
+            return {};
+        }
+
+        const auto e = query(i, j);
+
+        location nw { e.max_lat, e.min_lon };
+        location ne { e.max_lat, e.max_lon };
+        location se { e.min_lat, e.max_lon };
+        location sw { e.min_lat, e.min_lon };
+
+        return { nw, ne, se, sw };
+    }
+
+private:
+    // The number of points in a block
+    static constexpr size_t block_size = 32;
+
+    struct extent {
+        size_t min_index;
+        size_t max_index;
+        double min_lat;
+        double max_lat;
+        double min_lon;
+        double max_lon;
+    };
+
+    It start = {};
+    It end = {};
+
+    std::vector<double> lat;
+    std::vector<double> lon;
+    std::vector<double> ele;
+
+    // table[k][b] is the extent of the blocks [b, b + 2^k)
+    std::vector<std::vector<extent>> table;
+
+    // The extent of a then b, of equal elevations the earlier point wins
+    extent merge(const extent& a, const extent& b) const {
+        extent e;
+
+        const auto lower = [&](const size_t x, const size_t y) {
+            return ele[x] < ele[y] || (ele[x] == ele[y] && x < y);
+        };
+
+        const auto higher = [&](const size_t x, const size_t y) {
+            return ele[x] > ele[y] || (ele[x] == ele[y] && x < y);
+        };
+
+        e.min_index = lower(b.min_index, a.min_index) ? b.min_index : a.min_index;
+        e.max_index = higher(b.max_index, a.max_index) ? b.max_index : a.max_index;
+        e.min_lat = std::min(a.min_lat, b.min_lat);
+        e.max_lat = std::max(a.max_lat, b.max_lat);
+        e.min_lon = std::min(a.min_lon, b.min_lon);
+        e.max_lon = std::max(a.max_lon, b.max_lon);
+
+        return e;
+    }
+
+    // The extent of the points [i, j), i < j
+    extent scan(const size_t i, const size_t j) const {
+        extent e { i, i, lat[i], lat[i], lon[i], lon[i] };
+
+        for (auto k = i + 1; k != j; ++k) {
+            if (ele[k] > ele[e.max_index]) {
+                e.max_index = k;
+            } else if (ele[k] < ele[e.min_index]) {
+                e.min_index = k;
+            }
+
+            e.min_lat = std::min(e.min_lat, lat[k]);
+            e.max_lat = std::max(e.max_lat, lat[k]);
+            e.min_lon = std::min(e.min_lon, lon[k]);
+            e.max_lon = std::max(e.max_lon, lon[k]);
+        }
+
+        return e;
+    }
+
+    // The extent of the points [i, j), i < j
+    extent query(const size_t i, const size_t j) const {
+        // The full blocks in the range
+        const auto first = (i + block_size - 1) / block_size;
+        const auto last = j / block_size;
+
+        if (first >= last) {
+            return scan(i, j);
+        }
+
+        // Two runs of 2^k blocks that cover them
+        size_t k = 0;
+
+        while ((size_t(2) << k) <= last - first) {
+            ++k;
+        }
+
+        auto e = merge(table[k][first], table[k][last - (size_t(1) << k)]);
+
+        if (i != first * block_size) {
+            e = merge(scan(i, first * block_size), e);
+        }
+
+        if (j != last * block_size) {
+            e = merge(e, scan(last * block_size, j));
+        }
+
+        return e;
+    }
+};
+
+template <typename Range, typename It = internal::range_iterator<Range>>
+path_range_index<It> make_path_range_index(const Range& in) {
+    return path_range_index<It>(std::begin(in), std::end(in));
+}
+
+//
+//-------------- Linear Referencing -------------- 
+//
+
+//
+// Projects target onto the path, finding the nearest point on any of its
+// segments rather than the nearest of its points as find_closest_path_point_dist()
+// does, by a scan of the segments. Each segment is taken as the straight line
+// between its ends' n-vectors, a plane close to the sphere for the short
+// segments of a GPS track. Of segments as near as each other the first wins.
+// Distances along the path are measured by the distance model. An empty path
+// gives a default path_projection. See path_linear_reference for many
+// projections onto the same path.
+//
+template <typename Distance = distance_model::haversine, typename It>
+path_projection project_onto_path(const It start, const It end, const location& target) {
+    const auto n = static_cast<size_t>(std::distance(start, end));
+
+    if (n == 0) {
+        return {};
+    }
+
+    if (n == 1) {
+        return internal::make_projection(start, start, 0.0, 0.0, 0.0, 0, target);
+    }
+
+    const auto p = prepare_location(target);
+    const double pv[3] = { p.x, p.y, p.z };
+
+    auto a = prepare_location(internal::point_loc(start));
+    size_t closest = 0;
+    double closest_t = 0.0;
+    double closest_along = 0.0;
+    double closest_length = 0.0;
+    double smallest = std::numeric_limits<double>::infinity();
+
+    // The distances along the path as path_cumulative_distance<Distance>()
+    internal::compensated_sum along;
+
+    internal::for_each_pair_distance<Distance>(start, end, [&](const size_t i, const double d) {
+        const auto b = prepare_location(internal::point_loc(start + static_cast<std::ptrdiff_t>(i + 1)));
+        const double av[3] = { a.x, a.y, a.z };
+        const double bv[3] = { b.x, b.y, b.z };
+
+        double t;
+        const auto chord2 = internal::project_onto_chord(av, bv, pv, t);
+        const auto segment_start = along.value();
+
+        along.add(d);
+
+        if (chord2 < smallest) {
+            smallest = chord2;
+            closest = i;
+            closest_t = t;
+            closest_along = segment_start;
+            closest_length = along.value() - segment_start;
+        }
+
+        a = b;
+    });
+
+    const auto first = start + static_cast<std::ptrdiff_t>(closest);
+
+    return internal::make_projection(first, first + 1, closest_t, closest_along, closest_length, closest, target);
+}
+
+template <typename Distance = distance_model::haversine, typename Range, typename It = internal::range_iterator<Range>>
+path_projection project_onto_path(const Range& in, const location& target) {
+    return project_onto_path<Distance>(std::begin(in), std::end(in), target);
+}
+
+//
+// Linear referencing, or chainage, of a path: the point at a distance along
+// the path, and the projection of a location onto the path with its distance
+// along it. The distances along the path are those of path_cumulative_distance<Distance>().
+// Projections use a packed R-tree of the segments' bounding boxes, grouped in
+// path order as consecutive GPS segments are close together, so take
+// logarithmic rather than linear time, and give the same results as
+// project_onto_path().
+//
+// The index holds iterators into the path, so the path must outlive it and
+// not be changed while it's used. e.g.
+//
+//      const path_linear_reference route(path.begin(), path.end());
+//      auto progress = route.project_onto_path(vehicle).distance_m;
+//
+template <typename It, typename Distance = distance_model::haversine>
+class path_linear_reference {
+public:
+    path_linear_reference() = default;
+
+    path_linear_reference(const It start, const It end) : start(start), end(end) {
+        const auto n = static_cast<size_t>(std::distance(start, end));
+
+        if (n == 0) {
+            return;
+        }
+
+        cumulative.reserve(n);
+        cumulative.push_back(0.0);
+
+        std::vector<path_value> distances;
+        distances.reserve(n);
+        path_cumulative_distance<Distance>(start, end, std::back_inserter(distances));
+
+        for (const auto& d : distances) {
+            cumulative.push_back(d.value);
+        }
+
+        vectors.reserve(n);
+
+        for (auto i = start; i != end; ++i) {
+            const auto p = prepare_location(internal::point_loc(i));
+            vectors.push_back({ { p.x, p.y, p.z } });
+        }
+
+        build();
+    }
+
+    size_t size() const {
+        return vectors.size();
+    }
+
+    bool empty() const {
+        return vectors.empty();
+    }
+
+    // The length of the path in metres
+    double length() const {
+        return cumulative.empty() ? 0.0 : cumulative.back();
+    }
+
+    //
+    // The point distance_m metres along the path, its location & timestamp
+    // interpolated between the points either side, its sequence is the index
+    // of the point before. Distances outside the path give its first or last point.
+    //
+    path_point point_at_distance(const double distance_m) const {
+        if (cumulative.empty()) {
+            return {};
+        }
+
+        // The first point beyond distance_m
+        auto k = static_cast<size_t>(std::upper_bound(cumulative.begin(), cumulative.end(), distance_m) - cumulative.begin());
+
+        if (!(distance_m > 0.0)) {
+            k = 1;
+        }
+
+        const auto a = start + static_cast<std::ptrdiff_t>(k - 1);
+
+        if (k == cumulative.size() || !(distance_m > 0.0)) {
+            return { internal::point_loc(a), internal::point_time(a), static_cast<int>(k - 1) };
+        }
+
+        const auto b = a + 1;
+        const auto length = cumulative[k] - cumulative[k - 1];
+        const auto f = length > 0 ? (distance_m - cumulative[k - 1]) / length : 0.0;
+
+        return {
+            internal::interpolate_location(internal::point_loc(a), internal::point_loc(b), f),
+            internal::interpolate_time(internal::point_time(a), internal::point_time(b), f),
+            static_cast<int>(k - 1)
+        };
+    }
+
+    //
+    // Projects target onto the path, as project_onto_path<Distance>()
+    //
+    path_projection project_onto_path(const location& target) const {
+        if (vectors.empty()) {
+            return {};
+        }
+
+        if (vectors.size() == 1) {
+            return internal::make_projection(start, start, 0.0, 0.0, 0.0, 0, target);
+        }
+
+        const auto p = prepare_location(target);
+
+        query q;
+        q.v[0] = p.x;
+        q.v[1] = p.y;
+        q.v[2] = p.z;
+
+        search(q, levels.size() - 1, 0);
+
+        const auto first = start + static_cast<std::ptrdiff_t>(q.closest);
+
+        return internal::make_projection(first, first + 1, q.t, cumulative[q.closest],
+            cumulative[q.closest + 1] - cumulative[q.closest], q.closest, target);
+    }
+
+private:
+    // The number of children of each R-tree node
+    static constexpr size_t fanout = 16;
+
+    struct vector3 {
+        double v[3];
+    };
+
+    struct box {
+        double min_v[3];
+        double max_v[3];
+    };
+
+    struct query {
+        double v[3];
+        double smallest = std::numeric_limits<double>::infinity();
+        double t = 0.0;
+        size_t closest = 0;
+    };
+
+    It start = {};
+    It end = {};
+
+    // Distances along the path to each point, and the points' n-vectors
+    std::vector<double> cumulative;
+    std::vector<vector3> vectors;
+
+    // levels[0] are the segments' boxes, levels[k + 1][i] bounds
+    // levels[k][i * fanout] to levels[k][i * fanout + fanout - 1].
+    std::vector<std::vector<box>> levels;
+
+    void build() {
+        const auto segments = vectors.size() - 1;
+
+        if (segments == 0) {
+            return;
+        }
+
+        std::vector<box> boxes(segments);
+
+        for (size_t s = 0; s != segments; ++s) {
+            for (int a = 0; a != 3; ++a) {
+                boxes[s].min_v[a] = std::min(vectors[s].v[a], vectors[s + 1].v[a]);
+                boxes[s].max_v[a] = std::max(vectors[s].v[a], vectors[s + 1].v[a]);
+            }
+        }
+
+        levels.push_back(std::move(boxes));
+
+        while (levels.back().size() > 1) {
+            const auto& children = levels.back();
+            std::vector<box> parents((children.size() + fanout - 1) / fanout);
+
+            for (size_t i = 0; i != parents.size(); ++i) {
+                parents[i] = children[i * fanout];
+
+                for (auto c = i * fanout + 1; c != std::min((i + 1) * fanout, children.size()); ++c) {
+                    for (int a = 0; a != 3; ++a) {
+                        parents[i].min_v[a] = std::min(parents[i].min_v[a], children[c].min_v[a]);
+                        parents[i].max_v[a] = std::max(parents[i].max_v[a], children[c].max_v[a]);
+                    }
+                }
+            }
+
+            levels.push_back(std::move(parents));
+        }
+    }
+
+    // The square of the distance from v to the nearest point in b
+    static double box_distance2(const double* v, const box& b) {
+        double d2 = 0.0;
+
+        for (int a = 0; a != 3; ++a) {
+            const double d = std::max({ b.min_v[a] - v[a], 0.0, v[a] - b.max_v[a] });
+            d2 += d * d;
+        }
+
+        return d2;
+    }
+
+    void search(query& q, const size_t level, const size_t node) const {
+        if (level == 0) {
+            double t;
+            const auto chord2 = internal::project_onto_chord(vectors[node].v, vectors[node + 1].v, q.v, t);
+
+            if (chord2 < q.smallest || (chord2 == q.smallest && node < q.closest)) {
+                q.smallest = chord2;
+                q.t = t;
+                q.closest = node;
+            }
+
+            return;
+        }
+
+        // The children, nearest first
+        const auto& children = levels[level - 1];
+        const auto first = node * fanout;
+        const auto last = std::min(first + fanout, children.size());
+
+        std::pair<double, size_t> order[fanout];
+        size_t count = 0;
+
+        for (auto c = first; c != last; ++c) {
+            order[count++] = { box_distance2(q.v, children[c]), c };
+        }
+
+        std::sort(order, order + count);
+
+        for (size_t i = 0; i != count; ++i) {
+            // Allowing for rounding, a segment on the edge of
+            // a box could be as near as the nearest so far.
+            const double bound = std::sqrt(q.smallest) + 1E-15;
+
+            if (order[i].first > bound * bound) {
+                break;
+            }
+
+            search(q, level - 1, order[i].second);
+        }
+    }
+};
+
+template <typename Distance = distance_model::haversine, typename Range, typename It = internal::range_iterator<Range>>
+path_linear_reference<It, Distance> make_path_linear_reference(const Range& in) {
+    return path_linear_reference<It, Distance>(std::begin(in), std::end(in));
+}
+
+//
+//-------------- Structure of Arrays Path Functions -------------- 
+//
+
+inline path_soa to_path_soa(const path::const_iterator start, const path::const_iterator end) {
+    path_soa out;
+    const auto n = static_cast<size_t>(std::distance(start, end));
+
+    out.lat.resize(n);
+    out.lon.resize(n);
+    out.ele.resize(n);
+    out.timestamp.resize(n);
+    out.sequence.resize(n);
+
+    size_t j = 0;
+
+    for (auto i = start; i != end; ++i, ++j) {
+        out.lat[j] = i->loc.lat;
+        out.lon[j] = i->loc.lon;
+        out.ele[j] = i->loc.ele;
+        out.timestamp[j] = i->timestamp;
+        out.sequence[j] = i->sequence;
+    }
+
+    return out;
+}
+
+inline path to_path(const path_soa& in) {
+    path out(in.size());
+
+    for (size_t i = 0; i != out.size(); ++i) {
+        out[i] = in[i];
+    }
+
+    return out;
+}
+
+//
+// Converts a range of path points to a compact_path, returns false if a
+// timestamp is too far from the first one to be stored.
+//
+template <typename It>
+bool to_compact_path(const It start, const It end, compact_path& out) {
+    out.clear();
+    out.reserve(static_cast<size_t>(std::distance(start, end)));
+
+    for (auto i = start; i != end; ++i) {
+        if (!out.push_back(*i)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+inline path to_path(const compact_path& in) {
+    return path(in.begin(), in.end());
+}
+
+namespace internal {
+
+// The number of independent accumulators used by the reductions
+// below, splitting a reduction like this lets the compiler use
+// vector instructions without having to reorder floating point
+// operations itself.
+static constexpr size_t soa_lanes = 4;
+
+inline void min_max(const double* p, const size_t n, double& min_value, double& max_value) {
+    double mins[soa_lanes];
+    double maxs[soa_lanes];
+
+    for (size_t k = 0; k != soa_lanes; ++k) {
+        mins[k] = p[0];
+        maxs[k] = p[0];
     }
-    
-    return out;
+
+    size_t i = 0;
+
+    for (; i + soa_lanes <= n; i += soa_lanes) {
+        for (size_t k = 0; k != soa_lanes; ++k) {
+            mins[k] = std::min(mins[k], p[i + k]);
+            maxs[k] = std::max(maxs[k], p[i + k]);
+        }
+    }
+
+    for (; i != n; ++i) {
+        mins[0] = std::min(mins[0], p[i]);
+        maxs[0] = std::max(maxs[0], p[i]);
+    }
+
+    min_value = *std::min_element(mins, mins + soa_lanes);
+    max_value = *std::max_element(maxs, maxs + soa_lanes);
 }
 
+} // namespace internal
+
 //
-// Sums up the location to location distances on the given path.
+// Calculate axis-aligned bounding box of the path.
 //
-inline std::vector<path_value> path_cumulative_distance(const path::const_iterator start, const path::const_iterator end) {
-        
-    const auto count = std::distance(start, end);
+// return: { NW box corner, NE, SE, SW }
+//
+inline std::tuple<location, location, location, location> axis_aligned_bounding_box(const path_soa& in) {
 
-    if (count < 2) {
+    // Empty sequence?
+    if (in.empty()) {
         return {};
     }
 
-    std::vector<path_value> out;
-    out.reserve(static_cast<size_t>(count));
-    
-    double dist = 0.0;
-    
-    // Loop through from start to the second last
-    // point accumulating the heading between
-    // the point pairs.
-    const auto last = end - 1;
-    for (auto i = start; i != last; ++i) {
-        const auto d = distance(i->loc, (i + 1)->loc); 
-        dist += d;
-        
-        out.push_back({ dist, std::next(i)->timestamp });
+    double min_lat, max_lat, min_lon, max_lon;
+    internal::min_max(in.lat.data(), in.size(), min_lat, max_lat);
+    internal::min_max(in.lon.data(), in.size(), min_lon, max_lon);
+
+    location nw { max_lat, min_lon };
+    location ne { max_lat, max_lon };
+    location se { min_lat, max_lon };
+    location sw { min_lat, min_lon };
+
+    return { nw, ne, se, sw };
+}
+
+//
+// Same as path_distance() for a path, for haversine the latitude and
+// longitude arrays are passed straight to distance_batch() a chunk at a time.
+//
+template <typename Distance = distance_model::haversine>
+double path_distance(const path_soa& in) {
+    const auto n = in.size();
+
+    if (n < 2) {
+        return 0.0;
+    }
+
+    // Summed in compensated blocks as path_distance() for a path
+    internal::block_sum dist;
+
+    if constexpr (!std::is_same_v<Distance, distance_model::haversine>) {
+        for (size_t i = 0; i + 1 != n; ++i) {
+            const auto d = Distance::distance(in.loc(i), in.loc(i + 1));
+
+            dist.add(i, std::isnan(d) ? 0.0 : d);
+        }
+
+        return dist.value();
+    }
+
+    double d[internal::distance_chunk];
+
+    for (size_t i = 0; i + 1 < n; i += internal::distance_chunk) {
+        const auto m = std::min(internal::distance_chunk, n - 1 - i);
+        distance_batch(&in.lat[i], &in.lon[i], &in.lat[i + 1], &in.lon[i + 1], d, m);
+
+        for (size_t k = 0; k != m; ++k) {
+            dist.add(i + k, std::isnan(d[k]) ? 0.0 : d[k]);
+        }
     }
-    
-    return out;
-}    
+
+    return dist.value();
+}
 
 //
-// Finds the closest path point to the provided target location based on time.
+// Finds the index of the path location that is farthest from the location
+// specified by the "from" argument, or size() if the path is empty. If there
+// are multiple locations with the same maximum distance then it returns the first.
 //
-inline path::const_iterator find_closest_path_point_time(const path::const_iterator start, const path::const_iterator end, path_time target_timestamp) {
+template <typename Distance = distance_model::haversine>
+size_t find_farthest_point(const path_soa& in, const location& from) {
+    const auto n = in.size();
 
-    // Check for empty/bad range
-    if (start == end) {
-        return end;
+    if (n == 0) {
+        return n;
     }
 
-    // We assume that the points in the path are in ascending
-    // chronological order!
-    auto closest = start;
-    auto smallest_time_delta = std::abs((start->timestamp - target_timestamp).count());
+    if constexpr (!std::is_same_v<Distance, distance_model::haversine>) {
+        size_t farthest = 0;
+        double max_dist = 0;
 
-    for (auto i = start; i != end; ++i) {
-        const auto delta = std::abs((i->timestamp - target_timestamp).count());
-        
-        if (delta < smallest_time_delta) {
-            smallest_time_delta = delta;
-            closest = i;
+        for (size_t i = 0; i != n; ++i) {
+            const auto dist = Distance::distance(from, in.loc(i));
+
+            if (dist > max_dist) {
+                max_dist = dist;
+                farthest = i;
+            }
         }
+
+        return farthest;
     }
-    
-    return closest;
+
+    double d[internal::distance_chunk];
+    size_t farthest = 0;
+    double max_dist = 0;
+
+    for (size_t i = 0; i < n; i += internal::distance_chunk) {
+        const auto m = std::min(internal::distance_chunk, n - i);
+        distance_batch(&in.lat[i], &in.lon[i], from, d, m);
+
+        for (size_t k = 0; k != m; ++k) {
+            if (d[k] > max_dist) {
+                max_dist = d[k];
+                farthest = i + k;
+            }
+        }
+    }
+
+    return farthest;
 }
 
 //
-// Finds the closest path point to the provided target location based on distance.
+// Calculate some elevation stats for the path, returns:
 //
-inline path::iterator find_closest_path_point_dist(const path::iterator start, const path::iterator end, const location& target) {
-    
-    // Check for empty/bad range
-    if (start == end)
-        return end;
-    
-    auto closest = start;
-    auto smallest_delta = std::abs(distance(start->loc, target));
-    
-    for (auto i = start; i != end; ++i) {
-        const auto delta = std::abs(distance(i->loc, target));
-        
-        if (delta < smallest_delta) {
-            smallest_delta = delta;
-            closest = i;
+// { index of location with min elevation, index of max elevation,
+//    cumulative ascent over path, cumulative descent over path (-ve) }
+//
+// The indices are size() if the path has fewer than two points.
+//
+inline std::tuple<size_t, size_t, double, double> path_elevation_summary(const path_soa& in) {
+    const auto n = in.size();
+
+    if (n < 2) {
+        return { n, n, 0.0, 0.0 };
+    }
+
+    const double* ele = in.ele.data();
+
+    double min_elevation, max_elevation;
+    internal::min_max(ele, n, min_elevation, max_elevation);
+
+    // The first of each
+    const auto min_index = static_cast<size_t>(std::find(ele, ele + n, min_elevation) - ele);
+    const auto max_index = static_cast<size_t>(std::find(ele, ele + n, max_elevation) - ele);
+
+    double ascent[internal::soa_lanes] = {};
+    double descent[internal::soa_lanes] = {};
+
+    size_t i = 1;
+
+    for (; i + internal::soa_lanes <= n; i += internal::soa_lanes) {
+        for (size_t k = 0; k != internal::soa_lanes; ++k) {
+            const auto delta_ele = ele[i + k] - ele[i + k - 1];
+            ascent[k] += delta_ele >= 0 ? delta_ele : 0.0;
+            descent[k] += delta_ele >= 0 ? 0.0 : delta_ele;
         }
     }
-    
-    return closest;
+
+    for (; i != n; ++i) {
+        const auto delta_ele = ele[i] - ele[i - 1];
+        ascent[0] += delta_ele >= 0 ? delta_ele : 0.0;
+        descent[0] += delta_ele >= 0 ? 0.0 : delta_ele;
+    }
+
+    double cumulative_ascent = 0.0;
+    double cumulative_descent = 0.0;
+
+    for (size_t k = 0; k != internal::soa_lanes; ++k) {
+        cumulative_ascent += ascent[k];
+        cumulative_descent += descent[k];
+    }
+
+    return { min_index, max_index, cumulative_ascent, cumulative_descent };
 }
 
 //
-// Finds the first region within a path where progress halted, i.e. where the traveler 'stopped'.
-// Returns a tuple of iterators representing the start and end points of the "stationary" region.
+//-------------- Helper Functions -------------- 
 //
-// TODO: if a stationary region occurs at the end of a path it won';'t be returned.
+
 //
-inline std::tuple<path::const_iterator, path::const_iterator> find_stationary_points(const path::const_iterator start_it, const path::const_iterator end_it, const int radius_m, const int time_s) {
-    // Find the points where successive distance traveled values
-    // does not go further than radius_m
-    
-    auto start = start_it;
-    bool time_ok = false;
-    const auto end = std::prev(end_it);
+// The helper functions take a range of random access iterators
+// to path_values, or to anything with value and timestamp members.
+// The overloads that take an output iterator write their values to
+// it and return the end of the output, so don't allocate.
+//
+
+//
+// Smooths the values with a [ 1, 2, 1 ] triangular filter, giving
+// a value for each but the first and last.
+//
+template <typename It, typename Out>
+Out smooth(const It start_it, const It end_it, Out out) {
+    if (std::distance(start_it, end_it) < 3)
+        return out;
+
+    for (auto i = std::next(start_it); i != std::prev(end_it); ++i) {
+            // Triangular filter
+            // Use [ 1, 2, 1 ] kernel
+            const double val = (std::prev(i)->value + 2.0 * i->value + std::next(i)->value) / 4.0;
+            *out++ = path_value{ val , i->timestamp };
+    }
+
+    return out;
+}
+
+template <typename It>
+std::vector<path_value> smooth(const It start_it, const It end_it) {
+    if (std::distance(start_it, end_it) < 3)
+        return {};
+
+    std::vector<path_value> out;
+    out.reserve(static_cast<size_t>(std::distance(start_it, end_it) - 2));
+    smooth(start_it, end_it, std::back_inserter(out));
+
+    return out;
+}
+
+//
+// Smooths the values in place like smooth(), the first
+// and last values are left as they are.
+//
+template <typename It>
+void smooth_in_place(const It start_it, const It end_it) {
+    if (std::distance(start_it, end_it) < 3)
+        return;
+
+    // The unsmoothed value before i
+    double prev = start_it->value;
+
+    for (auto i = std::next(start_it); i != std::prev(end_it); ++i) {
+            const double value = i->value;
+            i->value = (prev + 2.0 * value + std::next(i)->value) / 4.0;
+            prev = value;
+    }
+}
+
+//
+// The difference between each value and the next, giving
+// a value for each but the last.
+//
+template <typename It, typename Out>
+Out first_forward_difference(const It start_it, const It end_it, Out out) {
+    if (std::distance(start_it, end_it) < 2)
+        return out;
+
+    for (auto i = start_it; i != std::prev(end_it); ++i) {
+            const double val = std::next(i)->value - i->value;
+            *out++ = path_value{ val, i->timestamp };
+    }
+
+    return out;
+}
+
+template <typename It>
+std::vector<path_value> first_forward_difference(const It start_it, const It end_it) {
+    if (std::distance(start_it, end_it) < 2)
+        return {};
+
+    std::vector<path_value> out;
+    out.reserve(static_cast<size_t>(std::distance(start_it, end_it) - 1));
+    first_forward_difference(start_it, end_it, std::back_inserter(out));
+
+    return out;
+}
+
+//
+// Half the difference between the values either side of
+// each value, giving a value for each but the first and last.
+//
+template <typename It, typename Out>
+Out first_central_difference(const It start_it, const It end_it, Out out) {
+    if (std::distance(start_it, end_it) < 3)
+        return out;
+
+    for (auto i = std::next(start_it); i != std::prev(end_it); ++i) {
+            const double val = (std::next(i)->value - std::prev(i)->value) / 2.0;
+            *out++ = path_value{ val, i->timestamp };
+    }
+
+    return out;
+}
+
+template <typename It>
+std::vector<path_value> first_central_difference(const It start_it, const It end_it) {
+    if (std::distance(start_it, end_it) < 3)
+        return {};
+
+    std::vector<path_value> out;
+    out.reserve(static_cast<size_t>(std::distance(start_it, end_it) - 2));
+    first_central_difference(start_it, end_it, std::back_inserter(out));
+
+    return out;
+}
+
+template <typename Distance = distance_model::haversine, typename It>
+path_summary generate_path_summary(const It start_it, const It end_it) {
+    path_summary summary{};
+
+    summary.points = static_cast<size_t>(std::distance(start_it, end_it));
+	
+	if (summary.points < 2) {
+		return summary;
+	}
+	
+	summary.start_time = time_to_str_utc(internal::point_time(start_it));
+	summary.end_time = time_to_str_utc(internal::point_time(end_it - 1)); 
+	summary.duration_s = duration_to_seconds(internal::point_time(start_it), internal::point_time(end_it- 1)); 
+	summary.distance_m = path_distance<Distance>(start_it, end_it);	
+	auto seconds = duration_to_seconds(internal::point_time(start_it), internal::point_time(end_it - 1));
+	auto speed = seconds > 0 ? summary.distance_m / seconds : 0.0;
+	
+	summary.mean_speed_kph = mps_to_kph(speed);	
+
+    return summary;
+}
+
+template <typename Distance = distance_model::haversine, typename Range, typename It = internal::range_iterator<Range>>
+path_summary generate_path_summary(const Range& in) {
+    return generate_path_summary<Distance>(std::begin(in), std::end(in));
+}
+
+//
+//-------------- Path Analysis -------------- 
+//
+
+//
+// The outputs of analyze_path(), combine them with | to choose which are calculated.
+//
+namespace analysis {
+    static constexpr unsigned distance = 1 << 0;             // path_distance()
+    static constexpr unsigned speed = 1 << 1;                // path_speed()
+    static constexpr unsigned heading = 1 << 2;              // path_heading()
+    static constexpr unsigned cumulative_distance = 1 << 3;  // path_cumulative_distance()
+    static constexpr unsigned elevation = 1 << 4;            // path_elevation_summary()
+    static constexpr unsigned bounding_box = 1 << 5;         // axis_aligned_bounding_box()
+    static constexpr unsigned summary = 1 << 6;              // generate_path_summary()
+
+    static constexpr unsigned all = distance | speed | heading | cumulative_distance | elevation | bounding_box | summary;
+}
+
+//
+// The results of analyze_path(), only the outputs that were asked for are filled in.
+//
+template <typename It>
+struct path_analysis {
+    // analysis::distance
+    double distance_m = 0.0;
+
+    // analysis::speed, heading & cumulative_distance
+    std::vector<path_value> speed;
+    std::vector<path_value> heading;
+    std::vector<path_value> cumulative_distance;
+
+    // analysis::elevation, min_elevation & max_elevation
+    // are end if the path has fewer than two points.
+    It min_elevation = {};
+    It max_elevation = {};
+    double cumulative_ascent = 0.0;
+    double cumulative_descent = 0.0;
+
+    // analysis::bounding_box, { NW box corner, NE, SE, SW }
+    std::tuple<location, location, location, location> bounding_box = {};
+
+    // analysis::summary
+    path_summary summary = {};
+};
+
+//
+// Calculates the outputs chosen by Flags in a single pass over the path, giving
+// the same results as calling the individual functions. The distances between
+// the points are found once and shared by the distance, speed & cumulative
+// distance outputs. Each point's sine and cosine are found once, and shared by
+// the headings and haversine distances, when headings are asked for, otherwise
+// the distances are found a chunk at a time by distance_batch(). The work for
+// outputs that weren't asked for is left out at compile time, e.g.
+//
+//      auto result = analyze_path<analysis::distance | analysis::elevation>(path.begin(), path.end());
+//
+template <unsigned Flags = analysis::all, typename Distance = distance_model::haversine, typename It>
+path_analysis<It> analyze_path(const It start, const It end) {
+    constexpr bool want_distance = (Flags & (analysis::distance | analysis::summary)) != 0;
+    constexpr bool want_speed = (Flags & analysis::speed) != 0;
+    constexpr bool want_heading = (Flags & analysis::heading) != 0;
+    constexpr bool want_cumulative = (Flags & analysis::cumulative_distance) != 0;
+    constexpr bool want_elevation = (Flags & analysis::elevation) != 0;
+    constexpr bool want_box = (Flags & analysis::bounding_box) != 0;
+    constexpr bool want_pair_distance = want_distance || want_speed || want_cumulative;
+
+    // The headings & haversine distances share each point's trigonometry
+    constexpr bool want_trig = want_heading && !internal::is_prepared<It>;
+    constexpr bool share_trig = want_trig && want_pair_distance && std::is_same_v<Distance, distance_model::haversine>;
+
+    path_analysis<It> out;
+    out.min_elevation = end;
+    out.max_elevation = end;
+
+    const auto count = std::distance(start, end);
+
+    if (count == 0) {
+        return out;
+    }
+
+    if constexpr (want_speed) {
+        out.speed.reserve(static_cast<size_t>(count));
+    }
+
+    if constexpr (want_heading) {
+        out.heading.reserve(static_cast<size_t>(count));
+    }
+
+    if constexpr (want_cumulative) {
+        out.cumulative_distance.reserve(static_cast<size_t>(count));
+    }
+
+    // The previous point
+    location loc = internal::point_loc(start);
+    path_time time = internal::point_time(start);
+    internal::haversine_point trig = {}, next_trig = {};
+
+    if constexpr (want_trig) {
+        trig = internal::to_haversine_point(loc.lat, loc.lon);
+    }
 
-    for (auto i = start_it; i != end; ++i) {
-        const auto next = std::next(i);
-    
-        // The distance between the last candidate start location
-        // and this location.
-        const auto delta = distance(start->loc, next->loc);
-        
-        // Is this distance within our "stationary" circle?
-        if (delta < radius_m) {
-            // yes, and is the time difference large enough such that
-            // we can expect a reasonable distance traveled and so count 
-            // this as a stationary region?            
-            if (i->timestamp - start->timestamp >  std::chrono::seconds(time_s)) {
-                time_ok = true;
+    double min_lat = loc.lat, max_lat = loc.lat;
+    double min_lon = loc.lon, max_lon = loc.lon;
+
+    auto min_it = start, max_it = start;
+    double min_elevation = loc.ele, max_elevation = loc.ele;
+
+    // Summed as path_distance(), path_cumulative_distance() & path_elevation_summary()
+    internal::block_sum dist;
+    internal::compensated_sum cumulative;
+    internal::block_sum ascent;
+    internal::block_sum descent;
+
+    // The first point's zero elevation delta
+    if constexpr (want_elevation) {
+        ascent.add(0, 0.0);
+        descent.add(0, 0.0);
+    }
+
+    // Moves on to point i + 1, d is the distance to it from point i
+    const auto step = [&](const size_t i, [[maybe_unused]] const double d) {
+        const auto next_it = start + i + 1;
+        const location next_loc = internal::point_loc(next_it);
+        const path_time next_time = internal::point_time(next_it);
+
+        if constexpr (want_distance) {
+            dist.add(i, std::isnan(d) ? 0.0 : d);
+        }
+
+        if constexpr (want_speed) {
+            const auto seconds = (double)std::chrono::duration_cast<std::chrono::microseconds>(next_time - time).count() / 1E6;
+            out.speed.push_back({ d / seconds, time });
+        }
+
+        if constexpr (want_cumulative) {
+            cumulative.add(d);
+            out.cumulative_distance.push_back({ cumulative.value(), next_time });
+        }
+
+        if constexpr (want_trig) {
+            // As path_heading()
+            if constexpr (!share_trig) {
+                next_trig = internal::to_haversine_point(next_loc.lat, next_loc.lon);
             }
-        } else {
 
-            // We are now outside the circle, if the last time delta
-            // was greater than our filter then we are on the move
-            // again so return the start and end iterators of the
-            // "stationary" region.
-            if (time_ok) {
-                return { start, i };
+            out.heading.push_back({ internal::heading_scalar(trig, next_trig), time });
+            trig = next_trig;
+        } else if constexpr (want_heading) {
+            out.heading.push_back({ internal::point_heading(start + i, next_it), time });
+        }
+
+        if constexpr (want_elevation) {
+            if (next_loc.ele > max_elevation) {
+                max_it = next_it;
+                max_elevation = next_loc.ele;
+            } else if (next_loc.ele < min_elevation) {
+                min_it = next_it;
+                min_elevation = next_loc.ele;
             }
-            
-            start = i;
+
+            const auto delta_ele = next_loc.ele - loc.ele;
+
+            ascent.add(i + 1, delta_ele >= 0 ? delta_ele : 0.0);
+            descent.add(i + 1, delta_ele >= 0 ? 0.0 : delta_ele);
+        }
+
+        if constexpr (want_box) {
+            min_lat = std::min(min_lat, next_loc.lat);
+            max_lat = std::max(max_lat, next_loc.lat);
+            min_lon = std::min(min_lon, next_loc.lon);
+            max_lon = std::max(max_lon, next_loc.lon);
+        }
+
+        loc = next_loc;
+        time = next_time;
+    };
+
+    if constexpr (share_trig) {
+        // The same distances as the kernels, from the shared trigonometry
+        for (size_t i = 0; i + 1 < static_cast<size_t>(count); ++i) {
+            const location next_loc = internal::point_loc(start + i + 1);
+            next_trig = internal::to_haversine_point(next_loc.lat, next_loc.lon);
+
+            step(i, internal::distance_scalar(trig, next_trig));
+        }
+    } else if constexpr (want_pair_distance) {
+        internal::for_each_pair_distance<Distance>(start, end, step);
+    } else {
+        for (size_t i = 0; i + 1 < static_cast<size_t>(count); ++i) {
+            step(i, 0.0);
         }
     }
-    
-    // none found
-    return { end_it, end_it };
-}
 
-//
-// Finds the path location that is farthest (as the crow files) from the location
-// specified by the "from" argument.  If there are multiple locations with the same maximum
-// distance then it returns the first.
-//
-inline path::const_iterator find_farthest_point(const path::const_iterator start, const path::const_iterator end, const location& from) {
+    if constexpr ((Flags & analysis::distance) != 0) {
+        out.distance_m = dist.value();
+    }
 
-    // Empty sequence
-    if (start == end || start > end) {
-        return end;
+    if constexpr (want_elevation) {
+        if (count > 1) {
+            out.min_elevation = min_it;
+            out.max_elevation = max_it;
+            out.cumulative_ascent = ascent.value();
+            out.cumulative_descent = descent.value();
+        }
     }
 
-    path::const_iterator farthest = start;
-    double max_dist = 0;
-    
-    for (auto i = start; i != end; ++i) {
-        auto dist = distance(from, i->loc);
-        if (dist > max_dist) {
-            max_dist = dist;
-            farthest = i;
+    if constexpr (want_box) {
+        out.bounding_box = { { max_lat, min_lon }, { max_lat, max_lon }, { min_lat, max_lon }, { min_lat, min_lon } };
+    }
+
+    if constexpr ((Flags & analysis::summary) != 0) {
+        out.summary.points = static_cast<size_t>(count);
+
+        if (count > 1) {
+            const auto first_time = internal::point_time(start);
+
+            out.summary.start_time = time_to_str_utc(first_time);
+            out.summary.end_time = time_to_str_utc(time);
+            out.summary.duration_s = duration_to_seconds(first_time, time);
+            out.summary.distance_m = dist.value();
+            const auto seconds = duration_to_seconds(first_time, time);
+            out.summary.mean_speed_kph = mps_to_kph(seconds > 0 ? out.summary.distance_m / seconds : 0.0);
         }
     }
 
-    return farthest;
+    return out;
 }
 
-//
-//-------------- Elevation Path Functions -------------- 
-//
+template <unsigned Flags = analysis::all, typename Distance = distance_model::haversine, typename Range, typename It = internal::range_iterator<Range>>
+path_analysis<It> analyze_path(const Range& in) {
+    return analyze_path<Flags, Distance>(std::begin(in), std::end(in));
+}
 
 //
-// Calculate some elevation stats for the path, returns:
+//-------------- Mixed Iterator Path Functions -------------- 
 //
-// { iterator to location with min elevation, iterator to max elevation,
-//    cumulative ascent over path, cumulative descent over path (-ve) }
+// Overloads of the path functions for a start and an end of different
+// iterator types with a common type, e.g. a path's cbegin() and end(), as
+// the functions took path::const_iterators before they were templates.
 //
-std::tuple<path::const_iterator, path::const_iterator, double, double> path_elevation_summary(const path::const_iterator start, const path::const_iterator end) {
-    const auto count =  std::distance(start, end);
 
-    if (count < 2) {
-        return {};
-    }
+template <typename Start, typename End, typename It = internal::common_iterator_t<Start, End>>
+std::tuple<location, location, location, location> axis_aligned_bounding_box(const Start start, const End end) {
+    return axis_aligned_bounding_box<It>(It(start), It(end));
+}
 
-    // Current min/max
-    double min_elevation = start->loc.ele;
-    double max_elevation = start->loc.ele;
+template <typename Start, typename End, typename It = internal::common_iterator_t<Start, End>>
+void ellipsoidal_distances(const Start start, const End end, double* out, const unsigned threads = 0) {
+    ellipsoidal_distances<It>(It(start), It(end), out, threads);
+}
 
-    // Iterators to the min/max elevations
-    auto min_it = start;
-    auto max_it = start;
-    
-    double cumulative_ascent = 0.0;
-    double cumulative_descent = 0.0;
-    double last_ele = start->loc.ele;
+template <typename Start, typename End, typename It = internal::common_iterator_t<Start, End>>
+std::vector<double> ellipsoidal_distances(const Start start, const End end, const unsigned threads = 0) {
+    return ellipsoidal_distances<It>(It(start), It(end), threads);
+}
 
-    for (auto i = start; i != end; ++i) {
+template <typename Distance = distance_model::haversine, typename Start, typename End, typename It = internal::common_iterator_t<Start, End>>
+double path_distance(const Start start, const End end) {
+    return path_distance<Distance, It>(It(start), It(end));
+}
 
-        // Is this a min/max?
-        if (i->loc.ele > max_elevation) {
-            max_it = i;
-            max_elevation = i->loc.ele;
-        } else if (i->loc.ele < min_elevation) {
-            min_it = i;
-            min_elevation = i->loc.ele;
-        }
+template <typename Start, typename End, typename Out, typename It = internal::common_iterator_t<Start, End>>
+Out path_heading(const Start start, const End end, Out out) {
+    return path_heading<It, Out>(It(start), It(end), out);
+}
 
-        // Accrue ascent or descent
-        auto delta_ele = i->loc.ele - last_ele;
-        last_ele = i->loc.ele;
+template <typename Start, typename End, typename It = internal::common_iterator_t<Start, End>>
+std::vector<path_value> path_heading(const Start start, const End end) {
+    return path_heading<It>(It(start), It(end));
+}
 
-        if (delta_ele >= 0) {
-            cumulative_ascent += delta_ele;
-        } else {
-            cumulative_descent += delta_ele;
-        }
-    }
+template <typename Distance = distance_model::haversine, typename Start, typename End, typename Out, typename It = internal::common_iterator_t<Start, End>>
+Out path_speed(const Start start, const End end, Out out) {
+    return path_speed<Distance, It, Out>(It(start), It(end), out);
+}
 
-    return { min_it, max_it, cumulative_ascent, cumulative_descent };
+template <typename Distance = distance_model::haversine, typename Start, typename End, typename It = internal::common_iterator_t<Start, End>>
+std::vector<path_value> path_speed(const Start start, const End end) {
+    return path_speed<Distance, It>(It(start), It(end));
 }
 
+template <typename Distance = distance_model::haversine, typename Start, typename End, typename Out, typename It = internal::common_iterator_t<Start, End>>
+Out path_cumulative_distance(const Start start, const End end, Out out) {
+    return path_cumulative_distance<Distance, It, Out>(It(start), It(end), out);
+}
 
-//
-//-------------- Helper Functions -------------- 
-//
+template <typename Distance = distance_model::haversine, typename Start, typename End, typename It = internal::common_iterator_t<Start, End>>
+std::vector<path_value> path_cumulative_distance(const Start start, const End end) {
+    return path_cumulative_distance<Distance, It>(It(start), It(end));
+}
 
-inline std::vector<path_value> smooth(const std::vector<path_value>::const_iterator start_it, const std::vector<path_value>::const_iterator end_it) {
-    if (std::distance(start_it, end_it) < 3)
-        return {};
-        
-    std::vector<path_value> out;
-    out.reserve(static_cast<size_t>(std::distance(start_it, end_it) - 2));
-    
-    for (auto i = start_it; i != std::prev(end_it); ++i) {
-            // Triangular filter
-            // Use [ 1, 2, 1 ] kernel
-            const double val = (std::prev(i)->value + 2.0 * i->value + std::next(i)->value) / 4.0;
-            out.push_back({ val , i->timestamp });
-    }
+template <typename Start, typename End, typename It = internal::common_iterator_t<Start, End>>
+It find_closest_path_point_time(const Start start, const End end, const path_time target_timestamp) {
+    return find_closest_path_point_time<It>(It(start), It(end), target_timestamp);
+}
 
-    return out;
+template <typename Distance = distance_model::haversine, typename Start, typename End, typename It = internal::common_iterator_t<Start, End>>
+It find_closest_path_point_dist(const Start start, const End end, const location& target) {
+    return find_closest_path_point_dist<Distance, It>(It(start), It(end), target);
 }
 
-inline std::vector<path_value> first_forward_difference(const std::vector<path_value>::const_iterator start_it, const std::vector<path_value>::const_iterator end_it) {
-    if (std::distance(start_it, end_it) < 3)
-        return {};
-        
-    std::vector<path_value> out;
-    out.reserve(static_cast<size_t>(std::distance(start_it, end_it) - 2));
-    
-    for (auto i = start_it; i != std::prev(end_it); ++i) {
-            const double val = std::next(i)->value - std::prev(i)->value; 
-            out.push_back({ val, i->timestamp });
-    }
+template <typename Distance = distance_model::haversine, typename Start, typename End, typename It = internal::common_iterator_t<Start, End>>
+It find_closest_path_point_dist(const Start start, const End end, const prepared_location& target) {
+    return find_closest_path_point_dist<Distance, It>(It(start), It(end), target);
+}
 
-    return out;
+template <typename Distance = distance_model::haversine, typename Start, typename End, typename It = internal::common_iterator_t<Start, End>>
+std::tuple<It, It> find_stationary_points(const Start start, const End end, const int radius_m, const int time_s) {
+    return find_stationary_points<Distance, It>(It(start), It(end), radius_m, time_s);
 }
 
-inline std::vector<path_value> first_central_difference(const std::vector<path_value>::iterator start_it, const std::vector<path_value>::iterator end_it) {
-    if (std::distance(start_it, end_it) < 3)
-        return {};
-        
-    std::vector<path_value> out;
-    out.reserve(static_cast<size_t>(std::distance(start_it, end_it) - 2));
-    
-    for (auto i = std::next(start_it); i != std::prev(end_it); ++i) {
-            const double val = (std::next(i)->value - std::prev(i)->value) / 2.0;
-            out.push_back( { val, i->timestamp });
-    }
+template <typename Distance = distance_model::haversine, typename Start, typename End, typename It = internal::common_iterator_t<Start, End>>
+It find_farthest_point(const Start start, const End end, const location& from) {
+    return find_farthest_point<Distance, It>(It(start), It(end), from);
+}
 
-    return out;
+template <typename Distance = distance_model::haversine, typename Start, typename End, typename It = internal::common_iterator_t<Start, End>>
+It find_farthest_point(const Start start, const End end, const prepared_location& from) {
+    return find_farthest_point<Distance, It>(It(start), It(end), from);
 }
 
-inline path_summary generate_path_summary(const path::const_iterator start_it, const path::const_iterator end_it) {
-    path_summary summary{};
+template <typename Start, typename End, typename It = internal::common_iterator_t<Start, End>>
+std::tuple<It, It, double, double> path_elevation_summary(const Start start, const End end) {
+    return path_elevation_summary<It>(It(start), It(end));
+}
 
-    summary.points = static_cast<size_t>(std::distance(start_it, end_it));
-	
-	if (summary.points < 2) {
-		return summary;
-	}
-	
-	summary.start_time = time_to_str_utc(start_it->timestamp);
-	summary.end_time = time_to_str_utc(end_it->timestamp); 
-	summary.duration_s = duration_to_seconds(start_it->timestamp, (end_it- 1)->timestamp); 
-	summary.distance_m = path_distance(start_it, end_it);	
-	auto seconds = duration_to_seconds(start_it->timestamp, (end_it - 1)->timestamp);
-	auto speed = seconds > 0 ? summary.distance_m / seconds : 0.0;
-	
-	summary.mean_speed_kph = mps_to_kph(speed);	
+template <typename Distance = distance_model::haversine, typename Start, typename End, typename It = internal::common_iterator_t<Start, End>>
+double path_distance_parallel(const Start start, const End end, const unsigned threads = 0) {
+    return path_distance_parallel<Distance, It>(It(start), It(end), threads);
+}
 
-    return summary;
+template <typename Start, typename End, typename It = internal::common_iterator_t<Start, End>>
+std::tuple<location, location, location, location> axis_aligned_bounding_box_parallel(const Start start, const End end, const unsigned threads = 0) {
+    return axis_aligned_bounding_box_parallel<It>(It(start), It(end), threads);
+}
+
+template <typename Start, typename End, typename It = internal::common_iterator_t<Start, End>>
+std::tuple<It, It, double, double> path_elevation_summary_parallel(const Start start, const End end, const unsigned threads = 0) {
+    return path_elevation_summary_parallel<It>(It(start), It(end), threads);
+}
+
+template <typename Distance = distance_model::haversine, typename Start, typename End, typename It = internal::common_iterator_t<Start, End>>
+It find_farthest_point_parallel(const Start start, const End end, const location& from, const unsigned threads = 0) {
+    return find_farthest_point_parallel<Distance, It>(It(start), It(end), from, threads);
+}
+
+template <typename Start, typename End, typename It = internal::common_iterator_t<Start, End>>
+prepared_path prepare_path(const Start start, const End end) {
+    return prepare_path<It>(It(start), It(end));
+}
+
+template <typename Distance = distance_model::haversine, typename Start, typename End, typename It = internal::common_iterator_t<Start, End>>
+path_projection project_onto_path(const Start start, const End end, const location& target) {
+    return project_onto_path<Distance, It>(It(start), It(end), target);
+}
+
+template <typename Start, typename End, typename It = internal::common_iterator_t<Start, End>>
+bool to_compact_path(const Start start, const End end, compact_path& out) {
+    return to_compact_path<It>(It(start), It(end), out);
+}
+
+template <typename Start, typename End, typename Out, typename It = internal::common_iterator_t<Start, End>>
+Out smooth(const Start start, const End end, Out out) {
+    return smooth<It, Out>(It(start), It(end), out);
+}
+
+template <typename Start, typename End, typename It = internal::common_iterator_t<Start, End>>
+std::vector<path_value> smooth(const Start start, const End end) {
+    return smooth<It>(It(start), It(end));
+}
+
+template <typename Start, typename End, typename Out, typename It = internal::common_iterator_t<Start, End>>
+Out first_forward_difference(const Start start, const End end, Out out) {
+    return first_forward_difference<It, Out>(It(start), It(end), out);
+}
+
+template <typename Start, typename End, typename It = internal::common_iterator_t<Start, End>>
+std::vector<path_value> first_forward_difference(const Start start, const End end) {
+    return first_forward_difference<It>(It(start), It(end));
+}
+
+template <typename Start, typename End, typename Out, typename It = internal::common_iterator_t<Start, End>>
+Out first_central_difference(const Start start, const End end, Out out) {
+    return first_central_difference<It, Out>(It(start), It(end), out);
+}
+
+template <typename Start, typename End, typename It = internal::common_iterator_t<Start, End>>
+std::vector<path_value> first_central_difference(const Start start, const End end) {
+    return first_central_difference<It>(It(start), It(end));
+}
+
+template <typename Distance = distance_model::haversine, typename Start, typename End, typename It = internal::common_iterator_t<Start, End>>
+path_summary generate_path_summary(const Start start, const End end) {
+    return generate_path_summary<Distance, It>(It(start), It(end));
+}
+
+template <unsigned Flags = analysis::all, typename Distance = distance_model::haversine, typename Start, typename End, typename It = internal::common_iterator_t<Start, End>>
+path_analysis<It> analyze_path(const Start start, const End end) {
+    return analyze_path<Flags, Distance, It>(It(start), It(end));
 }
 
 class stopwatch {
@@ -866,48 +4871,183 @@ inline void print_path_summary(const path& in) {
     }
 }
 
+namespace internal {
+
+inline bool is_space(const char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v';
+}
+
+// Parses a double from the start of [first, last), leading white space is
+// skipped like atof(). Returns a pointer to just after the number or nullptr
+// if there isn't one.
+inline const char* parse_double(const char* first, const char* const last, double& value) {
+    while (first != last && is_space(*first)) {
+        ++first;
+    }
+
+    // from_chars() doesn't accept a leading '+'
+    if (first != last && *first == '+') {
+        ++first;
+    }
+
+    // Fast path for plain decimals like -6.413192, if the digits fit in
+    // the 53 bit mantissa and there are no more than 22 decimal places then
+    // digits / 10^places is exact and correctly rounded, so the result is
+    // the same as from_chars() would give. Anything else goes to from_chars().
+    static constexpr double powers_of_ten[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+    };
+
+    const char* p = first;
+    const bool negative = p != last && *p == '-';
+
+    if (negative) {
+        ++p;
+    }
+
+    unsigned long long digits = 0;
+    int count = 0;
+    int places = 0;
+
+    for (; p != last && static_cast<unsigned>(*p - '0') <= 9; ++p, ++count) {
+        digits = digits * 10 + static_cast<unsigned>(*p - '0');
+    }
+
+    if (p != last && *p == '.') {
+        for (++p; p != last && static_cast<unsigned>(*p - '0') <= 9; ++p, ++count, ++places) {
+            digits = digits * 10 + static_cast<unsigned>(*p - '0');
+        }
+    }
+
+    const bool exponent = p != last && (*p == 'e' || *p == 'E');
+
+    if (count > 0 && count <= 15 && places <= 22 && !exponent) {
+        const double v = static_cast<double>(digits) / powers_of_ten[places];
+        value = negative ? -v : v;
+        return p;
+    }
+
+    const auto result = std::from_chars(first, last, value);
+    return result.ec == std::errc() ? result.ptr : nullptr;
+}
+
+inline bool parse_double(const std::string_view s, double& value) {
+    return parse_double(s.data(), s.data() + s.size(), value) != nullptr;
+}
+
+// Parses an integer from the start of [first, last), leading white space is
+// skipped. Returns a pointer to just after the number or nullptr if there
+// isn't one.
+inline const char* parse_integer(const char* first, const char* const last, long long& value) {
+    while (first != last && is_space(*first)) {
+        ++first;
+    }
+
+    if (first != last && *first == '+') {
+        ++first;
+    }
+
+    const char* p = first;
+    const bool negative = p != last && *p == '-';
+
+    if (negative) {
+        ++p;
+    }
+
+    // Up to 18 digits can't overflow
+    long long v = 0;
+    int count = 0;
+
+    for (; p != last && static_cast<unsigned>(*p - '0') <= 9 && count != 18; ++p, ++count) {
+        v = v * 10 + (*p - '0');
+    }
+
+    if (count > 0 && (p == last || static_cast<unsigned>(*p - '0') > 9)) {
+        value = negative ? -v : v;
+        return p;
+    }
+
+    const auto result = std::from_chars(first, last, value);
+    return result.ec == std::errc() ? result.ptr : nullptr;
+}
+
+inline bool parse_integer(const std::string_view s, long long& value) {
+    return parse_integer(s.data(), s.data() + s.size(), value) != nullptr;
+}
+
+// Skips the comma after a field of a CSV line, returns nullptr if there isn't one
+inline const char* skip_comma(const char* p, const char* const last) {
+    return p && p != last && *p == ',' ? p + 1 : nullptr;
+}
+
+// Parses a line of a GPS logger CSV file, such as
+//
+//      1658184839700,27797,51.872949,-8.582667,40.6,80.57,4,0.00,0.00,0.000,-1,0,0
+//
+// which must start with the timestamp, timestamp delta, lat & lon columns,
+// the elevation column after them is optional.
+inline bool parse_gps_log_line(const char* p, const char* const last, path_point& point) {
+    long long ts;
+    long long tsd;
+    double lat;
+    double lon;
+
+    if (!(p = parse_integer(p, last, ts)) || !(p = skip_comma(p, last)) ||
+        !(p = parse_integer(p, last, tsd)) || !(p = skip_comma(p, last)) ||
+        !(p = parse_double(p, last, lat)) || !(p = skip_comma(p, last)) ||
+        !(p = parse_double(p, last, lon))) {
+        return false;
+    }
+
+    double ele = 0.0;
+
+    if ((p = skip_comma(p, last)) != nullptr) {
+        parse_double(p, last, ele);
+    }
+
+    point.loc = { lat, lon, ele };
+    point.timestamp = path_time(std::chrono::milliseconds(ts));
+
+    return true;
+}
+
+}   // namespace internal
+
 // Quick and Dirty (qd) write path segment to .gpx
 
-// Quick and dirty load of path from csv file.
+//
+// Quick and dirty load of path from a GPS logger csv file, with timestamps,
+// elevation and sequence numbers. Lines that don't start with the timestamp,
+// timestamp delta, lat & lon columns, such as the header, are skipped, and
+// lines without the elevation column after them get an elevation of 0.
+// gps_path_io.h has load_csv_columns() to get at the other columns.
 //
 inline path load_csv_qd(const std::string filename) {
     path out;
-    
-    std::cout << "Loading " << filename << std::endl;
-    
-    std::ifstream fs(filename);
-    
+
+    std::ifstream fs(filename, std::ios::binary);
+
     if (!fs)
         return out;
 
-    std::cout << "loaded" << std::endl;
+    const std::string text((std::istreambuf_iterator<char>(fs)), std::istreambuf_iterator<char>());
+    const char* p = text.data();
+    const char* const last = p + text.size();
 
-    std::string line;
+    while (p != last) {
+        const char* const eol = std::find(p, last, '\n');
+        path_point point;
 
-    location loc{};
-    
-    try {
-        while (getline(fs, line)) { 
-            // 1658184839700,27797,51.872949,-8.582667,40.6,80.57,4,0.00,0.00,0.000,-1,0,0
-            //std::cout << line << std::endl;
-            long long ts;
-            long long tsd;
-            double lat;
-            double lon;
-            
-            if (sscanf(line.c_str(), "%lld,%lld,%lf,%lf", &ts, &tsd, &lat, &lon) == 4) {
-                loc = { lat, lon };
-                out.push_back({ loc });
-            }
-            
+        if (internal::parse_gps_log_line(p, eol, point)) {
+            point.sequence = static_cast<int>(out.size());
+            out.push_back(point);
         }
 
-    } catch (const std::regex_error& ex) {
-        printf("ex: %s %d\n", ex.what(), ex.code()); 
+        p = eol == last ? last : eol + 1;
     }
-    
+
     return out;
 }
 
-
 }   // namespace
\ No newline at end of file
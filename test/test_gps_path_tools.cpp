@@ -4,6 +4,9 @@
 #include <vector>
 #include <cmath>
 #include <iterator>
+#include <cstdlib>
+#include <new>
+#include <random>
 
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 #include "doctest.h"
@@ -13,6 +16,66 @@
 
 using namespace gps_path_tools;
 
+// Counts heap allocations so that tests can check
+// that a function doesn't allocate. Every replaceable
+// form is replaced so that new and delete always match,
+// and they aren't inlined so that the compiler doesn't
+// pair the builtin operator new with free().
+static size_t allocation_count = 0;
+
+__attribute__((noinline)) static void* counted_malloc(size_t size) {
+    ++allocation_count;
+    return std::malloc(size ? size : 1);
+}
+
+__attribute__((noinline)) static void counted_free(void* p) {
+    std::free(p);
+}
+
+void* operator new(size_t size) {
+    if (void* p = counted_malloc(size)) {
+        return p;
+    }
+
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return counted_malloc(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return counted_malloc(size);
+}
+
+void operator delete(void* p) noexcept {
+    counted_free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    counted_free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    counted_free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+    counted_free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept {
+    counted_free(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept {
+    counted_free(p);
+}
+
 // we deem the values to be equal if they are within
 // .01 of each other.
 static bool almost_equal(double val, double target, double delta) {
@@ -119,10 +182,80 @@ static bool iterator_test(const path::iterator value, path::iterator target, pat
         return pass;
 }
 
+static bool path_test(const path& value, const path& target) {
+        auto pass = value.size() == target.size();
+        size_t i = 0;
+
+        for (; pass && i != value.size(); ++i) {
+            const auto& a = value[i];
+            const auto& b = target[i];
+
+            pass = a.loc.lat == b.loc.lat && a.loc.lon == b.loc.lon && a.loc.ele == b.loc.ele &&
+                    a.timestamp == b.timestamp && a.sequence == b.sequence;
+        }
+
+        if (pass) {
+            std::cout << "PASS";
+        } else {
+            std::cout << "FAIL";
+        }
+
+        std::cout << ", got: " << value.size() << " points, target: " << target.size() << " points";
+
+        if (!pass && i != 0) {
+            std::cout << ", first mismatch at point #" << (i - 1);
+        }
+
+        std::cout << std::endl;
+
+        return pass;
+}
+
 static std::string make_data_path(const std::string& file_name) {
     return "../test_data/" + file_name;
 }
 
+// The table mountain loop, loaded once for the tests that repeat it
+static const ::path& table_mountain_loop() {
+    static const auto loop = load_gpx_trk(make_data_path("table_mountain_loop.gpx"));
+    return loop;
+}
+
+// Copies of the table mountain loop, one after the other, at least min_points long
+static ::path make_repeated_loop(const size_t min_points) {
+    const auto& loop = table_mountain_loop();
+    ::path path;
+
+    do {
+        path.insert(path.end(), loop.begin(), loop.end());
+    } while (path.size() < min_points);
+
+    return path;
+}
+
+// A point type of our own, read through path_point_traits
+struct test_fix {
+    double latitude;
+    double longitude;
+    double altitude;
+    long long time_us;
+};
+
+namespace gps_path_tools {
+
+template <>
+struct path_point_traits<test_fix> {
+    static location loc(const test_fix& p) {
+        return { p.latitude, p.longitude, p.altitude };
+    }
+
+    static path_time timestamp(const test_fix& p) {
+        return path_time(std::chrono::microseconds(p.time_us));
+    }
+};
+
+} // namespace gps_path_tools
+
 TEST_CASE("test_to_radians") {
     std::vector<test_point2> test_points = {
         {0.0, 0.0, 0.0000001},
@@ -215,6 +348,35 @@ TEST_CASE("test_str_to_time_utc") {
     }
 }
 
+TEST_CASE("test_parse_time_utc") {
+    // Same results as str_to_time_utc()
+    for (const auto str : { "2022-05-07T15:43:15.999999Z", "2022-05-07T15:43:15.000000Z", "2022-05-07T15:43:15.000001Z",
+                            "2022-05-07T15:43:15.001Z", "2022-05-07T15:43:15Z", "2022-05-07T15:43:15.100015",
+                            "2022-05-07T10:20:06.433Z", "1970-01-01T00:00:00Z", "2000-02-29T23:59:59.5Z",
+                            "2025-11-15T12:10:55.054Z" }) {
+        CHECK(value_test(parse_time_utc(str), str_to_time_utc(str)));
+    }
+
+    std::vector<std::pair<const char*, const char*>> tests = {
+        { "2022-05-07T15:43:15.123456789Z", "2022-05-07T15:43:15.123457Z" },
+        { "2022-05-07T15:43:15.9999996Z", "2022-05-07T15:43:16.000000Z" },
+        { "2022-05-07T16:43:15.5+01:00", "2022-05-07T15:43:15.500000Z" },
+        { "2022-05-07T10:13:15-0530", "2022-05-07T15:43:15.000000Z" },
+        { "2022-05-08T01:43:15+10", "2022-05-07T15:43:15.000000Z" },
+        { "  2022-05-07 15:43:15.25Z", "2022-05-07T15:43:15.250000Z" },
+        { "2022-12-31T23:59:59.75Z", "2022-12-31T23:59:59.750000Z" },
+    };
+
+    for (const auto& test : tests) {
+        CHECK(value_test(time_to_str_utc(parse_time_utc(test.first)), test.second));
+    }
+
+    // Bad input gives the epoch
+    for (const auto str : { "", "2022-05-07", "2022-13-07T15:43:15Z", "2022-05-07X15:43:15Z", "20x2-05-07T15:43:15Z" }) {
+        CHECK(value_test(parse_time_utc(str), path_time{}));
+    }
+}
+
 TEST_CASE("test_distance_vec") {    
     std::vector<test_locations> test_points = {
         { { 52.9827588546699, -6.040081945988319 }, { 52.9827588546699, -6.040081945988319 }, 0, 1 },
@@ -328,6 +490,7 @@ TEST_CASE("test_path_heading") {
     
     auto out = path_heading(path.begin(), path.end());
     CHECK(value_test(out.size(), 6114));    
+    CHECK(value_test(out[10].value, heading(path[10].loc, path[11].loc), 1E-6));
 }
 
 TEST_CASE("test_find_closest_path_point_time") {
@@ -413,6 +576,339 @@ TEST_CASE("test_save_gpx_trk") {
 }
 
 
+TEST_CASE("test_gpx_time_formatter") {
+    internal::time_formatter formatter;
+    char buf[internal::time_formatter::max_size];
+
+    bool same = true;
+
+    // Steps of a little over 7 hours cover all days,
+    // months and leap years over a few decades
+    auto time = str_to_time_utc("1970-01-01T00:00:00.000000Z");
+
+    for (int i = 0; i != 40000; ++i) {
+        time += std::chrono::microseconds(25923456789LL);
+
+        const auto out = std::string(buf, formatter.format(buf, time));
+        same = same && out == time_to_str_utc(time);
+    }
+
+    CHECK(same);
+
+    // Before the epoch falls back to time_to_str_utc()
+    time = str_to_time_utc("1969-12-31T23:59:59.000000Z");
+    CHECK(value_test(std::string(buf, formatter.format(buf, time)), time_to_str_utc(time)));
+}
+
+TEST_CASE("test_save_gpx_trk_format") {
+    path path = {
+        { { 52.988201, -6.413192, 165.56749 }, str_to_time_utc("2022-05-07T10:20:06.433Z") },
+        { { -0.000001234, 179.123456789012, -1e-7 }, str_to_time_utc("2022-05-08T00:00:00.000001Z") },
+    };
+
+    waypoints wp {
+        { "wp1", { 1.5, 2.5, 3.5 }, {}, "comment" },
+    };
+
+    const auto file = make_data_path("test_format.gpx");
+    CHECK(save_gpx_trk(file, path.begin(), path.end(), wp.begin(), wp.end()));
+
+    std::ifstream fs(file);
+    const std::string text((std::istreambuf_iterator<char>(fs)), std::istreambuf_iterator<char>());
+    fs.close();
+    std::remove(file.c_str());
+
+    const auto body = text.substr(text.find("<wpt"));
+
+    CHECK(value_test(body, "<wpt lat=\"1.5\" lon=\"2.5\">\n<ele>3.5</ele>\n<name>wp1</name>\n<cmt>comment</cmt>\n</wpt>\n"
+                            "<trk><trkseg><trkpt lat=\"52.988201\" lon=\"-6.413192\">\n<ele>165.56749</ele>\n"
+                            "<time>2022-05-07T10:20:06.433000Z</time>\n</trkpt>\n"
+                            "<trkpt lat=\"-1.234e-06\" lon=\"179.1234568\">\n<ele>-1e-07</ele>\n"
+                            "<time>2022-05-08T00:00:00.000001Z</time>\n</trkpt>\n"
+                            "</trkseg>\n                            </trk>\n                            </gpx>"));
+}
+
+static std::string read_file(const std::string& file_name) {
+    std::ifstream fs(file_name, std::ios::binary);
+    return std::string((std::istreambuf_iterator<char>(fs)), std::istreambuf_iterator<char>());
+}
+
+TEST_CASE("test_gpx_stream_writer") {
+    auto path = load_gpx_trk(make_data_path("table_mountain_loop.gpx"));
+
+    waypoints wp {
+        {"wp1", path[0].loc , path[0].timestamp, "wp1"},
+        {"wp2", path[1].loc, path[1].timestamp, "wp2"},       
+    };
+
+    const auto saved = make_data_path("test_stream_saved.gpx");
+    const auto streamed = make_data_path("test_stream.gpx");
+
+    save_gpx_trk(saved, path.begin(), path.end(), wp.begin(), wp.end());
+
+    {
+        // Small buffer so that it is written out many times
+        gpx_stream_writer writer(streamed, 1000);
+        CHECK(writer.good());
+
+        CHECK(writer.add(wp.cbegin(), wp.cend()));
+        CHECK(writer.add(path.cbegin(), path.cbegin() + 100));
+
+        for (auto i = path.cbegin() + 100; i != path.cend(); ++i) {
+            CHECK(writer.add(*i));
+        }
+    }
+
+    // Same output as save_gpx_trk()
+    CHECK(read_file(streamed) == read_file(saved));
+
+    // Waypoints added once the track has started are rejected
+    {
+        gpx_stream_writer writer(streamed);
+        CHECK(writer.add(path.cbegin(), path.cbegin() + 10));
+        CHECK(!writer.add(wp[0]));
+        CHECK(!writer.add(wp.cbegin(), wp.cend()));
+        CHECK(writer.add(path.cbegin() + 10, path.cend()));
+
+        CHECK(writer.finish());
+
+        // Nothing more after finish()
+        CHECK(!writer.add(path[0]));
+        CHECK(!writer.add(path.cbegin(), path.cbegin() + 10));
+        CHECK(!writer.add(wp[0]));
+    }
+
+    const auto text = read_file(streamed);
+    CHECK(text.find("<wpt") == std::string::npos);
+
+    CHECK(path_test(load_gpx_trk(streamed), path));
+
+    std::remove(saved.c_str());
+    std::remove(streamed.c_str());
+}
+
+TEST_CASE("test_path_bin") {
+    auto path = load_gpx_trk(make_data_path("table_mountain_loop.gpx"));
+
+    waypoints wp {
+        {"wp1", path[0].loc , path[0].timestamp, "wp1 comment"},
+        {"", path[1].loc, {}, ""},
+    };
+
+    const auto file = make_data_path("test_path.bin");
+
+    CHECK(save_path_bin(file, path.begin(), path.end(), wp.begin(), wp.end()));
+
+    {
+        ::path loaded;
+        waypoints loaded_wp;
+        CHECK(load_path_bin(file, loaded, loaded_wp));
+        CHECK(path_test(loaded, path));
+        CHECK(value_test((int)loaded_wp.size(), 2));
+        CHECK(value_test(loaded_wp[0].name, "wp1"));
+        CHECK(value_test(loaded_wp[0].cmt, "wp1 comment"));
+        CHECK(value_test(loaded_wp[0].timestamp, path[0].timestamp));
+        CHECK(value_test(loaded_wp[1].loc, path[1].loc, 0.000000001));
+
+        // Loading again replaces the points rather than appending to them
+        CHECK(load_path_bin(file, loaded, loaded_wp));
+        CHECK(path_test(loaded, path));
+        CHECK(value_test((int)loaded_wp.size(), 2));
+    }
+
+    // More points than fit in one block
+    ::path big;
+
+    for (int i = 0; i != 70; ++i) {
+        big.insert(big.end(), path.begin(), path.end());
+    }
+
+    for (size_t i = 0; i != big.size(); ++i) {
+        big[i].sequence = (int)i;
+    }
+
+    CHECK(save_path_bin(file, big.begin(), big.end()));
+    CHECK(path_test(load_path_bin(file), big));
+
+    {
+        // Read in place
+        path_bin_view view(file);
+        CHECK(view.is_open());
+        CHECK(view.verify());
+        CHECK(value_test((int)view.size(), (int)big.size()));
+        CHECK(value_test((int)view.block_count(), 7));
+
+        const auto block = view.block(6);
+        CHECK(value_test(block.lat[0], big[6 * 65536].loc.lat, 0.000000001));
+        CHECK(value_test(view[300000].sequence, 300000));
+        CHECK(value_test(view[300000].timestamp, big[300000].timestamp));
+    }
+
+    // Corrupt a point, the checksums should catch it
+    {
+        std::fstream fs(file, std::ios::in | std::ios::out | std::ios::binary);
+        fs.seekp(100000);
+        fs.put('x');
+    }
+
+    CHECK(load_path_bin(file).empty());
+
+    // Without checksums
+    CHECK(save_path_bin(file, path.begin(), path.end(), false));
+    CHECK(path_test(load_path_bin(file), path));
+
+    // Empty path
+    ::path empty;
+    CHECK(save_path_bin(file, empty.begin(), empty.end()));
+    CHECK(path_test(load_path_bin(file), empty));
+
+    // Crafted headers, the point counts at offset 16 and block size at 24
+    const auto craft = [&](const uint64_t points, const uint32_t block_points) {
+        CHECK(save_path_bin(file, path.begin(), path.end()));
+
+        std::fstream fs(file, std::ios::in | std::ios::out | std::ios::binary);
+
+        for (int i = 0; i != 8; ++i) {
+            fs.seekp(16 + i);
+            fs.put(static_cast<char>(points >> (8 * i)));
+        }
+
+        for (int i = 0; i != 4; ++i) {
+            fs.seekp(24 + i);
+            fs.put(static_cast<char>(block_points >> (8 * i)));
+        }
+    };
+
+    craft(0, 0);
+    CHECK(load_path_bin(file).empty());
+    CHECK(!path_bin_view(file).is_open());
+
+    craft(uint64_t{1} << 62, 1);
+    CHECK(load_path_bin(file).empty());
+    CHECK(!path_bin_view(file).is_open());
+
+    craft(uint64_t{1} << 40, 65536);
+    CHECK(load_path_bin(file).empty());
+
+    craft(path.size() * 2, 65536);
+    CHECK(load_path_bin(file).empty());
+    CHECK(!path_bin_view(file).is_open());
+
+    craft(path.size(), 1);
+    CHECK(load_path_bin(file).empty());
+
+    // Not a binary path file
+    CHECK(load_path_bin(make_data_path("test.gpx")).empty());
+    CHECK(!path_bin_view(make_data_path("no_such_file.bin")).is_open());
+
+    std::remove(file.c_str());
+}
+
+TEST_CASE("test_compressed_path") {
+    for (const auto name : { "table_mountain_loop.gpx", "knocknalogha_moot_25.gpx" }) {
+        const auto path = load_gpx_trk(make_data_path(name));
+        const auto compressed = compress_path(path.begin(), path.end(), 256);
+
+        CHECK(value_test((int)compressed.size, (int)path.size()));
+        CHECK(value_test((int)compressed.block_count(), (int)(path.size() + 255) / 256));
+
+        // Around 6 bytes a point against 36 for save_path_bin()
+        const auto bytes_per_point = (double)compressed.data.size() / (double)path.size();
+        CHECK(bytes_per_point < 7.5);
+
+        // Within the quantisation
+        const auto out = decompress_path(compressed);
+        CHECK(value_test((int)out.size(), (int)path.size()));
+
+        bool close = out.size() == path.size();
+
+        for (size_t i = 0; close && i != out.size(); ++i) {
+            close = almost_equal(out[i].loc.lat, path[i].loc.lat, 0.51E-7) && almost_equal(out[i].loc.lon, path[i].loc.lon, 0.51E-7) &&
+                    almost_equal(out[i].loc.ele, path[i].loc.ele, 0.0051) &&
+                    std::chrono::abs(out[i].timestamp - path[i].timestamp) < std::chrono::milliseconds(1) &&
+                    out[i].sequence == path[i].sequence;
+        }
+
+        CHECK(close);
+
+        // Random access to a block
+        ::path block;
+        decompress_block(compressed, 3, block);
+        CHECK(value_test((int)block.size(), 256));
+        CHECK(value_test(block.front().sequence, 3 * 256));
+        CHECK(value_test(block.back().timestamp, out[4 * 256 - 1].timestamp));
+
+        // Save and load
+        const auto file = make_data_path("test_path.cmp");
+        compressed_path loaded;
+        CHECK(save_compressed_path(file, compressed));
+        CHECK(load_compressed_path(file, loaded));
+        CHECK(path_test(decompress_path(loaded), out));
+        std::remove(file.c_str());
+    }
+
+    // Crafted files, the data size is at offset 24 and
+    // block i's offset and count at 32 + i * 12
+    {
+        const auto loop = load_gpx_trk(make_data_path("table_mountain_loop.gpx"));
+        const auto compressed = compress_path(loop.begin(), loop.end(), 256);
+        const auto file = make_data_path("test_path.cmp");
+
+        const auto craft = [&](const size_t at, const uint64_t value, const int bytes) {
+            CHECK(save_compressed_path(file, compressed));
+
+            std::fstream fs(file, std::ios::in | std::ios::out | std::ios::binary);
+
+            for (int i = 0; i != bytes; ++i) {
+                fs.seekp(static_cast<std::streamoff>(at) + i);
+                fs.put(static_cast<char>(value >> (8 * i)));
+            }
+        };
+
+        compressed_path loaded;
+
+        // Block 0 at the end of the data
+        craft(32, compressed.data.size(), 8);
+        CHECK(!load_compressed_path(file, loaded));
+
+        // Blocks out of order
+        craft(32 + 2 * 12, compressed.blocks[1].offset, 8);
+        CHECK(!load_compressed_path(file, loaded));
+
+        // A data size that wraps when added to the index size
+        craft(24, ~uint64_t{0} - 10, 8);
+        CHECK(!load_compressed_path(file, loaded));
+
+        // Counts that don't add up to the number of points
+        craft(32 + 12 + 8, 300, 4);
+        CHECK(!load_compressed_path(file, loaded));
+
+        craft(32 + 12 + 8, 0, 4);
+        CHECK(!load_compressed_path(file, loaded));
+
+        craft(16, loop.size() + 1, 8);
+        CHECK(!load_compressed_path(file, loaded));
+
+        // Unchanged
+        craft(16, loop.size(), 8);
+        CHECK(load_compressed_path(file, loaded));
+        CHECK(decompress_path(loaded).size() == loop.size());
+
+        std::remove(file.c_str());
+    }
+
+    // Non consecutive sequence numbers and a single point block
+    ::path path = {
+        { { 52.988201, -6.413192, 1.0 }, {}, 5 },
+        { { 52.988222, -6.413189, -2.0 }, {}, 3 },
+        { { -52.98821, 170.413156, 3.0 }, {}, 100 },
+    };
+
+    CHECK(path_test(decompress_path(compress_path(path.begin(), path.end(), 2)), decompress_path(compress_path(path.begin(), path.end(), 1))));
+    CHECK(value_test(decompress_path(compress_path(path.begin(), path.end(), 2))[2].sequence, 100));
+    CHECK(value_test(decompress_path(compress_path(path.begin(), path.end(), 2))[2].loc.lon, 170.413156, 0.0000001));
+}
+
 TEST_CASE("test_cardinal_direction") {
 
     CHECK(value_test(cardinal_direction(1.0), "N"));
@@ -453,6 +949,159 @@ TEST_CASE("test_load_gpx_trk") {
     CHECK(value_test(out, 16964, 0.5));  // 16.9Km
 }
 
+TEST_CASE("test_load_gpx_trk_mmap") {
+    for (const auto name : { "table_mountain_loop.gpx", "knocknalogha_moot_25.gpx", "test.gpx" }) {
+        auto path = load_gpx_trk_mmap(make_data_path(name));
+        CHECK(path_test(path, load_gpx_trk(make_data_path(name))));
+    }
+
+    // Missing file
+    auto path = load_gpx_trk_mmap(make_data_path("no_such_file.gpx"));
+    CHECK(path.empty());
+}
+
+TEST_CASE("test_tag_scanner") {
+    const std::string gpx = R"(<trkpt lat="52.988201" lon="-6.413192">
+        <ele>165.56749</ele>
+        <time>2022-05-07T10:20:06.433Z</time>
+      </trkpt>)";
+
+    // Try every start offset so that the SIMD paths see the
+    // matches at every position within a block and in the tail.
+    for (const auto backend : { internal::scan_backend::scalar, internal::scan_backend::sse2, internal::scan_backend::avx2 }) {
+        const auto& scanner = internal::get_tag_scanner(backend);
+        const auto& reference = internal::get_tag_scanner(internal::scan_backend::scalar);
+        const auto end = gpx.data() + gpx.size();
+
+        bool same = true;
+
+        for (size_t i = 0; i != gpx.size(); ++i) {
+            const auto p = gpx.data() + i;
+
+            same = same && scanner.find_char(p, end, '<') == reference.find_char(p, end, '<');
+            same = same && scanner.find_char(p, end, '>') == reference.find_char(p, end, '>');
+
+            for (const auto tag : { "<trkpt", "</ele>", "</time>", "</trkpt>" }) {
+                same = same && scanner.find_tag(p, end, tag, strlen(tag)) == reference.find_tag(p, end, tag, strlen(tag));
+            }
+        }
+
+        CHECK(same);
+
+        CHECK(scanner.find_tag(gpx.data(), end, "</time>", 7) - gpx.data() == (long)gpx.find("</time>"));
+    }
+
+    // Parse with each backend, feeding the file in small pieces
+    // so that tags are split across pieces.
+    const auto file = make_data_path("table_mountain_loop.gpx");
+    const auto reference = load_gpx_trk(file);
+
+    std::ifstream fs(file, std::ios::binary);
+    const std::string text((std::istreambuf_iterator<char>(fs)), std::istreambuf_iterator<char>());
+
+    for (const auto backend : { internal::scan_backend::scalar, internal::scan_backend::sse2, internal::scan_backend::avx2 }) {
+        internal::gpx_trk_parser parser;
+        parser.scanner = &internal::get_tag_scanner(backend);
+
+        path out;
+        std::string pending;
+
+        for (size_t i = 0; i < text.size(); i += 997) {
+            pending.append(text, i, 997);
+            pending.erase(0, parser.parse(pending, out));
+        }
+
+        CHECK(path_test(out, reference));
+    }
+}
+
+TEST_CASE("test_load_gpx_trk_parallel") {
+    for (const auto name : { "table_mountain_loop.gpx", "knocknalogha_moot_25.gpx" }) {
+        const auto file = make_data_path(name);
+        const auto reference = load_gpx_trk(file);
+
+        CHECK(path_test(load_gpx_trk_parallel(file), reference));
+
+        // Force lots of small chunks
+        const internal::mapped_file mapped(file);
+
+        for (const unsigned threads : { 1, 2, 3, 8 }) {
+            CHECK(path_test(internal::parse_gpx_trk_parallel(mapped.view(), threads, 1000), reference));
+        }
+    }
+
+    // Points with missing values carry them over from the previous
+    // point, including across chunk boundaries.
+    std::string gpx = "<gpx><trk><trkseg>";
+
+    for (int i = 0; i != 200; ++i) {
+        gpx += "<trkpt lat=\"" + std::to_string(i) + "\" lon=\"1\">";
+
+        if (i % 50 == 10) {
+            gpx += "<ele>" + std::to_string(i) + "</ele><time>2022-05-07T10:20:" + std::to_string(i % 60) + "Z</time>";
+        }
+
+        gpx += "</trkpt>\n";
+    }
+
+    gpx += "</trkseg></trk></gpx>";
+
+    path reference;
+    internal::gpx_trk_parser parser;
+    parser.parse(gpx, reference);
+
+    CHECK(value_test((int)reference.size(), 200));
+    CHECK(value_test(reference[70].loc.ele, 60.0, 0.0000001));
+
+    for (const unsigned threads : { 2, 4, 16 }) {
+        CHECK(path_test(internal::parse_gpx_trk_parallel(gpx, threads, 100), reference));
+    }
+}
+
+TEST_CASE("test_gpx_trk_reader") {
+    const auto file = make_data_path("table_mountain_loop.gpx");
+    const auto reference = load_gpx_trk(file);
+
+    // A tiny buffer so that tags are split across reads
+    {
+        gpx_trk_reader reader(file, false, 100);
+        CHECK(reader.is_open());
+
+        path all;
+        path batch;
+
+        while (reader.next(batch, 100)) {
+            CHECK(batch.size() <= 100);
+            all.insert(all.end(), batch.begin(), batch.end());
+        }
+
+        CHECK(path_test(all, reference));
+    }
+
+    // Reductions over overlapping batches
+    double dist = 0.0;
+    double ascent = 0.0;
+    double descent = 0.0;
+    size_t batches = 0;
+
+    CHECK(for_each_gpx_trk_batch(file, [&](const path& batch) {
+        auto [min_it, max_it, up, down] = path_elevation_summary(batch.begin(), batch.end());
+        dist += path_distance(batch.begin(), batch.end());
+        ascent += up;
+        descent += down;
+        ++batches;
+    }, true, 1000));
+
+    auto [min_it, max_it, up, down] = path_elevation_summary(reference.begin(), reference.end());
+
+    CHECK(value_test((int)batches, 7));
+    CHECK(value_test(dist, path_distance(reference.begin(), reference.end()), 0.000001));
+    CHECK(value_test(ascent, up, 0.000001));
+    CHECK(value_test(descent, down, 0.000001));
+
+    CHECK(!for_each_gpx_trk_batch(make_data_path("no_such_file.gpx"), [](const path&) {}));
+}
+
 TEST_CASE("test_load_gpx_trk1") {
     auto path = load_gpx_trk(make_data_path("knocknalogha_moot_25.gpx"));
     
@@ -479,16 +1128,143 @@ TEST_CASE("test_load_csv_qd") {
 
     CHECK(value_test(path.size(), 2010));
 
+    // The same points as the columnar loader
+    const auto table_path = csv_table_to_path(load_csv_columns(make_data_path("pass4_gps_track_log_24_08_2022.csv"), gps_log_csv_schema()));
+    CHECK(path_test(path, table_path));
+
+    // The elevation column is optional
+    const std::string file = "./qd_no_elevation.csv";
+    {
+        std::ofstream out(file);
+        out << "timestamp,timestamp_delta,lat,lon\n";
+        out << "1658184839700,27797,51.872949,-8.582667\n";
+        out << "1658184840700,1000,51.872959,-8.582677,40.6\r\n";
+        out << "not,a,gps,line\n";
+        out << "1658184841700,1000,51.872969,-8.582687";
+    }
+
+    const auto short_lines = load_csv_qd(file);
+    std::remove(file.c_str());
+
+    REQUIRE(short_lines.size() == 3);
+    CHECK(short_lines[0].loc.lat == 51.872949);
+    CHECK(short_lines[0].loc.ele == 0.0);
+    CHECK(short_lines[1].loc.ele == 40.6);
+    CHECK(short_lines[2].loc.lon == -8.582687);
+    CHECK(short_lines[2].sequence == 2);
+    CHECK(short_lines[2].timestamp == path_time(std::chrono::milliseconds(1658184841700LL)));
+
     save_gpx_trk("test_gps_log.gpx", path.begin()+60, path.end());
 }
 
+TEST_CASE("test_parse_number") {
+    // The fast path must give exactly the same results as from_chars()
+    std::vector<std::string> tests = { "0", "-0", "1", "52.988201", "-6.413192", "165.56749", "263.5514879999982",
+                                        "179.0823679999559", ".5", "5.", "1e-7", "1.5E3", "123456789012345678901234",
+                                        "0.1234567890123456789", "-0.000001234", "9007199254740993", "nan", "inf" };
+
+    unsigned long long seed = 12345;
+
+    for (int i = 0; i != 20000; ++i) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        auto digits = std::to_string(seed >> (seed % 40));
+        auto point = (seed >> 20) % (digits.size() + 1);
+        digits.insert(point, ".");
+        tests.push_back(((seed >> 30) & 1 ? "-" : "") + digits);
+    }
+
+    bool same = true;
+
+    for (const auto& t : tests) {
+        double value = 0.0;
+        double target = 0.0;
+        const auto ok = internal::parse_double(t, value);
+        const auto target_ok = std::from_chars(t.data(), t.data() + t.size(), target).ec == std::errc();
+
+        same = same && ok == target_ok && (!ok || std::memcmp(&value, &target, sizeof(double)) == 0 || (std::isnan(value) && std::isnan(target)));
+    }
+
+    CHECK(same);
+
+    long long value = 0;
+    CHECK((internal::parse_integer(" 1661332353550", value) && value == 1661332353550LL));
+    CHECK((internal::parse_integer("-375", value) && value == -375));
+    CHECK((internal::parse_integer("9223372036854775807", value) && value == 9223372036854775807LL));
+    CHECK(!internal::parse_integer("x1", value));
+    CHECK(!internal::parse_integer("99999999999999999999", value));
+}
+
+TEST_CASE("test_load_csv_columns") {
+    const auto file = make_data_path("pass4_gps_track_log_24_08_2022.csv");
+    const auto table = load_csv_columns(file, gps_log_csv_schema());
+
+    CHECK(value_test((int)table.rows, 2010));
+    CHECK(value_test((int)table.columns.size(), 13));
+
+    // 1661332353550,-375,53.429936,-6.955620,130.4,181.83,4,-0.71,-0.30,10.101,-1,0,0
+    CHECK(table.column("timestamp")->integers.front() == 1661332353550LL);
+    CHECK(value_test(table.column("lat")->reals.front(), 53.429936, 0.0000001));
+    CHECK(value_test(table.column("heading")->reals.front(), 181.83, 0.0000001));
+    CHECK(value_test(table.column("acc_z")->reals.front(), 10.101, 0.0000001));
+
+    // 1661332462449,-372,53.430173,-6.922811,141.3,93.98,4,-0.17,-0.35,8.358,1881,1661332462144,3
+    CHECK(value_test((int)table.column("frame")->integers.back(), 1881));
+    CHECK(table.column("image_timestamp")->integers.back() == 1661332462144LL);
+    CHECK(value_test((int)table.column("gps_fix")->integers.back(), 4));
+    CHECK(table.column("no_such_column") == nullptr);
+
+    for (const auto& c : table.columns) {
+        CHECK(value_test((int)(c.type == csv_type::integer ? c.integers.size() : c.reals.size()), 2010));
+    }
+
+    // Big enough to be split up between threads
+    {
+        const std::string big_file = make_data_path("test_big.csv");
+        const auto text = read_file(file);
+
+        {
+            std::ofstream out(big_file, std::ios::binary);
+
+            for (int i = 0; i != 100; ++i) {
+                out << text;
+            }
+        }
+
+        const auto single = load_csv_columns(big_file, gps_log_csv_schema(), 1);
+        const auto multi = load_csv_columns(big_file, gps_log_csv_schema(), 4);
+        std::remove(big_file.c_str());
+
+        CHECK(value_test((int)single.rows, 201000));
+        CHECK(value_test((int)multi.rows, 201000));
+
+        bool same = true;
+
+        for (size_t c = 0; c != single.columns.size(); ++c) {
+            same = same && single.columns[c].integers == multi.columns[c].integers && single.columns[c].reals == multi.columns[c].reals;
+        }
+
+        CHECK(same);
+    }
+
+    // Only some of the columns
+    const auto partial = load_csv_columns(file, { { "timestamp", csv_type::integer }, { "", csv_type::skip }, { "lat", csv_type::real } });
+    CHECK(value_test((int)partial.rows, 2010));
+    CHECK(value_test((int)partial.columns.size(), 2));
+
+    const auto path = csv_table_to_path(table);
+    CHECK(value_test(path.back().loc.lon, -6.922811, 0.0000001));
+    CHECK(value_test(path.back().loc.ele, 141.3, 0.0000001));
+    CHECK(time_to_us(path.back().timestamp) == 1661332462449000LL);
+    CHECK(value_test(path.back().sequence, 2009));
+}
+
 TEST_CASE("test_generate_path_summary") {
     auto path = load_gpx_trk(make_data_path("table_mountain_loop.gpx"));
 
     auto summary = generate_path_summary(path.begin(), path.end());
     CHECK(value_test(summary.points, 6115));
     CHECK(value_test(summary.start_time, time_to_str_utc(path.begin()->timestamp)));
-    CHECK(value_test(summary.end_time, time_to_str_utc(path.end()->timestamp)));
+    CHECK(value_test(summary.end_time, time_to_str_utc(path.back().timestamp)));
     CHECK(value_test(summary.duration_s, duration_to_seconds(path.front().timestamp, path.back().timestamp)));
     CHECK(value_test(summary.distance_m, path_distance(path.begin(), path.end())));
 }
@@ -555,6 +1331,910 @@ TEST_CASE("test_path_elevation_summary") {
     std::cout << "UP: " << cumulative_ascent << ", DOWN: " << cumulative_descent << std::endl;
 }
 
+TEST_CASE("test_path_soa") {
+    auto path = load_gpx_trk(make_data_path("table_mountain_loop.gpx"));
+    const auto soa = to_path_soa(path.begin(), path.end());
+
+    CHECK(value_test((int)soa.size(), (int)path.size()));
+    CHECK(path_test(to_path(soa), path));
+
+    {
+        auto [nw, ne, se, sw] = axis_aligned_bounding_box(soa);
+        auto [nw2, ne2, se2, sw2] = axis_aligned_bounding_box(path.begin(), path.end());
+        CHECK(value_test(nw, nw2, 1E-9));
+        CHECK(value_test(ne, ne2, 1E-9));
+        CHECK(value_test(se, se2, 1E-9));
+        CHECK(value_test(sw, sw2, 1E-9));
+    }
+
+    CHECK(value_test(path_distance(soa), path_distance(path.begin(), path.end()), 1E-6));
+    CHECK(value_test((int)find_farthest_point(soa, path.front().loc), 4048));
+
+    {
+        auto [min_index, max_index, ascent, descent] = path_elevation_summary(soa);
+        auto [min_it, max_it, ascent2, descent2] = path_elevation_summary(path.begin(), path.end());
+        CHECK(value_test((int)min_index, (int)(min_it - path.begin())));
+        CHECK(value_test((int)max_index, (int)(max_it - path.begin())));
+        CHECK(value_test(ascent, ascent2, 1E-6));
+        CHECK(value_test(descent, descent2, 1E-6));
+    }
+
+    // Empty and single point paths
+    path_soa empty;
+    CHECK(value_test(path_distance(empty), 0.0, 1E-9));
+    CHECK(find_farthest_point(empty, path.front().loc) == 0);
+    CHECK(std::get<0>(path_elevation_summary(empty)) == 0);
+
+    path_soa one;
+    one.push_back(path.front());
+    CHECK(value_test(path_distance(one), 0.0, 1E-9));
+    CHECK(find_farthest_point(one, path.back().loc) == 0);
+    CHECK(std::get<1>(path_elevation_summary(one)) == 1);
+    CHECK(value_test(std::get<0>(axis_aligned_bounding_box(one)), { path.front().loc.lat, path.front().loc.lon }, 1E-9));
+}
+
+TEST_CASE("test_compact_path") {
+    CHECK(sizeof(compact_path_point) == 16);
+
+    auto path = load_gpx_trk(make_data_path("table_mountain_loop.gpx"));
+
+    compact_path compact;
+    CHECK(to_compact_path(path.begin(), path.end(), compact));
+    CHECK(value_test((int)compact.size(), (int)path.size()));
+
+    // Within the precision of the compact points
+    const auto decoded = to_path(compact);
+    bool close = decoded.size() == path.size();
+
+    for (size_t i = 0; close && i != decoded.size(); ++i) {
+        close = almost_equal(decoded[i].loc.lat, path[i].loc.lat, 0.51E-7) && almost_equal(decoded[i].loc.lon, path[i].loc.lon, 0.51E-7) &&
+                almost_equal(decoded[i].loc.ele, path[i].loc.ele, 0.0001) &&
+                std::chrono::abs(decoded[i].timestamp - path[i].timestamp) < std::chrono::milliseconds(1) &&
+                decoded[i].sequence == path[i].sequence;
+    }
+
+    CHECK(close);
+
+    // The path functions give the same results as on the decoded path
+    CHECK(value_test(path_distance(compact.begin(), compact.end()), path_distance(decoded.begin(), decoded.end()), 1E-9));
+    CHECK(value_test(path_distance(compact.begin(), compact.end()), path_distance(path.begin(), path.end()), 0.01));
+
+    {
+        auto [nw, ne, se, sw] = axis_aligned_bounding_box(compact.begin(), compact.end());
+        auto [nw2, ne2, se2, sw2] = axis_aligned_bounding_box(decoded.begin(), decoded.end());
+        CHECK(value_test(nw, nw2, 1E-9));
+        CHECK(value_test(se, se2, 1E-9));
+    }
+
+    {
+        auto [min_it, max_it, ascent, descent] = path_elevation_summary(compact.begin(), compact.end());
+        auto [min_it2, max_it2, ascent2, descent2] = path_elevation_summary(decoded.begin(), decoded.end());
+        CHECK(value_test((int)(min_it - compact.begin()), (int)(min_it2 - decoded.begin())));
+        CHECK(value_test((int)(max_it - compact.begin()), (int)(max_it2 - decoded.begin())));
+        CHECK(value_test(ascent, ascent2, 1E-9));
+        CHECK(value_test(descent, descent2, 1E-9));
+    }
+
+    CHECK(value_test((int)(find_farthest_point(compact.begin(), compact.end(), path.front().loc) - compact.begin()), 4048));
+    CHECK(value_test((int)(find_closest_path_point_time(compact.begin(), compact.end(), path[100].timestamp) - compact.begin()), 100));
+    CHECK(value_test((int)(find_closest_path_point_dist(compact.begin(), compact.end(), path[200].loc) - compact.begin()), 200));
+    CHECK(value_test((int)path_speed(compact.begin(), compact.end()).size(), (int)path.size() - 1));
+    CHECK(value_test(path_heading(compact.begin(), compact.end())[10].value, path_heading(decoded.begin(), decoded.end())[10].value, 1E-9));
+
+    {
+        auto [start, end] = find_stationary_points(compact.begin(), compact.end(), 10, 2 * 60);
+        auto [start2, end2] = find_stationary_points(decoded.begin(), decoded.end(), 10, 2 * 60);
+        CHECK(value_test((int)(start - compact.begin()), (int)(start2 - decoded.begin())));
+        CHECK(value_test((int)(end - compact.begin()), (int)(end2 - decoded.begin())));
+    }
+
+    const auto summary = generate_path_summary(compact.begin(), compact.end());
+    CHECK(value_test(summary.end_time, time_to_str_utc(decoded.back().timestamp)));
+
+    // A timestamp too far from the first
+    compact_path short_path;
+    CHECK(short_path.push_back(path.front()));
+    CHECK(!short_path.push_back({ path.front().loc, path.front().timestamp + std::chrono::hours(24 * 30), 1 }));
+    CHECK(value_test((int)short_path.size(), 1));
+}
+
+TEST_CASE("test_generic_path_functions") {
+    const auto path = load_gpx_trk(make_data_path("table_mountain_loop.gpx"));
+
+    // Our own point type
+    std::vector<test_fix> fixes;
+
+    for (const auto& p : path) {
+        fixes.push_back({ p.loc.lat, p.loc.lon, p.loc.ele, time_to_us(p.timestamp) });
+    }
+
+    const auto& reference = path;
+
+    CHECK(value_test(path_distance(fixes.begin(), fixes.end()), path_distance(reference.begin(), reference.end()), 1E-9));
+    CHECK(value_test(path_distance(fixes), path_distance(reference), 1E-9));
+    CHECK(value_test((int)(find_farthest_point(fixes, reference.front().loc) - fixes.begin()), (int)(find_farthest_point(reference, reference.front().loc) - reference.begin())));
+    CHECK(value_test((int)(find_closest_path_point_time(fixes, path[50].timestamp) - fixes.begin()), 50));
+    CHECK(value_test(std::get<2>(path_elevation_summary(fixes)), std::get<2>(path_elevation_summary(reference)), 1E-9));
+    CHECK(value_test(std::get<0>(axis_aligned_bounding_box(fixes)), std::get<0>(axis_aligned_bounding_box(reference)), 1E-9));
+    CHECK(value_test(path_speed(fixes)[7].value, path_speed(reference)[7].value, 1E-9));
+    CHECK(value_test(generate_path_summary(fixes).distance_m, generate_path_summary(reference).distance_m, 1E-9));
+
+    // Const iterators, pointers and const ranges
+    const auto target = path[300].loc;
+    CHECK(value_test((int)(find_closest_path_point_dist(path.cbegin(), path.cend(), target) - path.cbegin()), 300));
+    CHECK(value_test((int)(find_closest_path_point_dist(path, target) - path.begin()), 300));
+    CHECK(value_test((int)(find_closest_path_point_dist(path.data(), path.data() + path.size(), target) - path.data()), 300));
+    CHECK(value_test(path_distance(path.data(), path.data() + path.size()), path_distance(path.begin(), path.end()), 1E-9));
+
+    // Mixed iterators, e.g. cbegin() & end() of a path that isn't const
+    ::path mixed(path);
+    const auto from = path[0].loc;
+    CHECK(path_distance(mixed.cbegin(), mixed.end()) == path_distance(path));
+    CHECK(path_distance<distance_model::flat_earth>(mixed.begin(), mixed.cend()) == path_distance<distance_model::flat_earth>(path));
+    CHECK(find_farthest_point(mixed.cbegin(), mixed.end(), from) - mixed.cbegin() == find_farthest_point(path, from) - path.begin());
+    CHECK(find_closest_path_point_dist(mixed.begin(), mixed.cend(), target) - mixed.cbegin() == 300);
+    CHECK(std::get<2>(path_elevation_summary(mixed.cbegin(), mixed.end())) == std::get<2>(path_elevation_summary(path)));
+    CHECK(path_speed(mixed.cbegin(), mixed.end()).size() == path.size() - 1);
+    CHECK(analyze_path<analysis::distance>(mixed.cbegin(), mixed.end()).distance_m == path_distance(path));
+
+    // Waypoints have loc & timestamp too
+    waypoints way = { { "a", path[0].loc }, { "b", path[4048].loc }, { "c", path[100].loc } };
+    CHECK(value_test((int)(find_farthest_point(way, path[0].loc) - way.begin()), 1));
+
+    // The helper functions on const path values
+    const auto speeds = path_speed(path);
+    const auto central = first_central_difference(speeds.begin(), speeds.end());
+    CHECK(value_test((int)central.size(), (int)speeds.size() - 2));
+    CHECK(value_test(central[0].value, (speeds[2].value - speeds[0].value) / 2.0, 1E-9));
+}
+
+TEST_CASE("test_series_output_iterators") {
+    const auto path = load_gpx_trk(make_data_path("table_mountain_loop.gpx"));
+    const auto n = path.size();
+
+    const auto heading = path_heading(path);
+    const auto speed = path_speed(path);
+    const auto distance = path_cumulative_distance(path);
+    const auto smoothed = smooth(speed.begin(), speed.end());
+    const auto forward = first_forward_difference(speed.begin(), speed.end());
+    const auto central = first_central_difference(speed.begin(), speed.end());
+
+    std::vector<path_value> buffer(n);
+    std::vector<path_value> values(n);
+
+    const auto same = [&buffer](const path_value* end, const std::vector<path_value>& target) {
+        return static_cast<size_t>(end - buffer.data()) == target.size() &&
+                std::equal(target.begin(), target.end(), buffer.data(), [](const path_value& a, const path_value& b) {
+                    return a.value == b.value && a.timestamp == b.timestamp;
+                });
+    };
+
+    // None of these allocate
+    const auto allocations = allocation_count;
+
+    CHECK(same(path_heading(path.begin(), path.end(), buffer.data()), heading));
+    CHECK(same(path_speed(path.begin(), path.end(), buffer.data()), speed));
+    CHECK(same(path_cumulative_distance(path.begin(), path.end(), buffer.data()), distance));
+    CHECK(same(smooth(speed.begin(), speed.end(), buffer.data()), smoothed));
+    CHECK(same(first_forward_difference(speed.begin(), speed.end(), buffer.data()), forward));
+    CHECK(same(first_central_difference(speed.begin(), speed.end(), buffer.data()), central));
+
+    std::copy(speed.begin(), speed.end(), values.begin());
+    smooth_in_place(values.begin(), values.begin() + static_cast<std::ptrdiff_t>(speed.size()));
+
+    CHECK(value_test((int)(allocation_count - allocations), 0));
+
+    // In place leaves the ends as they were
+    CHECK(value_test(values.front().value, speed.front().value, 1E-12));
+    CHECK(value_test(values[speed.size() - 1].value, speed.back().value, 1E-12));
+    CHECK(std::equal(smoothed.begin(), smoothed.end(), values.begin() + 1, [](const path_value& a, const path_value& b) {
+        return a.value == b.value && a.timestamp == b.timestamp;
+    }));
+
+    // smooth() and the differences don't read outside the range
+    std::vector<path_value> three = { { 1.0, {} }, { 2.0, {} }, { 7.0, {} } };
+    CHECK(value_test((int)smooth(three.begin(), three.end()).size(), 1));
+    CHECK(value_test(smooth(three.begin(), three.end())[0].value, 3.0, 1E-12));
+    CHECK(value_test((int)first_forward_difference(three.begin(), three.end()).size(), 2));
+    CHECK(value_test(first_forward_difference(three.begin(), three.end())[0].value, 1.0, 1E-12));
+    CHECK(value_test(first_forward_difference(three.begin(), three.end())[1].value, 5.0, 1E-12));
+    CHECK(value_test(first_central_difference(three.begin(), three.end())[0].value, 3.0, 1E-12));
+}
+
+TEST_CASE("test_analyze_path") {
+    const auto path = load_gpx_trk(make_data_path("table_mountain_loop.gpx"));
+
+    const auto same = [](const std::vector<path_value>& a, const std::vector<path_value>& b) {
+        return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](const path_value& x, const path_value& y) {
+            return x.value == y.value && x.timestamp == y.timestamp;
+        });
+    };
+
+    const auto result = analyze_path(path.begin(), path.end());
+
+    CHECK(value_test(result.distance_m, path_distance(path.begin(), path.end()), 1E-9));
+    CHECK(same(result.speed, path_speed(path)));
+    CHECK(same(result.heading, path_heading(path)));
+    CHECK(same(result.cumulative_distance, path_cumulative_distance(path)));
+
+    auto [min_it, max_it, ascent, descent] = path_elevation_summary(path);
+    CHECK(result.min_elevation == min_it);
+    CHECK(result.max_elevation == max_it);
+    CHECK(value_test(result.cumulative_ascent, ascent, 1E-9));
+    CHECK(value_test(result.cumulative_descent, descent, 1E-9));
+
+    auto [nw, ne, se, sw] = axis_aligned_bounding_box(path);
+    CHECK(value_test(std::get<0>(result.bounding_box), nw, 1E-12));
+    CHECK(value_test(std::get<1>(result.bounding_box), ne, 1E-12));
+    CHECK(value_test(std::get<2>(result.bounding_box), se, 1E-12));
+    CHECK(value_test(std::get<3>(result.bounding_box), sw, 1E-12));
+
+    const auto summary = generate_path_summary(path);
+    CHECK(result.summary.points == summary.points);
+    CHECK(value_test(result.summary.start_time, summary.start_time));
+    CHECK(value_test(result.summary.end_time, summary.end_time));
+    CHECK(value_test(result.summary.distance_m, summary.distance_m, 1E-9));
+    CHECK(value_test(result.summary.mean_speed_kph, summary.mean_speed_kph, 1E-9));
+
+    // Headings with the other distance models and prepared points
+    const auto ellipsoidal = analyze_path<analysis::distance | analysis::heading, distance_model::ellipsoidal>(path);
+    CHECK(ellipsoidal.distance_m == path_distance<distance_model::ellipsoidal>(path));
+    CHECK(same(ellipsoidal.heading, path_heading(path)));
+
+    const auto prepared = prepare_path(path);
+    CHECK(same(analyze_path<analysis::speed | analysis::heading>(prepared).heading, path_heading(prepared)));
+    CHECK(same(analyze_path<analysis::speed | analysis::heading>(prepared).speed, path_speed(prepared)));
+
+    // Only what was asked for
+    const auto some = analyze_path<analysis::distance | analysis::elevation>(path);
+    CHECK(value_test(some.distance_m, result.distance_m, 1E-9));
+    CHECK(value_test(some.cumulative_ascent, ascent, 1E-9));
+    CHECK(some.speed.empty());
+    CHECK(some.heading.empty());
+    CHECK(some.cumulative_distance.empty());
+    CHECK(value_test((int)some.summary.points, 0));
+
+    // A summary without distance still has the path's distance
+    CHECK(value_test(analyze_path<analysis::summary>(path).summary.distance_m, summary.distance_m, 1E-9));
+    CHECK(value_test(analyze_path<analysis::summary>(path).distance_m, 0.0, 1E-9));
+
+    // Empty and single point paths
+    ::path empty;
+    CHECK(analyze_path(empty).min_elevation == empty.end());
+    CHECK(value_test(analyze_path(empty).distance_m, 0.0, 1E-9));
+
+    ::path one = { path.front() };
+    const auto single = analyze_path(one);
+    CHECK(single.speed.empty());
+    CHECK(single.max_elevation == one.end());
+    CHECK(value_test(std::get<0>(single.bounding_box), std::get<0>(axis_aligned_bounding_box(one)), 1E-12));
+    CHECK(value_test((int)single.summary.points, 1));
+}
+
+TEST_CASE("test_distance_batch") {
+    // Random pairs around the globe and short hops, an odd
+    // count so that the vector backends have a scalar tail.
+    const size_t n = 20001;
+    std::mt19937_64 rng(42);
+    std::uniform_real_distribution<double> lat(-90.0, 90.0), lon(-180.0, 180.0), hop(-0.01, 0.01);
+
+    std::vector<double> lat1(n), lon1(n), lat2(n), lon2(n);
+
+    for (size_t i = 0; i != n; ++i) {
+        lat1[i] = lat(rng);
+        lon1[i] = lon(rng);
+        lat2[i] = i % 2 ? lat1[i] + hop(rng) : lat(rng);
+        lon2[i] = i % 2 ? lon1[i] + hop(rng) : lon(rng);
+    }
+
+    std::vector<double> out(n);
+    distance_batch(lat1.data(), lon1.data(), lat2.data(), lon2.data(), out.data(), n);
+
+    // The documented bound on the difference from distance()
+    bool within = true;
+
+    for (size_t i = 0; i != n; ++i) {
+        const auto d = distance({ lat1[i], lon1[i] }, { lat2[i], lon2[i] });
+
+        if (!std::isnan(d)) {
+            const auto bound = d < 19E6 ? 3E-15 * d + 1E-12 : 3E-13 * d;
+            within = within && std::abs(out[i] - d) <= bound;
+        }
+    }
+
+    CHECK(within);
+
+    // All the backends give the same results
+    for (const auto backend : { internal::simd_backend::scalar, internal::simd_backend::avx2, internal::simd_backend::avx512 }) {
+        std::vector<double> other(n);
+        internal::get_distance_kernel(backend).distance(lat1.data(), lon1.data(), lat2.data(), lon2.data(), other.data(), n);
+        CHECK(other == out);
+    }
+
+    // Point to target
+    const location target { 53.3498, -6.2603 };
+    std::vector<double> to_target(n);
+    distance_batch(lat1.data(), lon1.data(), target, to_target.data(), n);
+
+    std::vector<double> target_lat(n, target.lat), target_lon(n, target.lon);
+    distance_batch(lat1.data(), lon1.data(), target_lat.data(), target_lon.data(), out.data(), n);
+    CHECK(to_target == out);
+
+    // NaN in, NaN out
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    double d = 0.0;
+    distance_batch(&nan, &nan, target, &d, 1);
+    CHECK(std::isnan(d));
+
+    // The path functions, which use distance_batch()
+    const auto path = load_gpx_trk(make_data_path("table_mountain_loop.gpx"));
+
+    double dist = 0.0;
+
+    for (auto i = path.begin(); i != path.end() - 1; ++i) {
+        dist += distance(i->loc, std::next(i)->loc);
+    }
+
+    CHECK(value_test(path_distance(path), dist, 1E-6));
+    CHECK(value_test(path_cumulative_distance(path).back().value, dist, 1E-6));
+    CHECK(value_test(path_distance(to_path_soa(path.begin(), path.end())), path_distance(path), 1E-6));
+
+    const auto speeds = path_speed(path);
+    const auto seconds = (double)std::chrono::duration_cast<std::chrono::microseconds>(path[1].timestamp - path[0].timestamp).count() / 1E6;
+    CHECK(value_test(speeds[0].value, speed(path[0].loc, path[1].loc, seconds), 1E-9));
+
+    const location from { -33.96, 18.40 };
+    CHECK(find_farthest_point(path, from) - path.begin() == (long)find_farthest_point(to_path_soa(path.begin(), path.end()), from));
+}
+
+TEST_CASE("test_distance_models") {
+    // Vincenty's own example, Flinders Peak to Buninyong
+    const location flinders_peak { -(37 + 57 / 60.0 + 3.72030 / 3600), 144 + 25 / 60.0 + 29.52440 / 3600 };
+    const location buninyong { -(37 + 39 / 60.0 + 10.15610 / 3600), 143 + 55 / 60.0 + 35.38390 / 3600 };
+    CHECK(value_test(distance_model::ellipsoidal::distance(flinders_peak, buninyong), 54972.271, 1E-3));
+    CHECK(value_test(distance_model::ellipsoidal::distance(buninyong, buninyong), 0.0, 1E-9));
+
+    // Nearly antipodal, where Vincenty doesn't converge
+    CHECK(value_test(distance_model::ellipsoidal::distance({ 0, 0 }, { 0.5, 179.7 }), distance({ 0, 0 }, { 0.5, 179.7 }), 1E-6));
+
+    // Short hops
+    const location a { 52.98277, -6.03927 }, b { 52.98344, -6.03646 };
+    const auto h = distance(a, b);
+    CHECK(value_test(distance_model::haversine::distance(a, b), h, 1E-9));
+    CHECK(value_test(distance_model::nvector::distance(a, b), h, 1E-6));
+    CHECK(value_test(distance_model::equirectangular::distance(a, b), h, 1E-6));
+    CHECK(value_test(distance_model::flat_earth::distance(a, b), distance_model::ellipsoidal::distance(a, b), 1E-4));
+
+    // Across the antimeridian
+    CHECK(value_test(distance_model::equirectangular::distance({ 0, 179.999 }, { 0, -179.999 }), distance({ 0, 179.999 }, { 0, -179.999 }), 1E-6));
+    CHECK(value_test(distance_model::flat_earth::distance({ 0, 179.999 }, { 0, -179.999 }), distance_model::ellipsoidal::distance({ 0, 179.999 }, { 0, -179.999 }), 1E-4));
+
+    // The path functions with each model
+    const auto path = load_gpx_trk(make_data_path("table_mountain_loop.gpx"));
+    const auto dist = path_distance(path);
+
+    CHECK(value_test(path_distance<distance_model::nvector>(path), dist, 1E-3));
+    CHECK(value_test(path_distance<distance_model::equirectangular>(path.begin(), path.end()), dist, 1E-3));
+    CHECK(std::abs(path_distance<distance_model::ellipsoidal>(path) - dist) < dist * 5E-3);
+
+    double flat = 0.0;
+
+    for (auto i = path.begin(); i != path.end() - 1; ++i) {
+        flat += distance_model::flat_earth::distance(i->loc, std::next(i)->loc);
+    }
+
+    CHECK(value_test(path_distance<distance_model::flat_earth>(path), flat, 1E-6));
+    CHECK(value_test(path_distance<distance_model::flat_earth>(to_path_soa(path.begin(), path.end())), flat, 1E-6));
+    CHECK(value_test(path_cumulative_distance<distance_model::flat_earth>(path).back().value, flat, 1E-6));
+    CHECK(value_test(generate_path_summary<distance_model::flat_earth>(path).distance_m, flat, 1E-6));
+    CHECK(value_test(analyze_path<analysis::all, distance_model::flat_earth>(path).distance_m, flat, 1E-6));
+
+    const auto speeds = path_speed<distance_model::ellipsoidal>(path);
+    const auto seconds = (double)std::chrono::duration_cast<std::chrono::microseconds>(path[1].timestamp - path[0].timestamp).count() / 1E6;
+    CHECK(value_test(speeds[0].value, distance_model::ellipsoidal::distance(path[0].loc, path[1].loc) / seconds, 1E-9));
+
+    const location target { -33.96, 18.40 };
+    CHECK(find_closest_path_point_dist<distance_model::equirectangular>(path, path[100].loc) == find_closest_path_point_dist(path, path[100].loc));
+    CHECK(find_farthest_point<distance_model::ellipsoidal>(path.begin(), path.end(), target) == find_farthest_point(path, target));
+    CHECK(path.begin() + (long)find_farthest_point<distance_model::flat_earth>(to_path_soa(path.begin(), path.end()), target) == find_farthest_point(path, target));
+
+    const auto stationary = find_stationary_points(path, 10, 2 * 60);
+    CHECK(find_stationary_points<distance_model::flat_earth>(path, 10, 2 * 60) == stationary);
+}
+
+TEST_CASE("test_ellipsoidal_distances") {
+    // Long enough to be split between threads
+    const auto& loop = table_mountain_loop();
+    const auto path = make_repeated_loop(70001);
+
+    const auto one = ellipsoidal_distances(path.begin(), path.end(), 1);
+    const auto four = ellipsoidal_distances(path.begin(), path.end(), 4);
+
+    CHECK(one.size() == path.size() - 1);
+    CHECK(one == four);
+
+    // The warm starts only change where the iterations stop
+    double max_delta = 0.0;
+    internal::block_sum sum;
+
+    for (size_t i = 0; i != one.size(); ++i) {
+        max_delta = std::max(max_delta, std::abs(one[i] - distance_model::ellipsoidal::distance(path[i].loc, path[i + 1].loc)));
+        sum.add(i, one[i]);
+    }
+
+    CHECK(max_delta < 1E-5);
+
+    // As a path_distance() backend, the same for long and short paths,
+    // and for any number of threads
+    const auto dist = sum.value();
+
+    CHECK(path_distance<distance_model::ellipsoidal>(path) == dist);
+    CHECK(path_distance_parallel<distance_model::ellipsoidal>(path, 1) == dist);
+    CHECK(path_distance_parallel<distance_model::ellipsoidal>(path, 4) == dist);
+
+    internal::block_sum loop_sum;
+    internal::compensated_sum loop_running;
+
+    for (size_t i = 0; i + 1 != loop.size(); ++i) {
+        loop_sum.add(i, one[i]);
+        loop_running.add(one[i]);
+    }
+
+    CHECK(path_distance<distance_model::ellipsoidal>(loop) == loop_sum.value());
+    CHECK(path_cumulative_distance<distance_model::ellipsoidal>(loop).back().value == loop_running.value());
+
+    // Differs from the spherical distance by under 0.5%
+    CHECK(std::abs(dist - path_distance(path)) < 5E-3 * dist);
+
+    ::path empty;
+    CHECK(ellipsoidal_distances(empty.begin(), empty.end()).empty());
+    CHECK(ellipsoidal_distances(loop.begin(), loop.begin() + 1).empty());
+}
+
+TEST_CASE("test_prepared_path") {
+    const location a { 52.98277, -6.03927 }, b { 52.98344, -6.03646 };
+    const auto pa = prepare_location(a), pb = prepare_location(b);
+
+    CHECK(value_test(pa.loc, a, 1E-12));
+    CHECK(value_test(pa.x * pa.x + pa.y * pa.y + pa.z * pa.z, 1.0, 1E-12));
+    CHECK(value_test(distance(pa, pb), distance(a, b), 1E-8));
+    CHECK(distance_vec(pa, pb) == distance_vec(a, b));
+    CHECK(value_test(heading(pa, pb), heading(a, b), 1E-9));
+    CHECK(value_test(speed(pa, pb, 10.0), speed(a, b, 10.0), 1E-9));
+    CHECK(value_test(distance(pa, pa), 0.0, 1E-9));
+
+    // The path functions on a prepared path
+    const auto path = load_gpx_trk(make_data_path("table_mountain_loop.gpx"));
+    const auto prepared = prepare_path(path);
+
+    CHECK(prepared.size() == path.size());
+    CHECK(prepared.back().timestamp == path.back().timestamp);
+    CHECK(value_test(path_distance(prepared), path_distance(path), 1E-6));
+    CHECK(value_test(path_cumulative_distance(prepared).back().value, path_distance(path), 1E-6));
+
+    const auto headings = path_heading(prepared);
+    const auto expected = path_heading(path);
+    CHECK(headings.size() == expected.size());
+    CHECK(value_test(headings[10].value, expected[10].value, 1E-6));
+    CHECK(path_speed(prepared).size() == path.size() - 1);
+
+    // Prepared targets
+    const auto target = prepare_location(path[100].loc);
+    CHECK(find_closest_path_point_dist(prepared, target) - prepared.begin() == find_closest_path_point_dist(path, path[100].loc) - path.begin());
+    CHECK(find_closest_path_point_dist(path, target) == find_closest_path_point_dist(path, path[100].loc));
+
+    const auto from = prepare_location({ -33.96, 18.40 });
+    CHECK(find_farthest_point(prepared.begin(), prepared.end(), from) - prepared.begin() == find_farthest_point(path, from.loc) - path.begin());
+    CHECK(find_farthest_point(path, from) == find_farthest_point(path, from.loc));
+
+    // Other distance models use the locations
+    CHECK(value_test(path_distance<distance_model::flat_earth>(prepared), path_distance<distance_model::flat_earth>(path), 1E-9));
+
+    auto [start, end] = find_stationary_points(prepared, 10, 2 * 60);
+    auto [path_start, path_end] = find_stationary_points(path, 10, 2 * 60);
+    CHECK(start - prepared.begin() == path_start - path.begin());
+    CHECK(end - prepared.begin() == path_end - path.begin());
+}
+
+TEST_CASE("test_path_spatial_index") {
+    // Two copies of the loop, so every point has a twin further on
+    const auto& loop = table_mountain_loop();
+    const auto path = make_repeated_loop(2 * loop.size());
+
+    const path_spatial_index index(path.begin(), path.end());
+    CHECK(index.size() == path.size());
+
+    std::vector<location> targets;
+
+    // The path points, ties go to the first
+    for (size_t i = 0; i < path.size(); i += 7) {
+        targets.push_back(path[i].loc);
+    }
+
+    // Nearby, between the points and far away
+    for (size_t i = 0; i + 1 < loop.size(); i += 13) {
+        const auto& a = loop[i].loc;
+        const auto& b = loop[i + 1].loc;
+        targets.push_back({ (a.lat + b.lat) / 2.0, (a.lon + b.lon) / 2.0 });
+        targets.push_back({ a.lat + 0.001 * static_cast<double>(i % 5), a.lon - 0.002 * static_cast<double>(i % 3) });
+    }
+
+    targets.push_back({ 33.96, -161.6 });
+    targets.push_back({ 90.0, 0.0 });
+    targets.push_back({ -33.96, 18.40 });
+
+    for (size_t i = 0; i != targets.size(); ++i) {
+        CAPTURE(i);
+        CHECK(index.find_closest(targets[i]) - path.begin() == find_closest_path_point_dist(path, targets[i]) - path.begin());
+    }
+
+    // Batched queries
+    const auto one = index.find_closest(targets, 1);
+    const auto four = index.find_closest(targets, 4);
+    CHECK(one == four);
+
+    for (size_t i = 0; i != targets.size(); ++i) {
+        CAPTURE(i);
+        CHECK(one[i] - path.begin() == index.find_closest(targets[i]) - path.begin());
+    }
+
+    // Other point types
+    compact_path compact;
+    CHECK(to_compact_path(path.begin(), path.end(), compact));
+    const auto compact_index = make_path_spatial_index(compact);
+    CHECK(compact_index.find_closest(targets[3]) == find_closest_path_point_dist(compact, targets[3]));
+
+    ::path empty;
+    const auto empty_index = make_path_spatial_index(empty);
+    CHECK(empty_index.empty());
+    CHECK(empty_index.find_closest(targets[0]) == empty.end());
+}
+
+TEST_CASE("test_path_time_index") {
+    // Geotag the camera frames of the pass4 log
+    const auto file = make_data_path("pass4_gps_track_log_24_08_2022.csv");
+    const auto table = load_csv_columns(file, gps_log_csv_schema());
+    const auto log = csv_table_to_path(table);
+
+    // The log starts with some out of order fixes from 1980 while it synchronises
+    const auto log_index = make_path_time_index(log);
+    CHECK(!log_index.sorted());
+    CHECK(log_index.find_closest(log[50].timestamp) == find_closest_path_point_time(log, log[50].timestamp));
+
+    const ::path path(log.begin() + 100, log.end());
+    const auto index = make_path_time_index(path);
+    CHECK(index.sorted());
+    CHECK(index.size() == path.size());
+
+    std::vector<path_time> frames;
+
+    for (const auto ms : table.column("image_timestamp")->integers) {
+        if (ms > 0) {
+            frames.push_back(path_time(std::chrono::milliseconds(ms)));
+        }
+    }
+
+    CHECK(frames.size() > 1000);
+
+    // Before, after and exactly at the points
+    frames.insert(frames.begin(), path.front().timestamp - std::chrono::seconds(10));
+    frames.push_back(path[500].timestamp);
+    frames.push_back(path.back().timestamp + std::chrono::seconds(10));
+
+    for (size_t i = 0; i != frames.size(); ++i) {
+        CAPTURE(i);
+        CHECK(index.find_closest(frames[i]) - path.begin() == find_closest_path_point_time(path, frames[i]) - path.begin());
+    }
+
+    // Batches, merged when sorted
+    const auto closest = index.find_closest(frames);
+    const auto positions = index.position_at(frames);
+
+    for (size_t i = 0; i != frames.size(); ++i) {
+        const auto loc = index.position_at(frames[i]);
+
+        CAPTURE(i);
+        CHECK(closest[i] - path.begin() == index.find_closest(frames[i]) - path.begin());
+        CHECK((loc.lat == positions[i].lat && loc.lon == positions[i].lon && loc.ele == positions[i].ele));
+    }
+
+    // Interpolation
+    const auto& a = path[1000];
+    const auto& b = path[1001];
+    const auto mid = a.timestamp + (b.timestamp - a.timestamp) / 2;
+    CHECK(value_test(index.position_at(mid).lat, (a.loc.lat + b.loc.lat) / 2.0, 1E-9));
+    CHECK(value_test(index.position_at(mid).lon, (a.loc.lon + b.loc.lon) / 2.0, 1E-9));
+    CHECK(value_test(index.position_at(mid).ele, (a.loc.ele + b.loc.ele) / 2.0, 1E-9));
+    CHECK(value_test(index.position_at(a.timestamp).lat, a.loc.lat, 1E-12));
+    CHECK(value_test(index.position_at(frames.front()).lat, path.front().loc.lat, 1E-12));
+    CHECK(value_test(index.position_at(frames.back()).lat, path.back().loc.lat, 1E-12));
+
+    // Equal timestamps, the first wins, and across the antimeridian
+    const auto t0 = path_time(std::chrono::seconds(1000));
+    ::path small = {
+        { { 10.0, 179.0, 0.0 }, t0 },
+        { { 11.0, -179.0, 10.0 }, t0 + std::chrono::seconds(10) },
+        { { 12.0, -178.0, 20.0 }, t0 + std::chrono::seconds(10) },
+        { { 13.0, -177.0, 30.0 }, t0 + std::chrono::seconds(20) }
+    };
+
+    const auto small_index = make_path_time_index(small);
+    CHECK(small_index.find_closest(t0 + std::chrono::seconds(10)) - small.begin() == 1);
+    CHECK(small_index.find_closest(t0 + std::chrono::seconds(14)) - small.begin() == 1);
+    CHECK(small_index.find_closest(t0 + std::chrono::seconds(15)) - small.begin() == 1);
+    CHECK(small_index.find_closest(t0 + std::chrono::seconds(16)) - small.begin() == 3);
+    CHECK(value_test(small_index.position_at(t0 + std::chrono::seconds(5)).lon, 180.0, 1E-9));
+    CHECK(value_test(small_index.position_at(t0 + std::chrono::seconds(15)).lat, 12.5, 1E-9));
+
+    // Out of order timestamps fall back to scanning
+    std::swap(small[0], small[3]);
+    const auto unsorted_index = make_path_time_index(small);
+    CHECK(!unsorted_index.sorted());
+
+    for (const auto s : { 0, 4, 10, 16, 30 }) {
+        const auto t = t0 + std::chrono::seconds(s);
+        CHECK(unsorted_index.find_closest(t) == find_closest_path_point_time(small, t));
+    }
+
+    ::path empty;
+    CHECK(make_path_time_index(empty).find_closest(t0) == empty.end());
+}
+
+TEST_CASE("test_path_prefix_index") {
+    const auto path = load_gpx_trk(make_data_path("table_mountain_loop.gpx"));
+    const auto index = make_path_prefix_index(path);
+    CHECK(index.size() == path.size());
+
+    // Laps of the path
+    const std::pair<size_t, size_t> ranges[] = { { 0, path.size() }, { 0, 1 }, { 5, 5 }, { 10, 12 }, { 100, 900 }, { 733, path.size() } };
+
+    for (const auto& [i, j] : ranges) {
+        const auto start = path.begin() + static_cast<std::ptrdiff_t>(i);
+        const auto end = path.begin() + static_cast<std::ptrdiff_t>(j);
+
+        CHECK(value_test(index.distance(i, j), path_distance(start, end), 1E-6));
+
+        const auto [min_it, max_it, ascent, descent] = path_elevation_summary(start, end);
+        CHECK(value_test(index.ascent(i, j), ascent, 1E-6));
+        CHECK(value_test(index.descent(i, j), descent, 1E-6));
+
+        const auto summary = index.summary(i, j);
+        const auto expected = generate_path_summary(start, end);
+        CHECK(summary.points == expected.points);
+        CHECK(summary.start_time == expected.start_time);
+        CHECK(summary.end_time == expected.end_time);
+        CHECK(value_test(summary.duration_s, expected.duration_s, 1E-9));
+        CHECK(value_test(summary.distance_m, expected.distance_m, 1E-6));
+        CHECK(value_test(summary.mean_speed_kph, expected.mean_speed_kph, 1E-6));
+    }
+
+    CHECK(value_test(index.mean_speed(0, path.size()), index.distance(0, path.size()) / index.duration(0, path.size()), 1E-12));
+
+    // Appending a point or range at a time gives the same totals
+    path_prefix_index appended;
+
+    for (size_t i = 0; i != 100; ++i) {
+        appended.push_back(path[i]);
+    }
+
+    appended.append(path.begin() + 100, path.end());
+
+    CHECK(appended.size() == index.size());
+    CHECK(appended.distance(0, path.size()) == index.distance(0, path.size()));
+    CHECK(appended.distance(50, 150) == index.distance(50, 150));
+    CHECK(appended.ascent(0, path.size()) == index.ascent(0, path.size()));
+
+    appended.clear();
+    CHECK(appended.empty());
+    CHECK(appended.distance(0, 0) == 0.0);
+
+    // Other distance models, e.g. the ellipsoid for billing, to within where
+    // the warm started iterations stop for ranges starting elsewhere
+    const auto ellipsoidal = make_path_prefix_index<distance_model::ellipsoidal>(path);
+    CHECK(value_test(ellipsoidal.distance(0, path.size()), path_distance<distance_model::ellipsoidal>(path), 1E-6));
+    CHECK(value_test(ellipsoidal.distance(100, 900), path_distance<distance_model::ellipsoidal>(path.begin() + 100, path.begin() + 900), 1E-4));
+    CHECK(std::abs(ellipsoidal.distance(0, path.size()) - index.distance(0, path.size())) > 1.0);
+
+    path_prefix_index<distance_model::ellipsoidal> pushed;
+
+    for (size_t i = 0; i != 10; ++i) {
+        pushed.push_back(path[i]);
+    }
+
+    CHECK(value_test(pushed.distance(0, 10), ellipsoidal.distance(0, 10), 1E-4));
+}
+
+TEST_CASE("test_path_range_index") {
+    // Three copies of the loop, so the min & max elevations are repeated
+    const auto& loop = table_mountain_loop();
+    const auto path = make_repeated_loop(3 * loop.size());
+
+    const auto index = make_path_range_index(path);
+    CHECK(index.size() == path.size());
+
+    size_t queries = 0;
+
+    // Ranges within a block, across a few blocks and over most of the path
+    for (size_t i = 0; i < path.size(); i += 97) {
+        for (const size_t length : { 2, 5, 31, 32, 33, 64, 100, 1000, 5000 }) {
+            const auto j = std::min(i + length, path.size());
+
+            if (j - i < 2) {
+                continue;
+            }
+
+            const auto start = path.begin() + static_cast<std::ptrdiff_t>(i);
+            const auto end = path.begin() + static_cast<std::ptrdiff_t>(j);
+
+            const auto [min_it, max_it] = index.elevation_range(i, j);
+            const auto [expected_min, expected_max, ascent, descent] = path_elevation_summary(start, end);
+
+            const auto [nw, ne, se, sw] = index.bounding_box(i, j);
+            const auto [expected_nw, expected_ne, expected_se, expected_sw] = axis_aligned_bounding_box(start, end);
+
+            CAPTURE(i);
+            CAPTURE(j);
+            CHECK(min_it - path.begin() == expected_min - path.begin());
+            CHECK(max_it - path.begin() == expected_max - path.begin());
+            CHECK((nw.lat == expected_nw.lat && nw.lon == expected_nw.lon && se.lat == expected_se.lat && se.lon == expected_se.lon));
+
+            ++queries;
+        }
+    }
+
+    CHECK(queries > 1000);
+
+    // The whole path, the first of the repeated extremes
+    const auto [min_it, max_it] = index.elevation_range(0, path.size());
+    CHECK(min_it - path.begin() < static_cast<std::ptrdiff_t>(loop.size()));
+    CHECK(max_it - path.begin() < static_cast<std::ptrdiff_t>(loop.size()));
+
+    // Single points and empty ranges
+    CHECK(std::get<0>(index.elevation_range(7, 8)) - path.begin() == 7);
+    CHECK(std::get<0>(index.elevation_range(7, 7)) == path.end());
+    CHECK(std::get<0>(index.bounding_box(7, 8)).lat == path[7].loc.lat);
+
+    ::path empty;
+    CHECK(make_path_range_index(empty).empty());
+}
+
+TEST_CASE("test_path_linear_reference") {
+    // Two copies of the loop, so the route crosses over itself
+    const auto& loop = table_mountain_loop();
+    const auto path = make_repeated_loop(2 * loop.size());
+
+    const auto route = make_path_linear_reference(path);
+    const auto cumulative = path_cumulative_distance(path);
+
+    CHECK(route.size() == path.size());
+    CHECK(route.length() == cumulative.back().value);
+
+    // Points along the path
+    CHECK(route.point_at_distance(0.0).loc.lat == path.front().loc.lat);
+    CHECK(route.point_at_distance(-5.0).loc.lon == path.front().loc.lon);
+    CHECK(route.point_at_distance(route.length() + 5.0).loc.lat == path.back().loc.lat);
+    CHECK(route.point_at_distance(cumulative[99].value).loc.lat == path[100].loc.lat);
+    CHECK(route.point_at_distance(cumulative[99].value).sequence == 100);
+
+    const auto half = (cumulative[99].value + cumulative[100].value) / 2.0;
+    const auto mid = route.point_at_distance(half);
+    CHECK(value_test(mid.loc.lat, (path[100].loc.lat + path[101].loc.lat) / 2.0, 1E-9));
+    CHECK(value_test(mid.loc.lon, (path[100].loc.lon + path[101].loc.lon) / 2.0, 1E-9));
+    CHECK(std::abs((mid.timestamp - (path[100].timestamp + (path[101].timestamp - path[100].timestamp) / 2)).count()) < 1000);
+
+    // Projections, the same as the scan of the segments
+    std::vector<location> targets;
+
+    for (size_t i = 0; i + 1 < loop.size(); i += 11) {
+        const auto& a = loop[i].loc;
+        targets.push_back(a);
+        targets.push_back({ a.lat + 0.0003 * static_cast<double>(i % 7), a.lon - 0.0002 * static_cast<double>(i % 5) });
+    }
+
+    targets.push_back({ -33.96, 18.40 });
+    targets.push_back({ 51.5, -0.1 });
+
+    for (size_t i = 0; i != targets.size(); ++i) {
+        const auto p = route.project_onto_path(targets[i]);
+        const auto expected = project_onto_path(path, targets[i]);
+        const auto vertex = find_closest_path_point_dist(path, targets[i]);
+
+        CAPTURE(i);
+        CHECK(p.segment == expected.segment);
+        CHECK(p.distance_m == expected.distance_m);
+        CHECK((p.loc.lat == expected.loc.lat && p.loc.lon == expected.loc.lon));
+        CHECK(p.offset_m == expected.offset_m);
+        CHECK(p.timestamp == expected.timestamp);
+
+        // No further away than the closest point
+        CHECK(p.offset_m <= distance(vertex->loc, targets[i]) + 1E-6);
+    }
+
+    // Projecting a point along the path finds it again, on the first lap
+    const auto along = route.point_at_distance(half);
+    const auto p = route.project_onto_path(along.loc);
+    CHECK(p.segment == 100);
+    CHECK(value_test(p.distance_m, half, 1E-3));
+    CHECK(p.offset_m < 1E-3);
+
+    // Other distance models
+    const auto ellipsoidal_route = make_path_linear_reference<distance_model::ellipsoidal>(path);
+    CHECK(value_test(ellipsoidal_route.length(), path_cumulative_distance<distance_model::ellipsoidal>(path).back().value, 1E-4));
+    CHECK(ellipsoidal_route.length() != route.length());
+
+    for (size_t i = 0; i < targets.size(); i += 9) {
+        const auto p = ellipsoidal_route.project_onto_path(targets[i]);
+        const auto expected = project_onto_path<distance_model::ellipsoidal>(path, targets[i]);
+
+        CAPTURE(i);
+        CHECK(p.segment == expected.segment);
+        CHECK(value_test(p.distance_m, expected.distance_m, 1E-4));
+    }
+
+    // Other point types and short paths
+    compact_path compact;
+    CHECK(to_compact_path(path.begin(), path.end(), compact));
+    CHECK(make_path_linear_reference(compact).project_onto_path(targets[5]).segment == project_onto_path(compact, targets[5]).segment);
+
+    const ::path one_point(path.begin(), path.begin() + 1);
+    CHECK(make_path_linear_reference(one_point).project_onto_path(targets[3]).loc.lat == path.front().loc.lat);
+    CHECK(project_onto_path(one_point, targets[3]).distance_m == 0.0);
+
+    ::path empty;
+    CHECK(make_path_linear_reference(empty).empty());
+    CHECK(make_path_linear_reference(empty).length() == 0.0);
+    CHECK(project_onto_path(empty, targets[0]).segment == 0);
+}
+
+TEST_CASE("test_parallel_reductions") {
+    // Several reduction blocks long, with repeated min & max elevations
+    const auto& loop = table_mountain_loop();
+    const auto path = make_repeated_loop(20001);
+
+    const location from { -33.96, 18.40 };
+
+    for (const unsigned threads : { 1u, 3u, 4u }) {
+        CHECK(path_distance_parallel(path, threads) == path_distance(path));
+        CHECK(path_distance_parallel<distance_model::flat_earth>(path, threads) == path_distance<distance_model::flat_earth>(path));
+        CHECK(find_farthest_point_parallel(path, from, threads) == find_farthest_point(path, from));
+
+        const auto [nw, ne, se, sw] = axis_aligned_bounding_box_parallel(path, threads);
+        const auto [path_nw, path_ne, path_se, path_sw] = axis_aligned_bounding_box(path);
+        CHECK((nw.lat == path_nw.lat && nw.lon == path_nw.lon && se.lat == path_se.lat && se.lon == path_se.lon));
+        CHECK((ne.lat == path_ne.lat && ne.lon == path_ne.lon && sw.lat == path_sw.lat && sw.lon == path_sw.lon));
+
+        CHECK(path_elevation_summary_parallel(path, threads) == path_elevation_summary(path));
+    }
+
+    // The same sums as the single pass and structure of arrays versions
+    CHECK(analyze_path<analysis::distance>(path).distance_m == path_distance(path));
+    CHECK(path_distance(to_path_soa(path.begin(), path.end())) == path_distance(path));
+
+    const auto analysis = analyze_path<analysis::elevation>(path);
+    CHECK(analysis.cumulative_ascent == std::get<2>(path_elevation_summary(path)));
+    CHECK(analysis.cumulative_descent == std::get<3>(path_elevation_summary(path)));
+
+    // Short & empty paths
+    ::path empty;
+    CHECK(path_distance_parallel(empty) == 0.0);
+    CHECK(path_distance_parallel(loop.begin(), loop.begin() + 1) == 0.0);
+    CHECK(find_farthest_point_parallel(empty, from) == empty.end());
+    CHECK(std::get<0>(path_elevation_summary_parallel(loop.begin(), loop.begin() + 1)) == path::const_iterator{});
+    CHECK(path_distance_parallel(loop) == path_distance(loop));
+
+    // Compensated summation keeps the small values a naive sum loses
+    internal::compensated_sum sum;
+    double naive = 0.0;
+
+    for (const double x : { 1.0, 1E100, 1.0, -1E100 }) {
+        sum.add(x);
+        naive += x;
+    }
+
+    CHECK(sum.value() == 2.0);
+    CHECK(naive == 0.0);
+}
+
 #if 0
 static void test_100m() {
 	auto path = load_gpx_trk_qd(make_data_path("knocknalogha_moot_25.gpx"));